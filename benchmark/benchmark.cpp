@@ -0,0 +1,491 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "probe-cache.h"
+#include "transcoder.h"
+#include "video-decoder.h"
+#include "video-encoder.h"
+
+using Clock = std::chrono::steady_clock;
+
+
+/**
+ * A synthetic clip to generate and measure.
+ */
+struct Clip {
+    int width;
+    int height;
+    std::string extension;              // Output container.
+    std::string codec_name;             // Encoder, named explicitly rather than left to the container.
+    int gop_size;                       // Distance between keyframes in frames, which bounds seek costs.
+};
+
+
+/**
+ * A single measurement.
+ */
+struct Metric {
+    std::string name;
+    double value;
+    std::string unit;
+    bool higher_is_better;
+};
+
+
+/**
+ * Command line options.
+ */
+struct Options {
+    std::string output;                 // JSON file to write, or empty to write to stdout.
+    std::string work_directory = "benchmark-media";
+    int frames = 120;
+    int seeks = 20;
+    int opens = 10;
+};
+
+
+/**
+ * Returns the time elapsed since a point in time in milliseconds.
+ */
+static double getMillisecondsSince(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+
+/**
+ * Returns the median of a list of samples.
+ */
+static double getMedian(std::vector<double> samples) {
+    std::sort(samples.begin(), samples.end());
+    return samples.empty() ? 0.0 : samples[samples.size() / 2];
+}
+
+
+/**
+ * Returns the given percentile (0-100) of a list of samples.
+ */
+static double getPercentile(std::vector<double> samples, double percentile) {
+    std::sort(samples.begin(), samples.end());
+    if (samples.empty()) {
+        return 0.0;
+    }
+    const auto index = static_cast<size_t>(percentile / 100.0 * static_cast<double>(samples.size() - 1) + 0.5);
+    return samples[index];
+}
+
+
+/**
+ * Fills an RGB24 buffer with a deterministic test pattern: a diagonal gradient that scrolls with the
+ * frame index and a square that moves across it, so the encoder sees both texture and motion.
+ */
+static void fillPattern(uint8_t *rgb_buffer, int width, int height, int frame_index) {
+    const int square_size = height / 4;
+    const int square_x = (frame_index * 7) % std::max(width - square_size, 1);
+    const int square_y = (frame_index * 3) % std::max(height - square_size, 1);
+
+    for (int y = 0; y < height; y++) {
+        uint8_t *row = rgb_buffer + static_cast<size_t>(y) * width * 3;
+        for (int x = 0; x < width; x++) {
+            const bool in_square = x >= square_x && x < square_x + square_size &&
+                y >= square_y && y < square_y + square_size;
+            row[3 * x] = in_square ? 255 : static_cast<uint8_t>(x + frame_index);
+            row[3 * x + 1] = in_square ? 255 : static_cast<uint8_t>(y + 2 * frame_index);
+            row[3 * x + 2] = in_square ? 0 : static_cast<uint8_t>((x + y) / 2);
+        }
+    }
+}
+
+
+/**
+ * Returns a name identifying a clip in metric names, e.g. "1280x720-libx264-gop12.mp4".
+ */
+static std::string getClipName(const Clip &clip) {
+    return std::to_string(clip.width) + "x" + std::to_string(clip.height) + "-" + clip.codec_name + "-gop" +
+        std::to_string(clip.gop_size) + clip.extension;
+}
+
+
+/**
+ * Returns the encoder options a clip is encoded with.
+ */
+static VideoEncoderOptions getEncoderOptions(const Clip &clip) {
+    VideoEncoderOptions encoder_options;
+    encoder_options.codec_name = clip.codec_name;
+    encoder_options.gop_size = clip.gop_size;
+    return encoder_options;
+}
+
+
+/**
+ * Checks whether the FFmpeg build includes a clip's encoder (e.g. libx264 is optional).
+ */
+static bool isEncoderAvailable(const Clip &clip) {
+    return avcodec_find_encoder_by_name(clip.codec_name.c_str()) != nullptr;
+}
+
+
+/**
+ * Generates a clip and measures the encoding frame rate. Only the encoder calls are timed, not the
+ * generation of the test pattern.
+ */
+static void generateClip(const Clip &clip, const std::string &path, const Options &options,
+    std::vector<Metric> &metrics) {
+    std::vector<uint8_t> rgb_buffer(static_cast<size_t>(clip.width) * clip.height * 3);
+    VideoEncoder encoder(path, clip.width, clip.height, 30.0, int64_t{clip.width} * clip.height * 4,
+        getEncoderOptions(clip));
+
+    double encode_ms = 0.0;
+    for (int i = 0; i < options.frames; i++) {
+        fillPattern(rgb_buffer.data(), clip.width, clip.height, i);
+        const Clock::time_point start = Clock::now();
+        encoder.encodeFrame(rgb_buffer.data(), clip.width, clip.height);
+        encode_ms += getMillisecondsSince(start);
+    }
+    const Clock::time_point start = Clock::now();
+    encoder.finalize();
+    encode_ms += getMillisecondsSince(start);
+
+    metrics.push_back({"encode_fps/" + getClipName(clip), options.frames / (encode_ms / 1000.0), "fps", true});
+}
+
+
+/**
+ * Measures the encoding frame rate of a clip's resolution with frame and with slice threading, for
+ * several thread counts and the automatic one (the CPUs available to the process).
+ */
+static void measureEncodeThreads(const Clip &clip, const Options &options, std::vector<Metric> &metrics) {
+    const std::string path = (std::filesystem::path(options.work_directory) /
+        ("encode-threads-" + getClipName(clip))).string();
+    std::vector<uint8_t> rgb_buffer(static_cast<size_t>(clip.width) * clip.height * 3);
+
+    for (const EncoderThreadType thread_type : {EncoderThreadType::FRAME, EncoderThreadType::SLICE}) {
+        for (const int thread_count : {1, 2, 4, 0}) {
+            VideoEncoderOptions encoder_options = getEncoderOptions(clip);
+            encoder_options.thread_type = thread_type;
+            encoder_options.thread_count = thread_count;
+            VideoEncoder encoder(path, clip.width, clip.height, 30.0, int64_t{clip.width} * clip.height * 4,
+                encoder_options);
+
+            double encode_ms = 0.0;
+            for (int i = 0; i < options.frames; i++) {
+                fillPattern(rgb_buffer.data(), clip.width, clip.height, i);
+                const Clock::time_point start = Clock::now();
+                encoder.encodeFrame(rgb_buffer.data(), clip.width, clip.height);
+                encode_ms += getMillisecondsSince(start);
+            }
+            const Clock::time_point start = Clock::now();
+            encoder.finalize();
+            encode_ms += getMillisecondsSince(start);
+
+            const std::string threads = thread_count > 0 ? std::to_string(thread_count) : "auto";
+            const char *type = thread_type == EncoderThreadType::FRAME ? "frame" : "slice";
+            metrics.push_back({"encode_fps/threads-" + threads + "/" + type + "/" + getClipName(clip),
+                options.frames / (encode_ms / 1000.0), "fps", true});
+        }
+    }
+}
+
+
+/**
+ * Measures the encoding and input conversion frame rates of encoding 4K RGB frames into a 1080p
+ * video, with a single scaler thread and with the automatic slice-threaded scaling.
+ */
+static void measureDownscaleEncode(const Options &options, std::vector<Metric> &metrics) {
+    constexpr int INPUT_WIDTH = 3840;
+    constexpr int INPUT_HEIGHT = 2160;
+    const Clip clip{1920, 1080, ".mp4", "libx264", 12};
+    if (!isEncoderAvailable(clip)) {
+        std::cerr << "skipping " << getClipName(clip) << ": encoder unavailable" << std::endl;
+        return;
+    }
+    const std::string path = (std::filesystem::path(options.work_directory) / "downscale-encode.mp4").string();
+    std::vector<uint8_t> rgb_buffer(static_cast<size_t>(INPUT_WIDTH) * INPUT_HEIGHT * 3);
+
+    for (const int scaler_threads : {1, 0}) {
+        VideoEncoderOptions encoder_options = getEncoderOptions(clip);
+        encoder_options.scaler_threads = scaler_threads;
+        VideoEncoder encoder(path, clip.width, clip.height, 30.0, int64_t{clip.width} * clip.height * 4,
+            encoder_options);
+        encoder.setStatsEnabled(true);
+
+        double encode_ms = 0.0;
+        for (int i = 0; i < options.frames; i++) {
+            fillPattern(rgb_buffer.data(), INPUT_WIDTH, INPUT_HEIGHT, i);
+            const Clock::time_point start = Clock::now();
+            encoder.encodeFrame(rgb_buffer.data(), INPUT_WIDTH, INPUT_HEIGHT);
+            encode_ms += getMillisecondsSince(start);
+        }
+        const Clock::time_point start = Clock::now();
+        encoder.finalize();
+        encode_ms += getMillisecondsSince(start);
+
+        const std::string name = "scaler-threads-" + (scaler_threads > 0 ? std::to_string(scaler_threads) : "auto") +
+            "/" + std::to_string(INPUT_WIDTH) + "x" + std::to_string(INPUT_HEIGHT) + "-to-" + getClipName(clip);
+        const StageStats convert = encoder.getStats().convert;
+        metrics.push_back({"encode_fps/" + name, options.frames / (encode_ms / 1000.0), "fps", true});
+        if (convert.total_ns > 0) {
+            metrics.push_back({"encoder_convert_fps/" + name,
+                static_cast<double>(convert.calls) / (static_cast<double>(convert.total_ns) / 1e9), "fps", true});
+        }
+    }
+}
+
+
+/**
+ * Measures how long it takes to open a clip with probing and with a warm probe cache.
+ */
+static void measureOpen(const Clip &clip, const std::string &path, const Options &options,
+    std::vector<Metric> &metrics) {
+    std::vector<double> probe_ms;
+    for (int i = 0; i < options.opens; i++) {
+        const Clock::time_point start = Clock::now();
+        VideoDecoder decoder(path);
+        probe_ms.push_back(getMillisecondsSince(start));
+    }
+
+    const std::filesystem::path cache_directory = std::filesystem::path(options.work_directory) / "probe-cache";
+    std::filesystem::remove_all(cache_directory);
+    ProbeCache cache(cache_directory.string());
+    VideoDecoderOptions decoder_options;
+    decoder_options.probe_cache = &cache;
+    VideoDecoder warm_up(path, decoder_options);
+
+    std::vector<double> cached_ms;
+    for (int i = 0; i < options.opens; i++) {
+        const Clock::time_point start = Clock::now();
+        VideoDecoder decoder(path, decoder_options);
+        cached_ms.push_back(getMillisecondsSince(start));
+    }
+
+    metrics.push_back({"open_ms/probe/" + getClipName(clip), getMedian(probe_ms), "ms", false});
+    metrics.push_back({"open_ms/cached/" + getClipName(clip), getMedian(cached_ms), "ms", false});
+}
+
+
+/**
+ * Measures the decoding frame rate without any conversion.
+ */
+static void measureDecode(const Clip &clip, const std::string &path, std::vector<Metric> &metrics) {
+    VideoDecoder decoder(path);
+    AVFrame *frame = av_frame_alloc();
+    if (!frame) {
+        throw std::runtime_error("couldn't allocate frame");
+    }
+
+    int frames = 0;
+    const Clock::time_point start = Clock::now();
+    while (decoder.getNextFrame(frame)) {
+        frames++;
+    }
+    const double decode_ms = getMillisecondsSince(start);
+    av_frame_free(&frame);
+
+    metrics.push_back({"decode_fps/" + getClipName(clip), frames / (decode_ms / 1000.0), "fps", true});
+}
+
+
+/**
+ * Measures the frame rate of transcoding to half size, serially and with the pipelined transcoder.
+ */
+static void measureTranscode(const Clip &clip, const std::string &path, const Options &options,
+    std::vector<Metric> &metrics) {
+    TranscodeOptions transcode_options;
+    transcode_options.width = clip.width / 2;
+    transcode_options.height = clip.height / 2;
+
+    for (const bool pipelined : {false, true}) {
+        const char *mode = pipelined ? "pipelined" : "serial";
+        const std::string output_path = (std::filesystem::path(options.work_directory) /
+            (std::string("transcode-") + mode + "-" + getClipName(clip))).string();
+
+        Transcoder transcoder(path, output_path, transcode_options);
+        const Clock::time_point start = Clock::now();
+        const TranscodeStats stats = pipelined ? transcoder.runPipelined() : transcoder.run();
+        const double transcode_ms = getMillisecondsSince(start);
+
+        metrics.push_back({std::string("transcode_fps/") + mode + "/" + getClipName(clip),
+            static_cast<double>(stats.frames) / (transcode_ms / 1000.0), "fps", true});
+    }
+}
+
+
+/**
+ * Measures the throughput of each output format using the decoder's convert stage stats.
+ */
+static void measureConversion(const Clip &clip, const std::string &path, std::vector<Metric> &metrics) {
+    struct Format {
+        const char *name;
+        FrameOutputFormat format;
+        int bytes_per_pixel;
+    };
+    const Format formats[] = {
+        {"rgb24", FrameOutputFormat::RGB24, 3},
+        {"gray8", FrameOutputFormat::GRAY8, 1},
+        {"rgb48", FrameOutputFormat::RGB48, 6},
+        {"rgbf32", FrameOutputFormat::RGBF32, 12},
+    };
+
+    VideoDecoder decoder(path);
+    for (const Format &format : formats) {
+        std::vector<uint8_t> buffer(static_cast<size_t>(clip.width) * clip.height * format.bytes_per_pixel);
+        FrameOutput output;
+        output.data = buffer.data();
+        output.format = format.format;
+
+        decoder.seekToTimestamp(0);
+        decoder.resetStats();
+        decoder.setStatsEnabled(true);
+        while (decoder.getNextFrame(output)) {
+        }
+        decoder.setStatsEnabled(false);
+
+        const StageStats stats = decoder.getStats().convert;
+        const double seconds = static_cast<double>(stats.total_ns) / 1e9;
+        if (stats.calls == 0 || seconds <= 0.0) {
+            continue;
+        }
+        metrics.push_back({std::string("convert_fps/") + format.name + "/" + getClipName(clip),
+            static_cast<double>(stats.calls) / seconds, "fps", true});
+        metrics.push_back({std::string("convert_mbps/") + format.name + "/" + getClipName(clip),
+            static_cast<double>(stats.bytes) / 1e6 / seconds, "MB/s", true});
+    }
+}
+
+
+/**
+ * Measures the latency of frame-accurate seeks to pseudo-random timestamps.
+ */
+static void measureSeek(const Clip &clip, const std::string &path, const Options &options,
+    std::vector<Metric> &metrics) {
+    VideoDecoder decoder(path);
+    const int64_t duration = decoder.getTotalDuration();
+
+    // A fixed linear congruential generator keeps the seek targets identical between runs.
+    uint32_t state = 12345;
+    std::vector<double> seek_ms;
+    for (int i = 0; i < options.seeks; i++) {
+        state = state * 1664525u + 1013904223u;
+        const int64_t timestamp = static_cast<int64_t>(static_cast<double>(state) / 4294967296.0 * duration * 0.9);
+
+        const Clock::time_point start = Clock::now();
+        decoder.seekToTimestamp(timestamp);
+        seek_ms.push_back(getMillisecondsSince(start));
+    }
+
+    metrics.push_back({"seek_ms/p50/" + getClipName(clip), getMedian(seek_ms), "ms", false});
+    metrics.push_back({"seek_ms/p95/" + getClipName(clip), getPercentile(seek_ms, 95.0), "ms", false});
+}
+
+
+/**
+ * Writes the metrics as JSON.
+ */
+static void writeJson(std::ostream &stream, const std::vector<Metric> &metrics) {
+    stream << "{\n  \"version\": 1,\n  \"metrics\": [";
+    for (size_t i = 0; i < metrics.size(); i++) {
+        const Metric &metric = metrics[i];
+        char value[64];
+        std::snprintf(value, sizeof(value), "%.6g", metric.value);
+        stream << (i ? ",\n" : "\n") << "    {\"name\": \"" << metric.name << "\", \"value\": " << value
+            << ", \"unit\": \"" << metric.unit << "\", \"higher_is_better\": "
+            << (metric.higher_is_better ? "true" : "false") << "}";
+    }
+    stream << "\n  ]\n}\n";
+}
+
+
+/**
+ * Parses the command line. Returns false on invalid arguments.
+ */
+static bool parseOptions(int argc, char **argv, Options &options) {
+    for (int i = 1; i < argc; i++) {
+        const std::string argument = argv[i];
+        const bool has_value = i + 1 < argc;
+        if (argument == "--output" && has_value) {
+            options.output = argv[++i];
+        } else if (argument == "--work-dir" && has_value) {
+            options.work_directory = argv[++i];
+        } else if (argument == "--frames" && has_value) {
+            options.frames = std::max(std::atoi(argv[++i]), 1);
+        } else if (argument == "--quick") {
+            options.frames = 30;
+            options.seeks = 5;
+            options.opens = 3;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+int main(int argc, char **argv) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        std::cerr << "usage: " << argv[0] << " [--output FILE] [--work-dir DIR] [--frames N] [--quick]" << std::endl;
+        return 2;
+    }
+
+    // Codecs are named explicitly, since the containers' defaults depend on the FFmpeg build. Short
+    // GOPs keep seeks cheap; long ones (2 seconds at 30 fps) are what streaming encodes typically use.
+    const Clip clips[] = {
+        {640, 360, ".mp4", "libx264", 12},
+        {1280, 720, ".mp4", "libx264", 12},
+        {1280, 720, ".mp4", "libx264", 60},
+        {1920, 1080, ".mp4", "libx264", 12},
+        {1280, 720, ".mkv", "mpeg4", 12},
+        {1280, 720, ".mkv", "mpeg4", 60},
+        {1280, 720, ".avi", "mpeg4", 12},
+    };
+
+    std::filesystem::create_directories(options.work_directory);
+    std::vector<Metric> metrics;
+    try {
+        for (const Clip &clip : clips) {
+            if (!isEncoderAvailable(clip)) {
+                std::cerr << "skipping " << getClipName(clip) << ": encoder unavailable" << std::endl;
+                continue;
+            }
+            const std::string path = (std::filesystem::path(options.work_directory) / ("clip-" + getClipName(clip))).string();
+            std::cerr << "benchmarking " << getClipName(clip) << std::endl;
+
+            generateClip(clip, path, options, metrics);
+            if (clip.codec_name == "libx264" && clip.gop_size == 12) {
+                measureEncodeThreads(clip, options, metrics);
+            }
+            measureOpen(clip, path, options, metrics);
+            measureDecode(clip, path, metrics);
+            measureConversion(clip, path, metrics);
+            measureTranscode(clip, path, options, metrics);
+            measureSeek(clip, path, options, metrics);
+        }
+
+        std::cerr << "benchmarking 3840x2160 to 1920x1080 encoding" << std::endl;
+        measureDownscaleEncode(options, metrics);
+    } catch (const std::exception &exception) {
+        std::cerr << "benchmark failed: " << exception.what() << std::endl;
+        return 1;
+    }
+
+    if (options.output.empty()) {
+        writeJson(std::cout, metrics);
+    } else {
+        std::ofstream file(options.output, std::ios::trunc);
+        writeJson(file, metrics);
+        if (!file.flush()) {
+            std::cerr << "couldn't write " << options.output << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,57 @@
+#!/usr/bin/env python3
+"""Compares two video-benchmark JSON results and flags regressions.
+
+Usage: compare.py BASELINE.json CURRENT.json [--threshold PERCENT]
+
+Exits with status 1 if any metric got worse by more than the threshold.
+"""
+
+import argparse
+import json
+import sys
+
+
+def load_metrics(path):
+    with open(path) as file:
+        return {metric['name']: metric for metric in json.load(file)['metrics']}
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Compare two video-benchmark results.')
+    parser.add_argument('baseline', help='JSON results of the reference run')
+    parser.add_argument('current', help='JSON results of the run to check')
+    parser.add_argument('--threshold', type=float, default=5.0,
+                        help='relative change in percent that counts as a regression (default: 5)')
+    arguments = parser.parse_args()
+
+    baseline = load_metrics(arguments.baseline)
+    current = load_metrics(arguments.current)
+
+    regressions = 0
+    print(f'{"metric":<64} {"baseline":>12} {"current":>12} {"change":>9}')
+    for name in sorted(baseline.keys() & current.keys()):
+        before = baseline[name]['value']
+        after = current[name]['value']
+        if before == 0:
+            continue
+
+        # Positive changes are improvements, regardless of the metric's direction.
+        change = (after - before) / before * 100.0
+        if not current[name]['higher_is_better']:
+            change = -change
+
+        flag = ''
+        if change < -arguments.threshold:
+            flag = '  REGRESSION'
+            regressions += 1
+        print(f'{name:<64} {before:>12.4g} {after:>12.4g} {change:>+8.1f}%{flag}')
+
+    for name in sorted(baseline.keys() - current.keys()):
+        print(f'{name:<64} missing from {arguments.current}')
+
+    print(f'\n{regressions} regression(s) beyond {arguments.threshold:g}%')
+    return 1 if regressions else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
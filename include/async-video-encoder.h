@@ -0,0 +1,225 @@
+#pragma once
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include "bounded-queue.h"
+#include "frame-input.h"
+#include "frame-pool.h"
+#include "video-encoder.h"
+
+
+/**
+ * What AsyncVideoEncoder::encodeFrame(...) does when the queue of frames waiting for the encoder is
+ * full.
+ */
+enum class QueueFullPolicy {
+    BLOCK,      // Wait until the encoder thread makes room: no frame is lost, but the caller stalls.
+    DROP        // Drop the frame and return at once: the caller never stalls, but the video skips.
+};
+
+
+/**
+ * Options of an AsyncVideoEncoder.
+ */
+struct AsyncEncoderOptions {
+
+    /**
+     * Number of frames that can wait for the encoder thread. Larger queues absorb longer encoder
+     * hiccups at the cost of memory: queued frames are uncompressed.
+     */
+    size_t queue_capacity = 8;
+
+    /**
+     * What to do with a frame when the queue is full.
+     */
+    QueueFullPolicy full_policy = QueueFullPolicy::BLOCK;
+};
+
+
+/**
+ * Progress of an AsyncVideoEncoder.
+ */
+struct AsyncEncoderStats {
+    int64_t queued_frames = 0;          // Frames accepted by encodeFrame(...).
+    int64_t encoded_frames = 0;         // Frames the encoder thread has encoded.
+    int64_t dropped_frames = 0;         // Frames dropped because the queue was full.
+    uint64_t pool_allocations = 0;      // Plane buffers allocated for copies of queued frames.
+    BoundedQueueStats queue;            // Occupancy of the queue; mostly full means the encoder can't keep up.
+};
+
+
+/**
+ * A VideoEncoder running on a background thread, for callers that must not block on encoding (e.g.
+ * real-time capture).
+ *
+ * encodeFrame(...) only copies the frame into a pooled buffer, or takes over the caller's frame, and
+ * queues it. Conversion, encoding, and muxing all happen on the encoder thread. Each queued frame gets
+ * a number (counting from 0), whose completion can be polled with getEncodedFrameCount() or waited
+ * for with waitForFrame(...).
+ *
+ * encodeFrame(...) and finalize() must be called from one thread at a time; progress and stats can be
+ * queried from any thread.
+ */
+class AsyncVideoEncoder {
+    struct FrameDeleter {
+        void operator()(AVFrame *frame) const { av_frame_free(&frame); }
+    };
+
+    using FramePointer = std::unique_ptr<AVFrame, FrameDeleter>;
+
+    VideoEncoder m_encoder;
+    AsyncEncoderOptions m_options;
+    FramePool m_pool;
+    BoundedQueue<FramePointer> m_frames;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_progress;
+    int64_t m_queued_frames;
+    int64_t m_encoded_frames;
+    int64_t m_dropped_frames;
+    bool m_stopped;
+    std::exception_ptr m_error;
+
+    std::thread m_thread;
+
+public:
+
+    /**
+     * Creates the output file and starts the encoder thread.
+     *
+     * @param filepath Path to the output video file.
+     * @param width Width of the output video in pixels.
+     * @param height Height of the output video in pixels.
+     * @param fps Frames per second of the output video.
+     * @param bitrate Bitrate of the output video in bits per second.
+     * @param encoder_options Options controlling how the video stream is encoded.
+     * @param options Queue capacity and what to do when it is full.
+     *
+     * @throws std::runtime_error If the output file or its encoder cannot be set up.
+     * @throws std::system_error If the encoder thread cannot be started.
+     */
+    AsyncVideoEncoder(const std::string &filepath, int width, int height, double fps, int64_t bitrate,
+        const VideoEncoderOptions &encoder_options = {}, const AsyncEncoderOptions &options = {});
+
+    /**
+     * Encodes the frames still queued, stops the encoder thread, and finalizes the file. Errors are
+     * swallowed; call finalize() to see them.
+     */
+    ~AsyncVideoEncoder();
+
+    AsyncVideoEncoder(const AsyncVideoEncoder &) = delete;
+    AsyncVideoEncoder &operator=(const AsyncVideoEncoder &) = delete;
+
+    /**
+     * Copies a frame into a pooled buffer and queues it for encoding.
+     *
+     * @param input Format, dimensions, planes, and strides of the frame. The planes are only read
+     * during the call.
+     * @return Number of the frame, or -1 if it was dropped because the queue was full.
+     *
+     * @throws std::runtime_error If the frame has invalid dimensions or lacks a plane its format needs.
+     * @throws std::runtime_error If the encoder thread failed (with its error) or the encoder is finalized.
+     */
+    int64_t encodeFrame(const FrameInput &input);
+
+    /**
+     * Copies an RGB frame (expected buffer size: width x height x 3 bytes) into a pooled buffer and
+     * queues it for encoding.
+     *
+     * @param rgb_buffer Pointer to the RGB buffer representing the frame to be encoded.
+     * @param width Width of the input frame in pixels.
+     * @param height Height of the input frame in pixels.
+     * @return Number of the frame, or -1 if it was dropped because the queue was full.
+     *
+     * @throws std::runtime_error If the encoder thread failed (with its error) or the encoder is finalized.
+     */
+    int64_t encodeFrame(const uint8_t *rgb_buffer, int width, int height);
+
+    /**
+     * Takes over the references of a frame (e.g. a decoded one) and queues it for encoding, without
+     * copying it. Frames in the output video's dimensions and pixel format go to the codec as they
+     * are, except that their picture type is cleared so the encoder places keyframes by its own GOP
+     * structure. A frame that isn't reference counted is copied.
+     *
+     * @param frame Frame in any pixel format swscale can read. It is left blank once queued; a frame
+     * that is dropped, or that an exception is thrown for, keeps its references.
+     * @return Number of the frame, or -1 if it was dropped because the queue was full.
+     *
+     * @throws std::runtime_error If the frame has an unsupported pixel format or cannot be referenced.
+     * @throws std::runtime_error If the encoder thread failed (with its error) or the encoder is finalized.
+     */
+    int64_t encodeFrame(AVFrame *frame);
+
+    /**
+     * Returns the number of frames encoded so far. Frames are encoded in order, so every frame whose
+     * number is below this one is done.
+     */
+    [[nodiscard]] int64_t getEncodedFrameCount() const;
+
+    /**
+     * Waits until a queued frame has been encoded (and all frames before it).
+     *
+     * @param index Number of the frame, as returned by encodeFrame(...).
+     *
+     * @throws std::runtime_error If no frame with this number was queued.
+     * @throws std::runtime_error If the encoder thread failed (with its error).
+     */
+    void waitForFrame(int64_t index);
+
+    /**
+     * Encodes the frames still queued, stops the encoder thread, and finalizes the output file. Frames
+     * can't be queued afterwards. Can be called repeatedly.
+     *
+     * @throws std::runtime_error If the encoder thread failed (with its error).
+     */
+    void finalize();
+
+    /**
+     * Returns the number of queued, encoded, and dropped frames and the queue occupancy.
+     */
+    [[nodiscard]] AsyncEncoderStats getStats() const;
+
+    /**
+     * Returns the encoder, e.g. to enable its stage stats.
+     */
+    [[nodiscard]] VideoEncoder &getEncoder();
+
+private:
+
+    /**
+     * Queues a frame according to the queue-full policy.
+     *
+     * @param frame Frame to queue. Left untouched if it isn't queued.
+     * @return Number of the frame, or -1 if it was dropped.
+     *
+     * @throws std::runtime_error If the encoder thread failed (with its error) or the encoder is finalized.
+     */
+    int64_t queueFrame(FramePointer &frame);
+
+    /**
+     * Returns whether the queue is full, so that a frame that would be dropped isn't copied or taken
+     * over first.
+     */
+    [[nodiscard]] bool isQueueFull() const;
+
+    /**
+     * Rethrows the encoder thread's error, if it failed.
+     */
+    void checkError() const;
+
+    /**
+     * Converts and encodes queued frames until the queue is closed and empty (encoder thread).
+     */
+    void encodeFrames();
+};
@@ -0,0 +1,177 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <utility>
+
+
+/**
+ * Occupancy of a BoundedQueue over its lifetime. A queue that is mostly full points at a slow
+ * consumer, one that is mostly empty at a slow producer.
+ */
+struct BoundedQueueStats {
+    size_t capacity = 0;                // Maximum number of queued items.
+    uint64_t pushes = 0;                // Items pushed.
+    uint64_t occupancy_sum = 0;         // Sum of the number of queued items seen by each push, including the pushed one.
+    size_t peak_occupancy = 0;          // Largest number of queued items.
+    uint64_t push_wait_ns = 0;          // Time producers spent blocked on a full queue.
+    uint64_t pop_wait_ns = 0;           // Time consumers spent blocked on an empty queue.
+
+    /**
+     * Returns the average number of queued items right after a push.
+     */
+    [[nodiscard]] double getAverageOccupancy() const {
+        return pushes ? static_cast<double>(occupancy_sum) / static_cast<double>(pushes) : 0.0;
+    }
+};
+
+
+/**
+ * A thread-safe FIFO queue of limited capacity, for handing work between pipeline stages.
+ *
+ * Pushing to a full queue blocks until a consumer makes room, so a slow stage throttles the stages
+ * feeding it instead of letting memory grow (backpressure). Closing the queue wakes all waiting
+ * threads: producers can't push anymore, and consumers get the remaining items, then nothing.
+ *
+ * @tparam T Item type. Must be movable.
+ */
+template <typename T>
+class BoundedQueue {
+    using Clock = std::chrono::steady_clock;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_not_full;
+    std::condition_variable m_not_empty;
+    std::deque<T> m_items;
+    bool m_closed;
+    BoundedQueueStats m_stats;
+
+public:
+
+    /**
+     * Creates an empty queue.
+     *
+     * @param capacity Maximum number of queued items (at least 1).
+     */
+    explicit BoundedQueue(size_t capacity) : m_closed(false) {
+        m_stats.capacity = capacity > 0 ? capacity : 1;
+    }
+
+    BoundedQueue(const BoundedQueue &) = delete;
+    BoundedQueue &operator=(const BoundedQueue &) = delete;
+
+    /**
+     * Appends an item, waiting for room if the queue is full.
+     *
+     * @param item Item to append. Left untouched if the queue is closed.
+     * @return `true` if the item was appended, `false` if the queue is closed.
+     */
+    bool push(T &&item) {
+        std::unique_lock lock(m_mutex);
+        if (m_items.size() >= m_stats.capacity && !m_closed) {
+            const Clock::time_point start = Clock::now();
+            m_not_full.wait(lock, [this] { return m_items.size() < m_stats.capacity || m_closed; });
+            m_stats.push_wait_ns += getNanosecondsSince(start);
+        }
+        if (m_closed) {
+            return false;
+        }
+        append(std::move(item));
+        lock.unlock();
+        m_not_empty.notify_one();
+        return true;
+    }
+
+    /**
+     * Appends an item if there is room, without waiting.
+     *
+     * @param item Item to append. Left untouched if it isn't appended.
+     * @return `true` if the item was appended, `false` if the queue is full or closed.
+     */
+    bool tryPush(T &&item) {
+        std::unique_lock lock(m_mutex);
+        if (m_closed || m_items.size() >= m_stats.capacity) {
+            return false;
+        }
+        append(std::move(item));
+        lock.unlock();
+        m_not_empty.notify_one();
+        return true;
+    }
+
+    /**
+     * Removes the oldest item, waiting for one if the queue is empty.
+     *
+     * @param item Receives the removed item.
+     * @return `true` if an item was removed, `false` if the queue is closed and empty.
+     */
+    bool pop(T &item) {
+        std::unique_lock lock(m_mutex);
+        if (m_items.empty() && !m_closed) {
+            const Clock::time_point start = Clock::now();
+            m_not_empty.wait(lock, [this] { return !m_items.empty() || m_closed; });
+            m_stats.pop_wait_ns += getNanosecondsSince(start);
+        }
+        if (m_items.empty()) {
+            return false;
+        }
+        item = std::move(m_items.front());
+        m_items.pop_front();
+        lock.unlock();
+        m_not_full.notify_one();
+        return true;
+    }
+
+    /**
+     * Closes the queue and wakes all waiting threads. Items still queued can be popped.
+     */
+    void close() {
+        {
+            std::lock_guard lock(m_mutex);
+            m_closed = true;
+        }
+        m_not_full.notify_all();
+        m_not_empty.notify_all();
+    }
+
+    /**
+     * Returns the number of queued items.
+     */
+    [[nodiscard]] size_t size() const {
+        std::lock_guard lock(m_mutex);
+        return m_items.size();
+    }
+
+    /**
+     * Returns the occupancy recorded so far.
+     */
+    [[nodiscard]] BoundedQueueStats getStats() const {
+        std::lock_guard lock(m_mutex);
+        return m_stats;
+    }
+
+private:
+
+    /**
+     * Appends an item and updates the occupancy. The mutex must be held.
+     */
+    void append(T &&item) {
+        m_items.push_back(std::move(item));
+        m_stats.pushes++;
+        m_stats.occupancy_sum += m_items.size();
+        if (m_items.size() > m_stats.peak_occupancy) {
+            m_stats.peak_occupancy = m_items.size();
+        }
+    }
+
+    /**
+     * Returns the nanoseconds elapsed since a point in time.
+     */
+    static uint64_t getNanosecondsSince(Clock::time_point start) {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+    }
+};
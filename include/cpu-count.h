@@ -0,0 +1,14 @@
+#pragma once
+
+
+/**
+ * Returns the number of CPUs the process can actually use, which is at least 1.
+ *
+ * Unlike std::thread::hardware_concurrency() (and FFmpeg's automatic thread counts), this honors the
+ * process's CPU affinity mask and, on Linux, a CPU quota set through cgroups (v2 `cpu.max` or v1
+ * `cpu.cfs_quota_us`), as container runtimes do for CPU limits. A quota of 2.5 CPUs counts as 3. The
+ * result is computed once and cached.
+ *
+ * @return Number of usable CPUs.
+ */
+int getAvailableCpuCount();
@@ -0,0 +1,187 @@
+#pragma once
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/buffer.h>
+}
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+
+/**
+ * Interface of application-provided memory for decoded frames.
+ *
+ * When a VideoDecoder is given a FrameAllocator, the planes of every decoded frame are placed in
+ * memory obtained from it, so decoded frames can be handed to other subsystems without copying.
+ * The decoder recycles blocks on its own, so allocate() is only called while the decoder warms up
+ * or when the frame geometry changes.
+ *
+ * Implementations must be thread-safe, since frame-threaded decoders allocate from worker threads.
+ */
+class FrameAllocator {
+public:
+    virtual ~FrameAllocator() = default;
+
+    /**
+     * Allocates a block of memory for one frame plane.
+     *
+     * @param size Size of the block in bytes.
+     * @return Pointer to a block aligned to at least FrameAllocator::ALIGNMENT bytes, or null on failure.
+     */
+    virtual uint8_t *allocate(size_t size) = 0;
+
+    /**
+     * Releases a block returned by allocate(...).
+     *
+     * @param data Pointer returned by allocate(...).
+     */
+    virtual void deallocate(uint8_t *data) = 0;
+
+    /**
+     * Minimum alignment of blocks returned by allocate(...), matching the widest SIMD loads FFmpeg uses.
+     */
+    static constexpr size_t ALIGNMENT = 64;
+};
+
+
+/**
+ * A FrameAllocator that hands out aligned blocks, optionally backed by transparent huge pages and
+ * optionally pinned (locked) in physical memory.
+ */
+class AlignedFrameAllocator : public FrameAllocator {
+    bool m_huge_pages;
+    bool m_pinned;
+    std::atomic<uint64_t> m_allocation_count;
+    std::atomic<uint64_t> m_live_count;
+
+public:
+
+    /**
+     * Constructs an AlignedFrameAllocator.
+     *
+     * @param huge_pages Whether to back blocks with transparent huge pages (Linux only, ignored elsewhere).
+     * @param pinned Whether to lock blocks in physical memory so they can't be paged out (e.g. for DMA).
+     * Pinned blocks are rounded up to whole pages.
+     */
+    explicit AlignedFrameAllocator(bool huge_pages = false, bool pinned = false);
+
+    uint8_t *allocate(size_t size) override;
+
+    void deallocate(uint8_t *data) override;
+
+    /**
+     * Returns the total number of blocks allocated so far.
+     */
+    [[nodiscard]] uint64_t getAllocationCount() const;
+
+    /**
+     * Returns the number of blocks currently allocated and not yet released.
+     */
+    [[nodiscard]] uint64_t getLiveCount() const;
+};
+
+
+/**
+ * One FFmpeg buffer pool per plane of a frame, drawing buffers from an allocation callback. A plane's
+ * pool is rebuilt whenever the size of that plane changes; buffers of the old size stay valid until
+ * they are released. Shared by FrameBufferPool and FramePool.
+ *
+ * Not thread-safe: owners serialize calls themselves.
+ */
+class PlanePools {
+    AVBufferPool *m_pools[4];
+    size_t m_pool_sizes[4];
+    void *m_opaque;
+    AVBufferRef *(*m_allocate)(void *opaque, size_t size);
+
+public:
+
+    /**
+     * Constructs empty pools.
+     *
+     * @param opaque Value passed to `allocate`.
+     * @param allocate Allocates a buffer of a plane's pool, as for av_buffer_pool_init2(...).
+     */
+    PlanePools(void *opaque, AVBufferRef *(*allocate)(void *opaque, size_t size));
+
+    /**
+     * Releases the pools. Buffers still referenced by frames stay valid until they are released.
+     */
+    ~PlanePools();
+
+    PlanePools(const PlanePools &) = delete;
+    PlanePools &operator=(const PlanePools &) = delete;
+
+    /**
+     * Fills in the planes of a frame with pool buffers of the frame's pixel format.
+     *
+     * @param frame Frame without buffers whose `format` is set.
+     * @param linesizes Line size of each plane in bytes, each a multiple of FrameAllocator::ALIGNMENT.
+     * @param height Number of lines of the frame's first plane.
+     * @return 0 on success, or a negative AVERROR code. On failure the frame is left without buffers.
+     */
+    int fillFrame(AVFrame *frame, const int linesizes[4], int height);
+};
+
+
+/**
+ * Per-decoder buffer pools that route a codec context's frame allocations to a FrameAllocator.
+ *
+ * Installed as the codec context's `get_buffer2` callback. Buffers are recycled through one FFmpeg
+ * buffer pool per plane, which are recreated whenever the frame geometry changes.
+ */
+class FrameBufferPool {
+    std::mutex m_mutex;
+    PlanePools m_planes;
+
+public:
+
+    /**
+     * Constructs a FrameBufferPool drawing memory from the specified allocator.
+     *
+     * @param allocator Allocator to draw memory from. It must outlive every frame decoded with this pool.
+     */
+    explicit FrameBufferPool(FrameAllocator *allocator);
+
+    /**
+     * Releases the buffer pools. Buffers still referenced by frames stay valid until they are released.
+     */
+    ~FrameBufferPool();
+
+    FrameBufferPool(const FrameBufferPool &) = delete;
+    FrameBufferPool &operator=(const FrameBufferPool &) = delete;
+
+    /**
+     * Installs the pool as the `get_buffer2` callback of a codec context. Must be called before the
+     * codec context is opened.
+     *
+     * @param codec_context Codec context to install the pool in.
+     */
+    void install(AVCodecContext *codec_context);
+
+private:
+
+    /**
+     * The `get_buffer2` callback. Falls back to FFmpeg's default allocator for hardware frames,
+     * paletted formats, and codecs that don't support custom buffers.
+     */
+    static int getBuffer(AVCodecContext *codec_context, AVFrame *frame, int flags);
+
+    /**
+     * Allocates a pool buffer through the FrameAllocator passed as `opaque`.
+     */
+    static AVBufferRef *allocateBuffer(void *opaque, size_t size);
+
+    /**
+     * Returns a pool buffer's memory to the FrameAllocator passed as `opaque`.
+     */
+    static void freeBuffer(void *opaque, uint8_t *data);
+
+    /**
+     * Fills in the planes of a frame with buffers from the pools.
+     */
+    int fillFrame(AVCodecContext *codec_context, AVFrame *frame);
+};
@@ -0,0 +1,198 @@
+#pragma once
+
+extern "C" {
+#include <libavutil/pixfmt.h>
+}
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+#include "frame-allocator.h"
+
+class VideoDecoder;
+
+
+/**
+ * An arena of equally sized, recyclable output buffers for converted frames.
+ *
+ * Buffers are carved out of large slabs that are 64-byte aligned and optionally backed by transparent
+ * huge pages. Released buffers go back to a lock-free free list and are handed out again before any
+ * new slab is allocated, so once the arena has grown to the number of buffers in flight, acquiring and
+ * releasing buffers allocates nothing. The statistics returned by getStats() make that checkable.
+ *
+ * Acquiring and releasing buffers is thread-safe. The arena must outlive every buffer it hands out.
+ */
+class FrameArena {
+public:
+
+    /**
+     * A buffer handed out by the arena. It goes back to the arena when the handle is destroyed.
+     */
+    class Buffer {
+        FrameArena *m_arena;
+        uint8_t *m_data;
+        uint32_t m_slot;
+
+    public:
+        Buffer();
+        Buffer(FrameArena *arena, uint8_t *data, uint32_t slot);
+        Buffer(Buffer &&other) noexcept;
+        Buffer &operator=(Buffer &&other) noexcept;
+        ~Buffer();
+
+        Buffer(const Buffer &) = delete;
+        Buffer &operator=(const Buffer &) = delete;
+
+        /**
+         * Returns a pointer to the buffer memory (aligned to FrameAllocator::ALIGNMENT bytes), or null for
+         * an empty handle.
+         */
+        [[nodiscard]] uint8_t *getData() const { return m_data; }
+
+        /**
+         * Returns the usable size of the buffer in bytes.
+         */
+        [[nodiscard]] size_t getSize() const;
+
+        /**
+         * Returns the buffer to its arena early. The handle is empty afterwards.
+         */
+        void release();
+    };
+
+    /**
+     * Counters describing the arena's allocation behaviour.
+     */
+    struct Stats {
+        uint64_t slab_allocations;      // Slabs allocated from the system so far.
+        uint64_t acquisitions;          // Buffers handed out so far.
+        uint64_t releases;              // Buffers returned so far.
+        size_t capacity;                // Buffers carved out of all slabs.
+        size_t in_use;                  // Buffers currently handed out.
+    };
+
+    /**
+     * Maximum number of slabs an arena can grow to.
+     */
+    static constexpr size_t MAX_SLABS = 64;
+
+private:
+
+    /**
+     * A contiguous block of buffers along with the free-list links of its buffers.
+     */
+    struct Slab {
+        uint8_t *data;
+        std::atomic<uint32_t> *next;
+    };
+
+    size_t m_buffer_size;
+    size_t m_buffer_stride;
+    size_t m_buffers_per_slab;
+    AlignedFrameAllocator m_allocator;
+
+    Slab m_slabs[MAX_SLABS];
+    std::atomic<size_t> m_slab_count;
+    std::mutex m_grow_mutex;
+
+    // Head of the free list: the upper 32 bits are an ABA tag, the lower 32 bits the free slot + 1 (0 if empty).
+    std::atomic<uint64_t> m_free_head;
+
+    std::atomic<uint64_t> m_acquisitions;
+    std::atomic<uint64_t> m_releases;
+
+public:
+
+    /**
+     * Constructs an empty FrameArena. Slabs are only allocated once buffers are acquired.
+     *
+     * @param buffer_size Size of each buffer in bytes.
+     * @param buffers_per_slab Number of buffers carved out of each slab.
+     * @param huge_pages Whether to back slabs with transparent huge pages (Linux only, ignored elsewhere).
+     */
+    explicit FrameArena(size_t buffer_size, size_t buffers_per_slab = 8, bool huge_pages = false);
+
+    /**
+     * Constructs an empty FrameArena with buffers large enough to hold one frame of a decoder's video
+     * stream in the specified pixel format.
+     *
+     * @param decoder Decoder whose frames the buffers are meant for.
+     * @param format Pixel format the frames are converted to.
+     * @param buffers_per_slab Number of buffers carved out of each slab.
+     * @param huge_pages Whether to back slabs with transparent huge pages (Linux only, ignored elsewhere).
+     */
+    explicit FrameArena(const VideoDecoder &decoder, AVPixelFormat format = AV_PIX_FMT_RGB24,
+        size_t buffers_per_slab = 8, bool huge_pages = false);
+
+    /**
+     * Releases all slabs. Every buffer must have been returned by then.
+     */
+    ~FrameArena();
+
+    FrameArena(const FrameArena &) = delete;
+    FrameArena &operator=(const FrameArena &) = delete;
+
+    /**
+     * Hands out a buffer, allocating a new slab only if no released buffer is available.
+     *
+     * @return The acquired buffer.
+     *
+     * @throws std::runtime_error If a new slab is needed but cannot be allocated.
+     */
+    [[nodiscard]] Buffer acquire();
+
+    /**
+     * Returns the size of the arena's buffers in bytes.
+     */
+    [[nodiscard]] size_t getBufferSize() const;
+
+    /**
+     * Returns a snapshot of the arena's allocation counters.
+     */
+    [[nodiscard]] Stats getStats() const;
+
+    /**
+     * Returns the number of bytes needed to hold one frame of a decoder's video stream in a pixel format.
+     *
+     * @param decoder Decoder whose frames the buffer is meant for.
+     * @param format Pixel format the frames are converted to.
+     * @return Buffer size in bytes.
+     *
+     * @throws std::runtime_error If the size cannot be computed for the pixel format.
+     */
+    static size_t getBufferSize(const VideoDecoder &decoder, AVPixelFormat format);
+
+private:
+
+    /**
+     * Returns the free-list link of a slot.
+     */
+    std::atomic<uint32_t> &getNext(uint32_t slot);
+
+    /**
+     * Returns the memory of a slot.
+     */
+    uint8_t *getSlotData(uint32_t slot) const;
+
+    /**
+     * Pops a slot off the free list.
+     *
+     * @param slot Receives the popped slot.
+     * @return `true` on success, `false` if the free list is empty.
+     */
+    bool pop(uint32_t &slot);
+
+    /**
+     * Pushes a slot onto the free list.
+     */
+    void push(uint32_t slot);
+
+    /**
+     * Allocates a new slab and pushes all of its slots onto the free list.
+     *
+     * @throws std::runtime_error If the arena is full or the slab cannot be allocated.
+     */
+    void grow();
+};
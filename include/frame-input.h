@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+
+
+/**
+ * Pixel formats frames can be handed to a VideoEncoder in.
+ */
+enum class FrameInputFormat {
+
+    /**
+     * Planar 8-bit YUV 4:2:0: a full-size Y plane followed by quarter-size U and V planes.
+     */
+    I420,
+
+    /**
+     * Semi-planar 8-bit YUV 4:2:0: a full-size Y plane followed by a quarter-size plane of
+     * interleaved U and V samples, as produced by most hardware capture and decode paths.
+     */
+    NV12,
+
+    /**
+     * Packed 8-bit BGRA, 4 bytes per pixel (e.g. Windows and macOS screen capture). Alpha is ignored.
+     */
+    BGRA,
+
+    /**
+     * Packed 8-bit RGBA, 4 bytes per pixel. Alpha is ignored.
+     */
+    RGBA,
+
+    /**
+     * Packed 8-bit RGB, 3 bytes per pixel.
+     */
+    RGB24
+};
+
+
+/**
+ * Describes a caller-owned frame to encode: its format, dimensions, and planes.
+ *
+ * Planes are described separately, each with its own stride, so frames with padded rows or with
+ * planes in separate allocations (as capture APIs tend to hand them out) can be encoded in place.
+ */
+struct FrameInput {
+
+    /**
+     * Start of each plane: Y, U, and V for I420; Y and interleaved UV for NV12; just the first for
+     * packed formats. Unused entries are ignored.
+     */
+    const uint8_t *data[3] = {nullptr, nullptr, nullptr};
+
+    /**
+     * Distance between the starts of two rows of each plane in bytes. 0 means tightly packed rows.
+     */
+    int stride[3] = {0, 0, 0};
+
+    /**
+     * Width of the frame in pixels.
+     */
+    int width = 0;
+
+    /**
+     * Height of the frame in pixels.
+     */
+    int height = 0;
+
+    /**
+     * Pixel format of the planes.
+     */
+    FrameInputFormat format = FrameInputFormat::I420;
+};
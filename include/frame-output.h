@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstdint>
+
+
+/**
+ * A rectangle within a video frame, in pixels.
+ */
+struct FrameRect {
+    int x = 0;
+    int y = 0;
+    int width = 0;
+    int height = 0;
+};
+
+
+/**
+ * Pixel formats decoded frames can be written out in.
+ */
+enum class FrameOutputFormat {
+
+    /**
+     * Packed 8-bit RGB, 3 bytes per pixel.
+     */
+    RGB24,
+
+    /**
+     * 8-bit luminance only, 1 byte per pixel. For 8-bit YUV sources, the luma plane is copied (or
+     * downscaled) directly, without touching chroma at all, and samples keep the source's range.
+     */
+    GRAY8,
+
+    /**
+     * Packed 16-bit RGB, 6 bytes per pixel in native byte order, using the full 0-65535 range.
+     * 10- and 12-bit (e.g. HDR) YUV sources are converted without truncating them to 8 bits.
+     */
+    RGB48,
+
+    /**
+     * Packed 16-bit RGBA, 8 bytes per pixel in native byte order. Alpha is always opaque (65535).
+     */
+    RGBA64,
+
+    /**
+     * Packed 32-bit float RGB, 12 bytes per pixel. Values are the source's non-linear R'G'B' (in its
+     * transfer characteristic, e.g. PQ or HLG, see VideoDecoder::getColorInfo()) normalized to 0-1,
+     * without clamping, so out-of-gamut values survive the conversion.
+     */
+    RGBF32
+};
+
+
+/**
+ * Describes where and how a decoded frame is written into a caller-provided buffer.
+ *
+ * Besides tightly packed frame-sized buffers, this allows writing into padded rows or straight into a
+ * sub-rectangle of a larger canvas (e.g. a video wall or a texture atlas), optionally converting only
+ * a region of the source frame. Only the needed region is converted, without any intermediate buffer.
+ */
+struct FrameOutput {
+
+    /**
+     * Start of the destination buffer, i.e. the top-left pixel of the canvas. For RGB48 and RGBA64 it
+     * must be 2-byte aligned, for RGBF32 4-byte aligned.
+     */
+    uint8_t *data = nullptr;
+
+    /**
+     * Distance between the starts of two destination rows in bytes. 0 means tightly packed rows of
+     * the converted region's width. Like `data`, it must be a multiple of the sample size (2 bytes
+     * for RGB48 and RGBA64, 4 bytes for RGBF32).
+     */
+    int stride = 0;
+
+    /**
+     * Destination column (in pixels) the converted region's left edge is written to.
+     */
+    int x = 0;
+
+    /**
+     * Destination row the converted region's top edge is written to.
+     */
+    int y = 0;
+
+    /**
+     * Region of the source frame to convert. A zero width or height converts the whole frame. The
+     * origin is rounded down to the source's chroma subsampling grid (e.g. to even coordinates for
+     * 4:2:0 video), since chroma samples can't be split.
+     */
+    FrameRect crop;
+
+    /**
+     * Pixel format to write the frame in.
+     */
+    FrameOutputFormat format = FrameOutputFormat::RGB24;
+
+    /**
+     * Integer factor to shrink the converted region by in both dimensions, averaging each block of
+     * downscale x downscale pixels. Partial blocks at the right and bottom edges are dropped.
+     * Luma output has fast paths for factors 2, 4, and 8.
+     */
+    int downscale = 1;
+};
@@ -0,0 +1,94 @@
+#pragma once
+
+extern "C" {
+#include <libavutil/buffer.h>
+#include <libavutil/frame.h>
+#include <libavutil/pixfmt.h>
+}
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+
+#include "frame-allocator.h"
+
+
+/**
+ * A pool of reference-counted, writable frames of one geometry, for frames the application fills in
+ * itself (e.g. encoder input).
+ *
+ * Each plane comes from an FFmpeg buffer pool (see PlanePools), with line sizes aligned to
+ * FrameAllocator::ALIGNMENT. A buffer goes back to its pool when the last reference
+ * to it is released, which may be long after the frame was handed on (an encoder keeps references to
+ * the frames it is still working on). Once the pool has grown to the number of frames in flight,
+ * getting a frame allocates nothing. The pools are rebuilt whenever the requested geometry changes
+ * the size of a plane; frames of the old geometry stay valid.
+ *
+ * Getting frames is thread-safe. Frames may outlive the pool.
+ */
+class FramePool {
+    std::mutex m_mutex;
+    PlanePools m_planes;
+    int m_linesizes[4];
+    AVPixelFormat m_format;
+    int m_width;
+    int m_height;
+    std::atomic<uint64_t> m_allocation_count;
+
+public:
+
+    /**
+     * Constructs an empty pool.
+     */
+    FramePool();
+
+    /**
+     * Releases the buffer pools. Buffers still referenced by frames stay valid until they are released.
+     */
+    ~FramePool();
+
+    FramePool(const FramePool &) = delete;
+    FramePool &operator=(const FramePool &) = delete;
+
+    /**
+     * Fills a blank frame with writable buffers of the given geometry.
+     *
+     * @param frame Frame without buffers (e.g. freshly allocated or unreferenced).
+     * @param format Pixel format of the frame.
+     * @param width Width of the frame in pixels.
+     * @param height Height of the frame in pixels.
+     *
+     * @throws std::runtime_error If the geometry is invalid or the buffers cannot be allocated.
+     */
+    void getFrame(AVFrame *frame, AVPixelFormat format, int width, int height);
+
+    /**
+     * Grows the pool so that the given number of frames of a geometry can be in flight at once
+     * without allocating.
+     *
+     * @param count Number of frames.
+     * @param format Pixel format of the frames.
+     * @param width Width of the frames in pixels.
+     * @param height Height of the frames in pixels.
+     *
+     * @throws std::runtime_error If the geometry is invalid or the buffers cannot be allocated.
+     */
+    void reserve(int count, AVPixelFormat format, int width, int height);
+
+    /**
+     * Returns the number of plane buffers allocated so far.
+     */
+    [[nodiscard]] uint64_t getAllocationCount() const;
+
+private:
+
+    /**
+     * Allocates a pool buffer and counts it for the FramePool passed as `opaque`.
+     */
+    static AVBufferRef *allocateBuffer(void *opaque, size_t size);
+
+    /**
+     * Computes the line sizes of a new geometry. The mutex must be held.
+     */
+    void resize(AVPixelFormat format, int width, int height);
+};
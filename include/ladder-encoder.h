@@ -0,0 +1,129 @@
+#pragma once
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libswscale/swscale.h>
+}
+
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "bounded-queue.h"
+#include "video-decoder.h"
+#include "video-encoder.h"
+
+
+/**
+ * One output of a LadderEncoder.
+ */
+struct Rendition {
+    std::string output_path;            // File to write; its extension picks the container and codec.
+    int width = 0;                      // Width in pixels.
+    int height = 0;                     // Height in pixels.
+    int64_t bitrate = 0;                // Bit rate in bits per second.
+};
+
+
+/**
+ * Options shared by all renditions of a LadderEncoder.
+ */
+struct LadderOptions {
+
+    /**
+     * Distance between keyframes in seconds. Every rendition gets a keyframe at exactly the same
+     * frames, so that all of them can be cut into segments at the same points.
+     */
+    double keyframe_interval = 2.0;
+
+    /**
+     * Number of decoded frames each rendition can fall behind the decoder before decoding waits.
+     */
+    size_t queue_capacity = 4;
+};
+
+
+/**
+ * Results of a ladder encode.
+ */
+struct LadderStats {
+    int64_t frames = 0;                 // Frames decoded (and encoded by every rendition).
+    int keyframe_interval = 0;          // Distance between keyframes in frames.
+
+    /**
+     * Occupancy of each rendition's frame queue, in the order of the renditions. The rendition
+     * whose queue is mostly full is the one holding the others back.
+     */
+    std::vector<BoundedQueueStats> queues;
+};
+
+
+/**
+ * A class for encoding several renditions of a video (e.g. the 1080p, 720p, 480p, and 360p rungs of
+ * an adaptive bit rate ladder) from a single decode.
+ *
+ * The input is decoded once, and each decoded frame is handed to every rendition by reference,
+ * without copying. Each rendition scales and encodes on its own thread, and the renditions' codecs
+ * split the CPUs available to the process between them. The renditions get their keyframes at the
+ * same frames, with scene change keyframes turned off, so that segment boundaries line up across all
+ * of them.
+ */
+class LadderEncoder {
+    struct Output;
+
+    VideoDecoder m_decoder;
+    std::vector<std::unique_ptr<Output>> m_outputs;
+    LadderOptions m_options;
+    int m_keyframe_interval;
+
+public:
+
+    /**
+     * Opens the input file and creates one encoder per rendition.
+     *
+     * @param input_path Path to the video file to encode.
+     * @param renditions Outputs to create. Their dimensions must be even.
+     * @param options Keyframe interval and queue capacity.
+     * @param decoder_options Options controlling how the input file is opened.
+     *
+     * @throws std::runtime_error If there are no renditions or a rendition has invalid dimensions.
+     * @throws std::runtime_error If the input file cannot be decoded.
+     * @throws std::runtime_error If an output file or its encoder cannot be set up.
+     */
+    LadderEncoder(const std::string &input_path, const std::vector<Rendition> &renditions,
+        const LadderOptions &options = {}, const VideoDecoderOptions &decoder_options = {});
+
+    /**
+     * Frees all resources. Output files are finalized by their encoders if run() didn't do it.
+     */
+    ~LadderEncoder();
+
+    LadderEncoder(const LadderEncoder &) = delete;
+    LadderEncoder &operator=(const LadderEncoder &) = delete;
+
+    /**
+     * Decodes the input on the calling thread, encodes every rendition on its own thread, and
+     * finalizes all output files. Can be called once.
+     *
+     * @return Number of frames, keyframe interval, and queue occupancy.
+     *
+     * @throws std::runtime_error If a frame cannot be decoded, scaled, or encoded.
+     * @throws std::system_error If a thread cannot be started.
+     */
+    LadderStats run();
+
+private:
+
+    /**
+     * Scales and encodes the queued frames of one rendition, then finalizes its file (rendition
+     * thread).
+     */
+    void encodeRendition(Output &output);
+
+    /**
+     * Closes all queues, so that all threads wind down after an error.
+     */
+    void closeQueues();
+};
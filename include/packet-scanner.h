@@ -0,0 +1,89 @@
+#pragma once
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+}
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+#include "probe-cache.h"
+
+
+/**
+ * Metadata of one packet of a video stream.
+ */
+struct PacketInfo {
+    int64_t pts;                        // Presentation timestamp in microseconds, or AV_NOPTS_VALUE.
+    int64_t dts;                        // Decoding timestamp in microseconds, or AV_NOPTS_VALUE.
+    int64_t duration;                   // Duration in microseconds, or 0 if unknown.
+    int size;                           // Size of the packet in bytes.
+    int64_t position;                   // Byte position of the packet in the file, or -1 if unknown.
+    bool keyframe;                      // Whether decoding can start at this packet.
+};
+
+
+/**
+ * A class for iterating over the packets of a video file's video stream without decoding them.
+ *
+ * The PacketScanner only runs the demuxer: it never opens a codec, discards all other streams, and
+ * hands out packet metadata (timestamps, size, keyframe flag, and byte position) instead of packet
+ * data. This makes bitrate graphs, GOP structure reports, and exact frame counts about as fast as
+ * reading the file.
+ */
+class PacketScanner {
+    AVFormatContext *m_format_context;
+    AVPacket *m_packet;
+    int m_video_stream_index;
+
+public:
+
+    /**
+     * Opens a video file for scanning.
+     *
+     * Streams are identified from the container header. Only files whose header doesn't declare a
+     * video stream (e.g. raw elementary streams) are probed with `avformat_find_stream_info`, which
+     * decodes a few frames; a probe cache entry avoids even that.
+     *
+     * @param path Path to the video file.
+     * @param probe_cache Cache of stream probing results (can be null). It is only read, never written.
+     *
+     * @throws std::runtime_error If the file cannot be opened.
+     * @throws std::runtime_error If the file has no video stream.
+     * @throws std::runtime_error If the packet cannot be allocated.
+     */
+    explicit PacketScanner(const std::string &path, const ProbeCache *probe_cache = nullptr);
+
+    /**
+     * Closes the video file.
+     */
+    ~PacketScanner();
+
+    PacketScanner(const PacketScanner &) = delete;
+    PacketScanner &operator=(const PacketScanner &) = delete;
+
+    /**
+     * Reads the next packet of the video stream.
+     *
+     * @param info Receives the metadata of the packet.
+     * @return `true` if a packet has been read, `false` on end of file or error.
+     */
+    bool getNextPacket(PacketInfo &info);
+
+    /**
+     * Returns the time base of the video stream, i.e. the unit of its timestamps in the container.
+     * Packet timestamps are converted from it to microseconds.
+     *
+     * @return The time base of the video stream.
+     */
+    [[nodiscard]] AVRational getTimeBase() const;
+
+    /**
+     * Returns the video stream's index in the file.
+     *
+     * @return The index of the video stream.
+     */
+    [[nodiscard]] int getStreamIndex() const;
+};
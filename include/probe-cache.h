@@ -0,0 +1,69 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include "video-stream-info.h"
+
+
+/**
+ * An on-disk cache of video stream probing results.
+ *
+ * Probing a file with `avformat_find_stream_info` reads and decodes the beginning of the file and
+ * dominates the time it takes to open it. The ProbeCache persists the probed stream information
+ * (codec parameters, extradata, time base, duration, frame rates and seek index) so that files which
+ * are opened over and over can skip probing altogether. Entries are keyed by the file's path, size,
+ * and last modification time, so a file that changes on disk is probed again automatically.
+ *
+ * A ProbeCache holds no state besides its directory and can be shared between threads.
+ */
+class ProbeCache {
+    std::string m_directory;
+
+public:
+
+    /**
+     * Constructs a ProbeCache that stores its entries in the specified directory. The directory is
+     * created if it doesn't exist yet.
+     *
+     * @param directory Directory to store cache entries in.
+     *
+     * @throws std::runtime_error If the directory cannot be created.
+     */
+    explicit ProbeCache(const std::string &directory);
+
+    /**
+     * Looks up the stream information of a video file.
+     *
+     * @param path Path to the video file.
+     * @return The cached stream information, or null if the file isn't cached, has changed since it
+     * was cached, or its cache entry is unreadable.
+     */
+    [[nodiscard]] std::shared_ptr<const VideoStreamInfo> load(const std::string &path) const;
+
+    /**
+     * Stores the stream information of a video file, replacing any previous entry for it.
+     *
+     * @param path Path to the video file.
+     * @param info Stream information probed from the file.
+     * @return `true` if the entry has been written, `false` if the file can't be cached (e.g. it is
+     * not a regular local file) or the entry couldn't be written.
+     */
+    bool store(const std::string &path, const VideoStreamInfo &info) const;
+
+private:
+
+    /**
+     * Builds the cache key of a video file out of its absolute path, size, and modification time.
+     *
+     * @param path Path to the video file.
+     * @param key Receives the cache key.
+     * @return `true` on success, `false` if the file is not a regular local file.
+     */
+    static bool makeKey(const std::string &path, std::string &key);
+
+    /**
+     * Returns the path of the cache entry for a cache key.
+     */
+    [[nodiscard]] std::string getEntryPath(const std::string &key) const;
+};
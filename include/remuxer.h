@@ -0,0 +1,113 @@
+#pragma once
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+}
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+
+/**
+ * Options controlling which part of a file a Remuxer copies and how its timestamps are written.
+ */
+struct RemuxOptions {
+
+    /**
+     * Start of the part to copy in microseconds, in the same timeline as VideoDecoder timestamps.
+     * Stream copies can only start at a keyframe, so the copy starts at the last video keyframe at or
+     * before this time (see RemuxStats::start_time).
+     */
+    int64_t start_time = 0;
+
+    /**
+     * End of the part to copy in microseconds, or a negative value to copy up to the end of the file.
+     * Packets decoded at or after this time are dropped; with B-frames, the last few frames shown can
+     * therefore lie slightly beyond it.
+     */
+    int64_t end_time = -1;
+
+    /**
+     * Whether to shift the timestamps of all streams so that the output starts at 0.
+     */
+    bool rebase_timestamps = true;
+};
+
+
+/**
+ * Results of a remux.
+ */
+struct RemuxStats {
+    int64_t packets = 0;                // Packets written.
+    int64_t bytes = 0;                  // Packet bytes written.
+    int64_t start_time = 0;             // Actual (keyframe-aligned) start of the copied part in microseconds.
+};
+
+
+/**
+ * A class for copying the streams of a media file into another container without decoding them.
+ *
+ * Changing containers (e.g. MKV to MP4) and trimming at keyframes only moves compressed packets
+ * around, so it is limited by I/O instead of codec speed and loses no quality. Streams the output
+ * container can't hold are left out.
+ */
+class Remuxer {
+    AVFormatContext *m_input_context;
+    AVFormatContext *m_output_context;
+    std::vector<int> m_stream_mapping;
+    int m_video_stream_index;
+    RemuxOptions m_options;
+
+public:
+
+    /**
+     * Opens the input file and creates the output file, with one output stream per input stream the
+     * output container supports. The output format is guessed from the output path.
+     *
+     * @param input_path Path to the media file to copy.
+     * @param output_path Path to the file to write.
+     * @param options Part of the input to copy and timestamp handling.
+     *
+     * @throws std::runtime_error If the input file cannot be opened or probed.
+     * @throws std::runtime_error If the output format context cannot be allocated or the output file
+     * cannot be opened.
+     * @throws std::runtime_error If no input stream can be stored in the output container.
+     * @throws std::runtime_error If the output header cannot be written.
+     */
+    Remuxer(const std::string &input_path, const std::string &output_path, const RemuxOptions &options = {});
+
+    /**
+     * Closes both files. An output that hasn't been completed by run() is left incomplete.
+     */
+    ~Remuxer();
+
+    Remuxer(const Remuxer &) = delete;
+    Remuxer &operator=(const Remuxer &) = delete;
+
+    /**
+     * Copies the selected part of the input into the output and completes the output file.
+     *
+     * @return Number of packets and bytes written, and the actual start of the copied part.
+     *
+     * @throws std::runtime_error If the input cannot be sought to the start time.
+     * @throws std::runtime_error If a packet or the trailer cannot be written.
+     */
+    RemuxStats run();
+
+private:
+
+    /**
+     * Creates the output streams and fills the stream mapping.
+     *
+     * @throws std::runtime_error If no input stream can be stored in the output container.
+     */
+    void createOutputStreams();
+
+    /**
+     * Closes both files and frees their contexts.
+     */
+    void close();
+};
@@ -0,0 +1,183 @@
+#pragma once
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+}
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+
+/**
+ * The part of a video a SmartCutter cuts out.
+ */
+struct SmartCutOptions {
+
+    /**
+     * First frame to keep in microseconds, in the same timeline as VideoDecoder timestamps.
+     */
+    int64_t start_time = 0;
+
+    /**
+     * Time of the first frame to drop in microseconds, or a negative value to keep everything up to
+     * the end of the file.
+     */
+    int64_t end_time = -1;
+};
+
+
+/**
+ * Results of a smart cut.
+ */
+struct SmartCutStats {
+    int64_t copied_packets = 0;         // Packets stream-copied from the input.
+    int64_t encoded_frames = 0;         // Frames decoded and re-encoded at the edges.
+};
+
+
+/**
+ * A class for cutting a video stream at exact frames while re-encoding as little as possible.
+ *
+ * Only the partial GOPs at the in and out points are decoded and re-encoded (with the input's codec,
+ * dimensions, pixel format, and bit rate); every complete GOP between them is stream-copied. The cut
+ * is frame-accurate, yet costs about as much as a remux plus encoding at most two GOPs. The output
+ * holds the video stream only, with timestamps starting at 0.
+ *
+ * Limitations:
+ * - The input must use closed GOPs: leading frames of an open GOP that reference the previous GOP
+ *   can't be copied without it.
+ * - Re-encoded frames carry the encoder's own parameter sets in-band, while the output's codec
+ *   parameters (extradata) are the input's. For H.264 and HEVC with length-prefixed (avcC/hvcC)
+ *   extradata, re-encoded packets are converted to length-prefixed NAL units, and the input's
+ *   parameter sets are repeated in-band at the first copied keyframe so decoding switches back to
+ *   them. Players that ignore in-band parameter sets (e.g. some hardware decoders) may still fail
+ *   on the re-encoded parts. Other codecs must carry their headers in keyframes (e.g. VP9, AV1).
+ * - An encoder for the input codec and pixel format has to be available.
+ */
+class SmartCutter {
+
+    /**
+     * A keyframe of the input, with timestamps in the video stream's time base.
+     */
+    struct Keyframe {
+        int64_t pts;
+        int64_t dts;
+    };
+
+    AVFormatContext *m_input_context;
+    AVFormatContext *m_output_context;
+    AVCodecContext *m_decoder_context;
+    AVPacket *m_packet;
+    AVFrame *m_frame;
+    int m_video_stream_index;
+    SmartCutOptions m_options;
+
+    std::vector<uint8_t> m_parameter_sets;
+    int m_nal_length_size;
+    int64_t m_start_timestamp;
+    int64_t m_last_dts;
+    SmartCutStats m_stats;
+
+public:
+
+    /**
+     * Opens the input file, prepares decoding of its video stream, and creates the output file. The
+     * output format is guessed from the output path.
+     *
+     * @param input_path Path to the video file to cut.
+     * @param output_path Path to the file to write.
+     * @param options Part of the video to keep.
+     *
+     * @throws std::runtime_error If the input file cannot be opened or has no video stream.
+     * @throws std::runtime_error If the video decoder cannot be opened.
+     * @throws std::runtime_error If the output file cannot be created.
+     */
+    SmartCutter(const std::string &input_path, const std::string &output_path, const SmartCutOptions &options);
+
+    /**
+     * Closes both files. An output that hasn't been completed by run() is left incomplete.
+     */
+    ~SmartCutter();
+
+    SmartCutter(const SmartCutter &) = delete;
+    SmartCutter &operator=(const SmartCutter &) = delete;
+
+    /**
+     * Writes the cut video and completes the output file.
+     *
+     * @return Number of copied packets and re-encoded frames.
+     *
+     * @throws std::runtime_error If the input cannot be sought to a cut point.
+     * @throws std::runtime_error If the edges cannot be re-encoded.
+     * @throws std::runtime_error If a packet, the header, or the trailer cannot be written.
+     */
+    SmartCutStats run();
+
+private:
+
+    /**
+     * Lists the keyframes from the last one at or before `start` up to the first one at or after
+     * `end` (or the end of the file).
+     *
+     * @param last_timestamp Receives the largest presentation timestamp read.
+     *
+     * @throws std::runtime_error If there is no keyframe.
+     */
+    std::vector<Keyframe> scanKeyframes(int64_t start, int64_t end, int64_t &last_timestamp);
+
+    /**
+     * Decodes the frames with timestamps in [start, end) and re-encodes them as a new GOP.
+     *
+     * @param start Timestamp of the first frame to re-encode.
+     * @param end Timestamp of the first frame not to re-encode.
+     * @param dts_delay Distance between presentation and decoding timestamps to give the encoded
+     * packets, so that their decoding timestamps line up with the surrounding copied packets.
+     */
+    void encodeRange(int64_t start, int64_t end, int64_t dts_delay);
+
+    /**
+     * Copies the packets from keyframe `first` up to (but not including) keyframe `last`, or up to
+     * the end of the file if `last` is null.
+     *
+     * @param repeat_parameter_sets Whether to insert the input's parameter sets before the first packet.
+     */
+    void copyRange(const Keyframe &first, const Keyframe *last, bool repeat_parameter_sets);
+
+    /**
+     * Seeks the input to the last keyframe at or before a timestamp of the video stream. Reading from
+     * wherever the input was instead would silently cut at the wrong point.
+     *
+     * @throws std::runtime_error If the input cannot be sought.
+     */
+    void seek(int64_t timestamp);
+
+    /**
+     * Allocates and opens an encoder matching the input video stream.
+     */
+    AVCodecContext *openEncoder() const;
+
+    /**
+     * Writes all packets the encoder has ready, or all remaining ones after it has been flushed.
+     */
+    void writeEncodedPackets(AVCodecContext *encoder_context, int64_t dts_delay);
+
+    /**
+     * Rebases a packet's timestamps (given in the input stream's time base), converts them to the
+     * output stream's time base, and writes the packet.
+     */
+    void writePacket(AVPacket *packet);
+
+    /**
+     * Converts a packet of Annex B NAL units (as written by encoders) to length-prefixed NAL units, if
+     * the output stream uses those.
+     */
+    void convertToLengthPrefixed(AVPacket *packet) const;
+
+    /**
+     * Closes both files and frees all contexts.
+     */
+    void close();
+};
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#include "tracer.h"
+
+
+/**
+ * Cumulative statistics of one processing stage (e.g. demuxing, decoding, or conversion).
+ */
+struct StageStats {
+
+    /**
+     * Number of latency histogram buckets. Bucket i counts calls that took [2^i, 2^(i+1)) nanoseconds;
+     * bucket 0 also counts calls that took 0 ns and the last bucket every call longer than that.
+     */
+    static constexpr int HISTOGRAM_BUCKETS = 32;
+
+    uint64_t calls = 0;                 // Timed calls so far.
+    uint64_t total_ns = 0;              // Time spent in all calls in nanoseconds.
+    uint64_t max_ns = 0;                // Longest call in nanoseconds.
+    uint64_t bytes = 0;                 // Bytes read or written by all calls.
+    std::array<uint64_t, HISTOGRAM_BUCKETS> histogram{};
+
+    /**
+     * Returns the mean call latency in microseconds, or 0 if there were no calls.
+     */
+    [[nodiscard]] double getAverageMicroseconds() const;
+
+    /**
+     * Returns an upper bound of the given latency percentile (0-100) in nanoseconds, with the
+     * power-of-two resolution of the histogram, or 0 if there were no calls.
+     */
+    [[nodiscard]] uint64_t getPercentileNanoseconds(double percentile) const;
+};
+
+
+/**
+ * Statistics of the stages of a VideoDecoder.
+ */
+struct DecoderStats {
+    StageStats demux;                   // av_read_frame(...) calls; bytes are packet sizes.
+    StageStats decode;                  // avcodec_send_packet(...) and avcodec_receive_frame(...) calls.
+    StageStats convert;                 // Frame conversions; bytes are written output bytes.
+};
+
+
+/**
+ * Statistics of the stages of a VideoEncoder.
+ */
+struct EncoderStats {
+    StageStats convert;                 // Input conversions; bytes are read input bytes.
+    StageStats encode;                  // avcodec_send_frame(...) and avcodec_receive_packet(...) calls.
+    StageStats mux;                     // av_interleaved_write_frame(...) calls; bytes are packet sizes.
+    uint64_t frame_allocations = 0;     // Plane buffers allocated for frames handed to the codec, ever.
+};
+
+
+/**
+ * Thread-safe accumulator behind a StageStats snapshot. Recording is a handful of relaxed atomic
+ * additions, so stats can be polled from another thread while the stage runs.
+ */
+class StageCounter {
+    const char *m_name;
+    std::atomic<uint64_t> m_calls;
+    std::atomic<uint64_t> m_total_ns;
+    std::atomic<uint64_t> m_max_ns;
+    std::atomic<uint64_t> m_bytes;
+    std::array<std::atomic<uint64_t>, StageStats::HISTOGRAM_BUCKETS> m_histogram;
+
+public:
+    /**
+     * Constructs a counter with all counters at zero.
+     * @param name Name of the stage, used for its trace events (see Tracer). Must outlive the counter.
+     */
+    explicit StageCounter(const char *name);
+
+    StageCounter(const StageCounter &) = delete;
+    StageCounter &operator=(const StageCounter &) = delete;
+
+    /**
+     * Returns the name of the stage.
+     */
+    [[nodiscard]] const char *getName() const { return m_name; }
+
+    /**
+     * Records one call of the stage.
+     * @param ns Duration of the call in nanoseconds.
+     * @param bytes Bytes read or written by the call.
+     */
+    void record(uint64_t ns, uint64_t bytes);
+
+    /**
+     * Returns a snapshot of the counters. Counters recorded concurrently may be partially included.
+     */
+    [[nodiscard]] StageStats getStats() const;
+
+    /**
+     * Sets all counters back to zero.
+     */
+    void reset();
+};
+
+
+/**
+ * Times the enclosing scope and records it to a StageCounter and, while tracing, to the Tracer when
+ * it ends.
+ *
+ * A timer with stats and tracing both off doesn't read the clock, so instrumenting a call costs a
+ * couple of branches when they are turned off.
+ */
+class ScopedStageTimer {
+    StageCounter &m_counter;
+    bool m_record;
+    bool m_trace;
+    uint64_t m_bytes;
+    std::chrono::steady_clock::time_point m_start;
+
+public:
+
+    /**
+     * Starts timing a call of a stage.
+     * @param counter Counter to record the call to.
+     * @param enabled Whether to record the call to the counter.
+     */
+    ScopedStageTimer(StageCounter &counter, bool enabled)
+        : m_counter(counter), m_record(enabled), m_trace(Tracer::isEnabled()), m_bytes(0) {
+        if (m_record || m_trace) {
+            m_start = std::chrono::steady_clock::now();
+        }
+    }
+
+    ~ScopedStageTimer() {
+        if (m_record || m_trace) {
+            const auto end = std::chrono::steady_clock::now();
+            if (m_record) {
+                m_counter.record(std::chrono::duration_cast<std::chrono::nanoseconds>(end - m_start).count(), m_bytes);
+            }
+            if (m_trace) {
+                Tracer::getInstance().record(m_counter.getName(), m_start, end);
+            }
+        }
+    }
+
+    ScopedStageTimer(const ScopedStageTimer &) = delete;
+    ScopedStageTimer &operator=(const ScopedStageTimer &) = delete;
+
+    /**
+     * Adds to the bytes read or written by the timed call.
+     */
+    void addBytes(uint64_t bytes) { m_bytes += bytes; }
+};
@@ -0,0 +1,163 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+
+/**
+ * A process-wide recorder of timeline events that can be exported as a Chrome trace.
+ *
+ * While tracing is started, every stage timed by a ScopedStageTimer (demux, decode, convert, encode,
+ * mux) on every thread is recorded as a begin/end event, whether or not the decoder's or encoder's
+ * stats are enabled. Each thread records into its own fixed-size buffer without taking any lock, so
+ * tracing doesn't serialize the threads it observes. The resulting JSON file can be loaded into
+ * Perfetto (ui.perfetto.dev) or chrome://tracing to see how the stages of all threads overlap.
+ *
+ * When a thread's buffer is full, its further events are dropped and counted (see getDroppedCount()).
+ *
+ * Each buffer takes about 1.5 MB. The buffer of a thread that has exited is freed as soon as its events
+ * have been written by writeChromeTrace() or discarded by clear() (or right away if it holds none), so
+ * processes that keep starting threads only hold buffers for running threads and for finished threads
+ * whose events haven't been written yet.
+ */
+class Tracer {
+public:
+
+    /**
+     * Number of events each thread can record until the trace is cleared.
+     */
+    static constexpr size_t EVENTS_PER_THREAD = size_t{1} << 16;
+
+private:
+
+    /**
+     * A completed event: a named span of time on one thread.
+     */
+    struct Event {
+        const char *name;
+        int64_t begin_ns;
+        int64_t end_ns;
+    };
+
+    /**
+     * Events of one thread. Only the owning thread appends; the count is published with release
+     * semantics, so readers see completely written events only.
+     */
+    struct ThreadBuffer {
+        std::unique_ptr<Event[]> events;
+        std::atomic<size_t> count;
+        std::atomic<uint64_t> dropped;
+        uint32_t thread_id;
+        std::string thread_name;
+        bool exited;                    // Whether the owning thread has exited. Guarded by m_mutex.
+    };
+
+    /**
+     * A thread's registration with the tracer. Its destructor runs when the thread exits and hands
+     * the thread's buffer back for freeing.
+     */
+    struct ThreadRegistration {
+        ThreadBuffer *buffer = nullptr;
+
+        ~ThreadRegistration();
+    };
+
+    static inline std::atomic<bool> s_enabled{false};
+
+    const std::chrono::steady_clock::time_point m_origin;
+    mutable std::mutex m_mutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> m_buffers;
+    uint32_t m_next_thread_id;
+    uint64_t m_freed_dropped;           // Dropped events of buffers that have been freed since clear().
+
+    Tracer();
+
+public:
+
+    Tracer(const Tracer &) = delete;
+    Tracer &operator=(const Tracer &) = delete;
+
+    /**
+     * Returns the process-wide tracer.
+     */
+    static Tracer &getInstance();
+
+    /**
+     * Returns whether events are being recorded. This is a single relaxed load, so instrumented code
+     * can check it on every call.
+     */
+    static bool isEnabled() { return s_enabled.load(std::memory_order_relaxed); }
+
+    /**
+     * Starts recording events. Events recorded earlier are kept; call clear() to discard them.
+     */
+    void start();
+
+    /**
+     * Stops recording events. Events recorded so far are kept.
+     */
+    void stop();
+
+    /**
+     * Discards all recorded events and frees the buffers of exited threads. Must not be called while
+     * other threads may be recording, i.e. only after stop() and once the traced work has finished.
+     */
+    void clear();
+
+    /**
+     * Records an event on the calling thread. Called by ScopedStageTimer; can be used directly to
+     * add application-specific spans.
+     *
+     * @param name Name of the event. Must stay valid until the trace has been written (e.g. a string literal).
+     * @param begin Time the event began.
+     * @param end Time the event ended.
+     */
+    void record(const char *name, std::chrono::steady_clock::time_point begin, std::chrono::steady_clock::time_point end);
+
+    /**
+     * Names the calling thread in written traces (e.g. "decoder" or "encoder 2"). Threads that aren't
+     * named are shown by their number.
+     *
+     * @param name Name of the calling thread.
+     */
+    void setThreadName(const std::string &name);
+
+    /**
+     * Returns the number of events dropped because their thread's buffer was full.
+     */
+    [[nodiscard]] uint64_t getDroppedCount() const;
+
+    /**
+     * Writes all recorded events to a file in Chrome trace event JSON format. Once written, the
+     * events of threads that have exited are discarded and their buffers freed, so they don't appear
+     * in traces written later.
+     *
+     * @param path Path to the file to write.
+     * @return `true` if the trace has been written, `false` if the file couldn't be written.
+     */
+    bool writeChromeTrace(const std::string &path);
+
+private:
+
+    /**
+     * Returns the calling thread's buffer, registering one on the thread's first call.
+     */
+    ThreadBuffer &getThreadBuffer();
+
+    /**
+     * Takes back the buffer of a thread that is exiting. It is freed right away if it holds no
+     * events, and otherwise once they have been written or cleared.
+     */
+    void releaseThreadBuffer(ThreadBuffer *buffer);
+
+    /**
+     * Frees the buffers of exited threads. Must be called with m_mutex held.
+     */
+    void freeExitedBuffers();
+};
@@ -0,0 +1,213 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "transcoder.h"
+
+
+/**
+ * A transcode to run on a TranscodeScheduler.
+ */
+struct TranscodeJob {
+    std::string input_path;
+    std::string output_path;
+    TranscodeOptions options;
+
+    /**
+     * Jobs with a higher priority start first; jobs with equal priority start in submission order.
+     */
+    int priority = 0;
+};
+
+
+/**
+ * Options of a TranscodeScheduler.
+ */
+struct SchedulerOptions {
+
+    /**
+     * Number of threads all running jobs may use together, or 0 to use one per CPU available to the
+     * process (see getAvailableCpuCount()). At least 2: every job needs a decoder and an encoder thread.
+     */
+    int thread_budget = 0;
+
+    /**
+     * Maximum number of jobs running at once, or 0 for one per four threads of the budget. Fewer,
+     * wider jobs waste less on per-job overhead; more, narrower jobs scale better with codecs that
+     * thread poorly. No job gets more than this part of the budget (but at least 2 threads), and a job
+     * only starts while at least 2 threads of the budget are free.
+     */
+    int max_running_jobs = 0;
+};
+
+
+/**
+ * State of a job submitted to a TranscodeScheduler.
+ */
+enum class JobState {
+    QUEUED,
+    RUNNING,
+    COMPLETED,
+    FAILED
+};
+
+
+/**
+ * Progress and throughput of a single job.
+ */
+struct JobStats {
+    uint64_t id = 0;
+    JobState state = JobState::QUEUED;
+    int priority = 0;
+    int decode_threads = 0;             // Threads the job's decoder got from the budget.
+    int encode_threads = 0;             // Threads the job's encoder got from the budget.
+    int64_t frames = 0;                 // Frames encoded (known once the job has finished).
+    double queued_seconds = 0.0;        // Time between submission and start.
+    double run_seconds = 0.0;           // Time between start and end (so far, while running).
+    std::string error;                  // Error message of a failed job.
+
+    /**
+     * Returns the frames encoded per second of running time.
+     */
+    [[nodiscard]] double getFramesPerSecond() const {
+        return run_seconds > 0.0 ? static_cast<double>(frames) / run_seconds : 0.0;
+    }
+};
+
+
+/**
+ * Throughput of all jobs of a TranscodeScheduler together.
+ */
+struct SchedulerStats {
+    int thread_budget = 0;
+    int threads_in_use = 0;             // Threads assigned to running jobs.
+    int queued_jobs = 0;
+    int running_jobs = 0;
+    int completed_jobs = 0;
+    int failed_jobs = 0;
+    int64_t frames = 0;                 // Frames encoded by finished jobs.
+    double busy_seconds = 0.0;          // Wall time during which at least one job has been running.
+
+    /**
+     * Returns the frames encoded per second of busy time across the host.
+     */
+    [[nodiscard]] double getFramesPerSecond() const {
+        return busy_seconds > 0.0 ? static_cast<double>(frames) / busy_seconds : 0.0;
+    }
+};
+
+
+/**
+ * A class for running many transcodes in one process within a fixed CPU thread budget.
+ *
+ * Every codec context spawns its own threads (by default one per core), so a handful of independent
+ * transcodes quickly oversubscribes a host and the jobs thrash each other. The scheduler owns the
+ * thread budget instead: it runs a limited number of jobs at once, in priority order, and hands each
+ * one a share of the budget, split between its decoder and its encoder. Threads a job doesn't use
+ * any more go back to the budget for the jobs that start after it.
+ */
+class TranscodeScheduler {
+    using Clock = std::chrono::steady_clock;
+
+    /**
+     * A submitted job and its bookkeeping.
+     */
+    struct Entry {
+        TranscodeJob job;
+        JobStats stats;
+        Clock::time_point submit_time;
+        Clock::time_point start_time;
+    };
+
+    /**
+     * Orders queued entries (by index) by priority, then by submission.
+     */
+    struct EntryOrder {
+        const std::vector<Entry> *entries;
+        bool operator()(size_t a, size_t b) const;
+    };
+
+    int m_thread_budget;
+    int m_max_running_jobs;
+    int m_available_threads;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_work_available;
+    std::condition_variable m_all_done;
+    std::vector<Entry> m_entries;
+    std::priority_queue<size_t, std::vector<size_t>, EntryOrder> m_queue;
+    int m_running_jobs;
+    bool m_stopping;
+
+    Clock::time_point m_busy_since;
+    Clock::duration m_busy_time;
+
+    std::vector<std::thread> m_workers;
+
+public:
+
+    /**
+     * Starts the worker threads that run the jobs.
+     *
+     * @param options Thread budget and maximum number of running jobs.
+     *
+     * @throws std::system_error If a worker thread cannot be started.
+     */
+    explicit TranscodeScheduler(const SchedulerOptions &options = {});
+
+    /**
+     * Lets running jobs finish, drops queued ones, and stops the worker threads.
+     */
+    ~TranscodeScheduler();
+
+    TranscodeScheduler(const TranscodeScheduler &) = delete;
+    TranscodeScheduler &operator=(const TranscodeScheduler &) = delete;
+
+    /**
+     * Queues a job. It starts as soon as a worker is free and no job of higher priority is waiting.
+     *
+     * @param job Files and settings of the transcode.
+     * @return Id of the job, for looking up its stats.
+     */
+    uint64_t submit(const TranscodeJob &job);
+
+    /**
+     * Waits until all submitted jobs have finished.
+     */
+    void wait();
+
+    /**
+     * Returns the stats of every job submitted so far, in submission order (ids count from 0).
+     */
+    [[nodiscard]] std::vector<JobStats> getJobStats() const;
+
+    /**
+     * Returns the throughput of all jobs together and the use of the thread budget.
+     */
+    [[nodiscard]] SchedulerStats getStats() const;
+
+private:
+
+    /**
+     * Runs queued jobs until the scheduler stops (worker thread).
+     */
+    void runJobs();
+
+    /**
+     * Assigns decoder and encoder threads to a job that is about to start. The mutex must be held.
+     */
+    void assignThreads(JobStats &stats);
+
+    /**
+     * Runs a single job with its assigned threads and returns the number of frames encoded.
+     */
+    static int64_t runJob(const TranscodeJob &job, const JobStats &stats);
+};
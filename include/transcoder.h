@@ -0,0 +1,188 @@
+#pragma once
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libswscale/swscale.h>
+}
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+#include "bounded-queue.h"
+#include "video-decoder.h"
+#include "video-encoder.h"
+
+
+/**
+ * Output settings of a Transcoder. Zero values keep the input's setting.
+ */
+struct TranscodeOptions {
+    int width = 0;                      // Output width in pixels.
+    int height = 0;                     // Output height in pixels.
+    double fps = 0.0;                   // Output frame rate; frames are dropped or repeated to keep the timing.
+    int64_t bitrate = 0;                // Output bit rate in bits per second.
+};
+
+
+/**
+ * Threading settings of Transcoder::runPipelined(...).
+ */
+struct PipelineOptions {
+
+    /**
+     * Number of threads scaling frames, or 0 to pick one per four available CPUs (1 to 4).
+     */
+    int scaler_threads = 0;
+
+    /**
+     * Capacity of each queue between two stages. Larger queues absorb more jitter at the cost of
+     * memory: decoded frames are uncompressed.
+     */
+    size_t queue_capacity = 8;
+};
+
+
+/**
+ * Occupancy of the queues between the stages of a pipelined transcode. The stage behind the queue
+ * that is mostly full (high average occupancy, long push waits) is the bottleneck.
+ */
+struct PipelineStats {
+    BoundedQueueStats packets;          // Demux to decode.
+    BoundedQueueStats decoded_frames;   // Decode to scale.
+    BoundedQueueStats encoder_frames;   // Scale to encode and mux.
+    int scaler_threads = 0;             // Number of threads that scaled frames.
+};
+
+
+/**
+ * Results of a transcode.
+ */
+struct TranscodeStats {
+    int64_t frames = 0;                 // Frames encoded, counting repeats.
+    int64_t scaled_frames = 0;          // Frames that had to be scaled or converted before encoding.
+    int64_t dropped_frames = 0;         // Input frames dropped to match the output frame rate.
+    int64_t repeated_frames = 0;        // Extra encodes of input frames repeated to match the output frame rate.
+    PipelineStats pipeline;             // Queue occupancy; only filled by runPipelined(...).
+};
+
+
+/**
+ * A class for re-encoding the video stream of a file into another file.
+ *
+ * Decoded frames go straight from the VideoDecoder to the VideoEncoder in their native (YUV) format,
+ * instead of taking a detour through RGB buffers. Frames are only scaled when their dimensions or
+ * pixel format differ from the encoder's, and then in a single swscale pass, so a plain re-encode
+ * involves no colorspace conversion and no extra full-frame copy at all.
+ */
+class Transcoder {
+    VideoDecoder m_decoder;
+    VideoEncoder m_encoder;
+    AVFrame *m_scaled_frame;
+    SwsContext *m_sws_context;
+
+    /**
+     * Queues and shared state of a pipelined transcode.
+     */
+    struct Pipeline;
+
+public:
+
+    /**
+     * Opens the input file and creates the output file. The output format (and with it the codec)
+     * is guessed from the output path.
+     *
+     * @param input_path Path to the video file to transcode.
+     * @param output_path Path to the file to write.
+     * @param options Output settings; unset ones are taken from the input.
+     * @param decoder_options Options controlling how the input file is opened.
+     * @param encoder_options Options controlling how the output video stream is encoded.
+     *
+     * @throws std::runtime_error If the input file cannot be decoded.
+     * @throws std::runtime_error If the output file or its encoder cannot be set up.
+     * @throws std::runtime_error If the scaled frame cannot be allocated.
+     */
+    Transcoder(const std::string &input_path, const std::string &output_path, const TranscodeOptions &options = {},
+        const VideoDecoderOptions &decoder_options = {}, const VideoEncoderOptions &encoder_options = {});
+
+    /**
+     * Frees the scaling resources. The output file is finalized by the encoder if run() didn't do it.
+     */
+    ~Transcoder();
+
+    Transcoder(const Transcoder &) = delete;
+    Transcoder &operator=(const Transcoder &) = delete;
+
+    /**
+     * Decodes and re-encodes every frame of the input on the calling thread and finalizes the output
+     * file. Either this or runPipelined(...) can be called once.
+     *
+     * @return Number of frames encoded, and how many of them had to be scaled.
+     *
+     * @throws std::runtime_error If a frame cannot be scaled or encoded.
+     */
+    TranscodeStats run();
+
+    /**
+     * Decodes and re-encodes every frame of the input and finalizes the output file, running each
+     * stage on its own threads: one demuxing, one decoding, a pool scaling, and one encoding and
+     * muxing. The stages are connected by bounded queues, so the slowest stage (usually the encoder)
+     * sets the pace and is kept busy while the others work ahead. Either this or run() can be called
+     * once.
+     *
+     * @param options Number of scaler threads and queue capacity.
+     * @return Number of frames encoded, how many of them had to be scaled, and queue occupancy.
+     *
+     * @throws std::runtime_error If a packet cannot be decoded or a frame cannot be scaled or encoded.
+     * @throws std::system_error If a thread cannot be started.
+     */
+    TranscodeStats runPipelined(const PipelineOptions &options = {});
+
+    /**
+     * Returns the decoder, e.g. to enable its stage stats.
+     */
+    [[nodiscard]] VideoDecoder &getDecoder();
+
+    /**
+     * Returns the encoder, e.g. to enable its stage stats.
+     */
+    [[nodiscard]] VideoEncoder &getEncoder();
+
+private:
+
+    /**
+     * Returns the input's video stream.
+     */
+    [[nodiscard]] const AVStream *getInputStream() const;
+
+    /**
+     * Scales and converts a decoded frame to the encoder's dimensions and pixel format.
+     *
+     * @param frame Decoded frame.
+     * @return The scaled frame, owned by the transcoder.
+     *
+     * @throws std::runtime_error If the scaling context cannot be created.
+     */
+    AVFrame *scaleFrame(const AVFrame *frame);
+
+    /**
+     * Reads the video packets of the input and queues them for decoding (demux thread).
+     */
+    void demuxPackets(Pipeline &pipeline);
+
+    /**
+     * Decodes queued packets and queues the frames, numbered in presentation order, for scaling
+     * (decode thread).
+     */
+    void decodePackets(Pipeline &pipeline);
+
+    /**
+     * Scales queued frames as needed and queues them for encoding (scaler threads).
+     */
+    void scaleFrames(Pipeline &pipeline);
+
+    /**
+     * Restores the order of queued frames and encodes them (encode thread).
+     */
+    void encodeFrames(Pipeline &pipeline);
+};
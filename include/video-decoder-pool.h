@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "video-decoder.h"
+
+
+/**
+ * A pool of recycled VideoDecoder objects for batch jobs over many short clips.
+ *
+ * Instead of constructing and destructing a decoder per file, the pool hands out decoders that have
+ * been released earlier and merely reopens them (see VideoDecoder::reopen), which keeps their codec
+ * context, packet, frame and conversion context alive across files.
+ *
+ * Acquiring and releasing decoders is thread-safe. The pool must outlive every decoder it hands out.
+ */
+class VideoDecoderPool {
+public:
+
+    /**
+     * Deleter of pooled decoders that returns them to their pool instead of destroying them.
+     */
+    class Releaser {
+        VideoDecoderPool *m_pool;
+
+    public:
+        explicit Releaser(VideoDecoderPool *pool = nullptr) : m_pool(pool) {}
+
+        void operator()(VideoDecoder *decoder) const;
+    };
+
+    /**
+     * A decoder handed out by the pool. It goes back to the pool when the handle is destroyed.
+     */
+    using Handle = std::unique_ptr<VideoDecoder, Releaser>;
+
+private:
+    VideoDecoderOptions m_options;
+    size_t m_max_idle_decoders;
+    mutable std::mutex m_mutex;
+    std::vector<std::unique_ptr<VideoDecoder>> m_idle_decoders;
+    size_t m_created_count;
+    size_t m_reused_count;
+
+public:
+
+    /**
+     * Constructs an empty VideoDecoderPool.
+     *
+     * @param max_idle_decoders Maximum number of released decoders kept for reuse. Decoders released
+     * while the pool is full are destroyed.
+     * @param options Options used to open every file handed to the pool.
+     */
+    explicit VideoDecoderPool(size_t max_idle_decoders = 4, const VideoDecoderOptions &options = {});
+
+    VideoDecoderPool(const VideoDecoderPool &) = delete;
+    VideoDecoderPool &operator=(const VideoDecoderPool &) = delete;
+
+    /**
+     * Returns a decoder for the specified video file, recycling an idle decoder if there is one.
+     *
+     * @param path The path to the video file to be decoded.
+     * @return A decoder positioned at the start of the video stream.
+     *
+     * @throws std::runtime_error If the video file cannot be opened or the decoder cannot be set up.
+     */
+    [[nodiscard]] Handle acquire(const std::string &path);
+
+    /**
+     * Returns the number of released decoders currently waiting to be reused.
+     */
+    [[nodiscard]] size_t getIdleCount() const;
+
+    /**
+     * Returns the number of decoders the pool had to construct from scratch.
+     */
+    [[nodiscard]] size_t getCreatedCount() const;
+
+    /**
+     * Returns the number of times an idle decoder has been recycled for a new file.
+     */
+    [[nodiscard]] size_t getReusedCount() const;
+
+private:
+
+    /**
+     * Takes back a decoder that has been handed out by acquire(...).
+     */
+    void release(VideoDecoder *decoder);
+};
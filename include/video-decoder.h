@@ -5,11 +5,63 @@ extern "C" {
 #include <libavcodec/avcodec.h>
 #include <libswscale/swscale.h>
 #include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
 }
 
+#include <atomic>
 #include <cstdint>
+#include <memory>
+#include <stdexcept>
 #include <string>
 
+#include "frame-allocator.h"
+#include "frame-output.h"
+#include "probe-cache.h"
+#include "stage-stats.h"
+#include "video-stream-info.h"
+
+
+/**
+ * Options controlling how a VideoDecoder opens its video file.
+ */
+struct VideoDecoderOptions {
+
+    /**
+     * Cache of stream probing results. If set, the decoder skips probing files that are already
+     * cached and adds the probing results of files that aren't. The cache must outlive the decoder.
+     */
+    const ProbeCache *probe_cache = nullptr;
+
+    /**
+     * Allocator for the planes of decoded frames. If set, decoded frames live in memory obtained from
+     * it instead of FFmpeg's internal pools. The allocator must outlive the decoder and every frame
+     * obtained from it through getNextFrame(AVFrame *, int64_t *).
+     */
+    FrameAllocator *frame_allocator = nullptr;
+
+    /**
+     * Number of threads the codec may decode with, or 0 for one per CPU available to the process (see
+     * getAvailableCpuCount()). With 1, FFmpeg's own default, decoding runs entirely on the calling thread.
+     */
+    int thread_count = 1;
+};
+
+
+/**
+ * Color metadata of a video stream, as needed to interpret high bit depth (e.g. HDR) output.
+ */
+struct VideoColorInfo {
+    AVColorPrimaries primaries = AVCOL_PRI_UNSPECIFIED;
+    AVColorTransferCharacteristic transfer = AVCOL_TRC_UNSPECIFIED;
+    AVColorSpace space = AVCOL_SPC_UNSPECIFIED;
+    AVColorRange range = AVCOL_RANGE_UNSPECIFIED;
+
+    /**
+     * Bits per luma sample of the decoded frames (e.g. 10 for yuv420p10le), or 0 if unknown.
+     */
+    int bit_depth = 0;
+};
+
 
 /**
  * A class for decoding video frames from a video file using FFmpeg.
@@ -20,12 +72,26 @@ extern "C" {
  * simple interface for frame retrieval.
  */
 class VideoDecoder {
+    std::string m_path;
+    VideoDecoderOptions m_options;
     AVFormatContext *m_format_context;
     AVCodecContext *m_codec_context;
+    std::unique_ptr<FrameBufferPool> m_frame_buffer_pool;
+    std::shared_ptr<const VideoStreamInfo> m_stream_info;
 
     int m_video_stream_index;
     AVPacket *m_packet;
     AVFrame *m_frame;
+    SwsContext *m_sws_context;
+    bool m_has_pending_frames;
+
+    std::atomic<bool> m_stats_enabled;
+    StageCounter m_demux_counter;
+    StageCounter m_decode_counter;
+    StageCounter m_convert_counter;
+
+    // Takes decoded frames from getNextFrame(AVFrame **) without converting them to RGB.
+    friend class Transcoder;
 
 public:
 
@@ -37,6 +103,7 @@ public:
      * within the file and prepares the decoder for subsequent frame retrieval operations.
      *
      * @param path The path to the video file to be decoded.
+     * @param options Options controlling how the video file is opened.
      *
      * @throws std::runtime_error If the video file cannot be opened.
      * @throws std::runtime_error If the stream information cannot be retrieved.
@@ -48,13 +115,44 @@ public:
      * @throws std::runtime_error If the packet allocation fails.
      * @throws std::runtime_error If the frame allocation fails.
      */
-    explicit VideoDecoder(const std::string &path);
+    explicit VideoDecoder(const std::string &path, const VideoDecoderOptions &options = {});
 
     /**
      * Destructs the VideoDecoder object, releasing all associated resources.
      */
     ~VideoDecoder();
 
+    VideoDecoder(const VideoDecoder &) = delete;
+    VideoDecoder &operator=(const VideoDecoder &) = delete;
+
+    /**
+     * Creates an independent decoder for the same video file.
+     *
+     * The clone reuses the stream information (codec parameters, timing and seek index) this decoder
+     * has already probed, so only a new I/O handle and a new codec context are opened. Clones can be
+     * used concurrently with each other and with this decoder, which makes them a cheap way to run
+     * several parallel readers or seekers over one file.
+     *
+     * @return A new decoder positioned at the start of the video stream.
+     *
+     * @throws std::runtime_error If the video file cannot be reopened or the decoder cannot be set up.
+     */
+    [[nodiscard]] std::unique_ptr<VideoDecoder> clone() const;
+
+    /**
+     * Closes the current video file and opens another one in its place.
+     *
+     * The packet, the frame and the conversion context are always kept. The codec context is kept as
+     * well (and merely flushed) if the new video stream uses the same codec, dimensions, pixel format
+     * and codec extradata as the current one, which is the common case for batches of similar clips.
+     * If opening the new file fails, the decoder keeps decoding the current one.
+     *
+     * @param path The path to the video file to be decoded.
+     *
+     * @throws std::runtime_error If the video file cannot be opened or the decoder cannot be set up.
+     */
+    void reopen(const std::string &path);
+
     /**
      * Returns the width of the video stream in pixels.
      *
@@ -90,6 +188,14 @@ public:
      */
     [[nodiscard]] int64_t getBitrate() const;
 
+    /**
+     * Returns the color primaries, transfer characteristic, matrix coefficients, range, and bit depth
+     * of the video stream.
+     *
+     * @return Color metadata of the video stream.
+     */
+    [[nodiscard]] VideoColorInfo getColorInfo() const;
+
     /**
      * Decodes the next video m_frame, converts it to an RGB buffer, and retrieves its presentation timestamp.
      *
@@ -99,6 +205,35 @@ public:
      */
     bool getNextFrame(uint8_t *rgb_buffer, int64_t *pts = nullptr);
 
+    /**
+     * Decodes the next video frame, converts (a region of) it to RGB, and writes it into a caller-provided
+     * buffer as described by an output descriptor.
+     *
+     * @param output Describes the destination buffer, its row stride, the destination offset, and the
+     * region of the frame to convert.
+     * @param pts Pointer (can be null) to store the presentation timestamp (PTS) of the decoded frame in microseconds.
+     * @return `true` if a frame is successfully decoded and converted, `false` on end of stream or error.
+     *
+     * @throws std::runtime_error If the crop rectangle exceeds the frame, the output buffer is misaligned, or
+     * the conversion fails.
+     */
+    bool getNextFrame(const FrameOutput &output, int64_t *pts = nullptr);
+
+    /**
+     * Decodes the next video frame and hands out a new reference to it, without any conversion or copying.
+     *
+     * The frame stays valid (and unchanged) until the caller unreferences it, no matter how many frames
+     * are decoded afterwards. With a frame allocator (see VideoDecoderOptions), its planes live in
+     * memory obtained from that allocator.
+     *
+     * @param frame Frame to store the reference in. Any reference it held before is released.
+     * @param pts Pointer (can be null) to store the presentation timestamp (PTS) of the decoded frame in microseconds.
+     * @return `true` if a frame is successfully decoded, `false` on end of stream or error.
+     *
+     * @throws std::runtime_error If the decoded frame cannot be referenced.
+     */
+    bool getNextFrame(AVFrame *frame, int64_t *pts = nullptr);
+
     /**
      * Seeks to the nearest keyframe at or before the specified timestamp, then decodes frames
      * until the exact timestamp is reached.
@@ -107,10 +242,82 @@ public:
      * @return true if the desired timestamp is reached successfully, returns false otherwise.
      */
     bool seekToTimestamp(int64_t timestamp_in_microseconds);
-   
+
+    /**
+     * Turns timing of the demux, decode, and convert stages on or off. Stats are off by default; while
+     * they are off, the instrumentation costs a branch per stage call. Can be called from any thread.
+     *
+     * @param enabled Whether to record stage stats.
+     */
+    void setStatsEnabled(bool enabled);
+
+    /**
+     * Returns the stats recorded so far. Stats accumulate across reopen() and can be polled from any
+     * thread while the decoder is in use.
+     *
+     * @return Call counts, cumulative time, bytes, and latency histograms of each stage.
+     */
+    [[nodiscard]] DecoderStats getStats() const;
+
+    /**
+     * Sets all recorded stats back to zero. Can be called from any thread.
+     */
+    void resetStats();
+
 
 private:
 
+    /**
+     * Constructs a VideoDecoder object, optionally reusing previously probed stream information.
+     *
+     * @param path The path to the video file to be decoded.
+     * @param options Options controlling how the video file is opened.
+     * @param stream_info Stream information to apply instead of probing the file. If null or if it
+     * doesn't match the file, the stream information is looked up in the probe cache (if any) and
+     * the file is probed with `avformat_find_stream_info` as a last resort.
+     */
+    VideoDecoder(const std::string &path, const VideoDecoderOptions &options,
+        std::shared_ptr<const VideoStreamInfo> stream_info);
+
+    /**
+     * Opens a video file and finds its video stream, reusing previously probed stream information
+     * where possible.
+     *
+     * @param path The path to the video file to be opened.
+     * @param stream_info Stream information to apply instead of probing the file (may be null). On
+     * return, holds the stream information actually used for the file.
+     * @param video_stream_index Receives the index of the video stream.
+     * @return The opened format context.
+     *
+     * @throws std::runtime_error If the video file cannot be opened.
+     * @throws std::runtime_error If the stream information cannot be retrieved.
+     * @throws std::runtime_error If no video stream is found in the file.
+     */
+    AVFormatContext *openInput(const std::string &path, std::shared_ptr<const VideoStreamInfo> &stream_info,
+        int &video_stream_index) const;
+
+    /**
+     * Allocates and opens a decoder context for a video stream.
+     *
+     * @param codec_parameters Codec parameters of the video stream.
+     * @return The opened codec context.
+     *
+     * @throws std::runtime_error If the video codec is unsupported.
+     * @throws std::runtime_error If the video codec context cannot be allocated.
+     * @throws std::runtime_error If the codec parameters cannot be copied to the codec context.
+     * @throws std::runtime_error If the video codec cannot be opened.
+     */
+    AVCodecContext *openCodec(const AVCodecParameters *codec_parameters) const;
+
+    /**
+     * Checks whether the current codec context can decode a video stream with the specified codec
+     * parameters without being reopened.
+     *
+     * @param codec_parameters Codec parameters of the video stream.
+     * @return `true` if codec, dimensions, pixel format, and extradata all match.
+     */
+    [[nodiscard]] bool isCodecContextReusable(const AVCodecParameters *codec_parameters) const;
+
     /**
      * Returns a pointer to the demuxed video stream. This method is intended to be used
      * with getBestEffortTimestampInMicroseconds(...) method.
@@ -133,7 +340,29 @@ private:
      * @param rgb_buffer pre-allocated buffer of size (m_frame->width * m_frame->height * 3) to
      * write the converted RGB data into.
      */
-    static void convertAVFrameToRGBBuffer(const AVFrame *frame, uint8_t *rgb_buffer);
+    void convertAVFrameToRGBBuffer(const AVFrame *frame, uint8_t *rgb_buffer);
+
+    /**
+     * Converts (a region of) an AVFrame to RGB and writes it into a caller-provided buffer as described
+     * by an output descriptor.
+     * @param frame AVFrame to convert.
+     * @param output Describes the destination buffer and the region of the frame to convert.
+     */
+    void convertAVFrame(const AVFrame *frame, const FrameOutput &output);
+
+    /**
+     * Checks whether the first plane of frames in a pixel format holds 8-bit luma samples that can be
+     * used as grayscale output as they are.
+     * @param descriptor Descriptor of the pixel format.
+     */
+    static bool hasDirectLumaPlane(const AVPixFmtDescriptor *descriptor);
+
+    /**
+     * Makes the scaling context convert YUV with the matrix coefficients and range of a frame, instead
+     * of swscale's BT.601 limited range default.
+     * @param frame Frame about to be converted.
+     */
+    void applyColorspaceDetails(const AVFrame *frame);
 
     /**
      * Returns the best effort timestamp of an AVFrame in microseconds.
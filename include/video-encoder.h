@@ -7,27 +7,152 @@ extern "C" {
 #include <libavutil/imgutils.h>
 }
 
+#include <atomic>
 #include <cstdint>
+#include <map>
 #include <string>
 
+#include "frame-input.h"
+#include "frame-pool.h"
+#include "stage-stats.h"
+
+
+/**
+ * How an encoder spreads its work across threads.
+ */
+enum class EncoderThreadType {
+    AUTO,       // Let the codec choose (usually frame threading where supported).
+    FRAME,      // Encode several frames at once: the best throughput, but adds a frame of latency per thread.
+    SLICE       // Split each frame into slices encoded in parallel: no extra latency, slightly larger output.
+};
+
+
+/**
+ * Options controlling how a VideoEncoder encodes its video stream.
+ */
+struct VideoEncoderOptions {
+
+    /**
+     * Name of the encoder to use (e.g. "libx264", "libx265", "libvpx-vp9", "libsvtav1", "mpeg4"), or
+     * empty to use the output format's default video codec. The output format must support it.
+     */
+    std::string codec_name;
+
+    /**
+     * Speed preset (e.g. "veryfast" for libx264 and libx265, "8" for libsvtav1), or empty for the
+     * encoder's default. Passed to the encoder as its "preset" option.
+     */
+    std::string preset;
+
+    /**
+     * Tuning (e.g. "film", "animation", or "zerolatency" for libx264), or empty for none. Passed to
+     * the encoder as its "tune" option.
+     */
+    std::string tune;
+
+    /**
+     * Profile (e.g. "high" for libx264, "main10" for libx265), or empty for the encoder's default.
+     */
+    std::string profile;
+
+    /**
+     * Constant rate factor, or a negative value to encode at the requested bitrate. Set, it replaces
+     * the bitrate: lower values give better quality and larger files. Encoders without a CRF mode
+     * (e.g. mpeg4) use a fixed quantizer of the same value instead.
+     */
+    int crf = -1;
+
+    /**
+     * Constant quantizer, or a negative value to encode at the requested bitrate (or CRF). Set, it
+     * replaces both. Encoders without a "qp" option use a fixed quantizer (qscale, or qmin = qmax).
+     */
+    int qp = -1;
+
+    /**
+     * Further encoder options by name, as in `ffmpeg -h encoder=NAME` (e.g. {"x264-params",
+     * "aq-mode=3"} or {"row-mt", "1"}). The named options above take precedence over these. Options the
+     * encoder doesn't know make the constructor throw.
+     */
+    std::map<std::string, std::string> codec_options;
+
+    /**
+     * Maximum distance between keyframes in frames.
+     */
+    int gop_size = 12;
+
+    /**
+     * Whether the encoder may insert extra keyframes at scene changes. Turning this off makes
+     * keyframes fall exactly every `gop_size` frames (with encoders that support it, e.g. libx264 and
+     * MPEG-4 part 2), which is needed to keep keyframes aligned across several encodes of one video.
+     */
+    bool scene_cut_keyframes = true;
+
+    /**
+     * Number of threads the codec may encode with, or 0 for one per CPU available to the process.
+     * Unlike the codecs' own automatic counts, the automatic count honors CPU affinity and container
+     * (cgroup) CPU limits; see getAvailableCpuCount(). Defaults to 1, like FFmpeg and the decoder, so
+     * that several encoders in one process don't each claim every CPU.
+     */
+    int thread_count = 1;
+
+    /**
+     * Kind of threading the codec should use. Codecs that don't support the requested kind fall back
+     * to what they support.
+     */
+    EncoderThreadType thread_type = EncoderThreadType::AUTO;
+
+    /**
+     * Number of slice threads converting and resizing input frames, or 0 to use up to 4 (of the CPUs
+     * available to the process) for frames of 1280x720 pixels or more on either side of the
+     * conversion, and a single thread for smaller ones.
+     */
+    int scaler_threads = 0;
+};
+
+
 /**
  * A class for encoding video frames into a video file using FFmpeg.
  *
  * The `VideoEncoder` class provides functionality to create and configure a video
- * encoder, encode RGB frames into a video stream, and finalize the video file. It
+ * encoder, encode RGB or YUV frames into a video stream, and finalize the video file. It
  * manages the lifecycle of the underlying FFmpeg structures and provides a simple
  * interface for encoding video frames.
  */
 class VideoEncoder {
+
+    /**
+     * Identifies the scaling context of an input size and pixel format.
+     */
+    struct ScalerKey {
+        int width;
+        int height;
+        AVPixelFormat format;
+
+        auto operator<=>(const ScalerKey &) const = default;
+    };
+
     AVFormatContext *m_format_context;
     AVCodecContext *m_codec_context;
     AVStream *m_stream;
     AVFrame *m_frame;
+    FramePool m_frame_pool;
     AVPacket *m_packet;
-    SwsContext *m_sws_context;
+    std::map<ScalerKey, SwsContext *> m_sws_contexts;
+    AVFrame *m_input_frame;
+    int m_scaler_threads;
     bool m_finalized;
     int64_t m_pts;
 
+    std::atomic<bool> m_stats_enabled;
+    StageCounter m_convert_counter;
+    StageCounter m_encode_counter;
+    StageCounter m_mux_counter;
+
+    // Feed decoded frames to encodeFrame(AVFrame *) without converting them to RGB first.
+    friend class Transcoder;
+    friend class LadderEncoder;
+    friend class AsyncVideoEncoder;
+
 public:
     /**
      * Initializes the encoder with the specified parameters.
@@ -48,6 +173,23 @@ public:
      */
     explicit VideoEncoder(const std::string &filepath, int width, int height, double fps, int64_t bitrate);
 
+    /**
+     * Initializes the encoder with the specified parameters and encoding options.
+     *
+     * @param filepath Path to the output video file.
+     * @param width Width of the output video in pixels.
+     * @param height Height of the output video in pixels.
+     * @param fps Frames per second of the output video.
+     * @param bitrate Bitrate of the output video in bits per second.
+     * @param options Options controlling how the video stream is encoded.
+     *
+     * @throws std::runtime_error If the encoder cannot be set up (see above).
+     * @throws std::runtime_error If the requested codec doesn't exist or the output format doesn't support it.
+     * @throws std::runtime_error If the encoder doesn't know one of the codec options.
+     */
+    VideoEncoder(const std::string &filepath, int width, int height, double fps, int64_t bitrate,
+        const VideoEncoderOptions &options);
+
     /**
      * Destructor to ensure proper cleanup and finalization of the encoding process.
      * Calls finalize() to ensure that the file is correctly written before cleanup.
@@ -66,6 +208,19 @@ public:
      */
     void encodeFrame(const uint8_t *rgb_buffer, int width, int height);
 
+    /**
+     * Encodes a frame in one of several pixel formats, described plane by plane with strides. A frame
+     * that already has the output video's dimensions and pixel format (I420, i.e. YUV 4:2:0) is copied
+     * as is, without any conversion; any other frame is converted and resized as needed.
+     *
+     * @param input Format, dimensions, planes, and strides of the frame. The planes are only read
+     * during the call.
+     *
+     * @throws std::runtime_error If the frame has invalid dimensions or lacks a plane its format needs.
+     * @throws std::runtime_error If the frame cannot be encoded or if any error occurs during conversion.
+     */
+    void encodeFrame(const FrameInput &input);
+
     /**
      * Finalizes the encoding process, ensuring that the output file is written correctly.
      * This method flushes the encoder, writes the trailer, and cleans up FFmpeg structures.
@@ -74,13 +229,101 @@ public:
      */
     void finalize();
 
+    /**
+     * Turns timing of the convert, encode, and mux stages on or off. Stats are off by default; while
+     * they are off, the instrumentation costs a branch per stage call. Can be called from any thread.
+     *
+     * @param enabled Whether to record stage stats.
+     */
+    void setStatsEnabled(bool enabled);
+
+    /**
+     * Returns the stats recorded so far. Can be polled from any thread while the encoder is in use.
+     *
+     * @return Call counts, cumulative time, bytes, and latency histograms of each stage.
+     */
+    [[nodiscard]] EncoderStats getStats() const;
+
+    /**
+     * Sets all recorded stage stats back to zero; the frame allocation count keeps counting. Can be
+     * called from any thread.
+     */
+    void resetStats();
+
 private:
 
     /**
-     * Encodes a YUV frame (as an AVFrame) without any colorspace conversion. However,
-     * the frame is resized to output video dimensions as needed before encoding.
+     * Checks a frame description and gathers its planes, filling in the strides of tightly packed ones.
+     *
+     * @param input Frame description.
+     * @param src_data Receives the start of each plane; unused entries are null.
+     * @param src_stride Receives the line size of each plane in bytes; unused entries are 0.
+     * @param format Receives the FFmpeg pixel format of the frame.
+     * @return Size of the planes in bytes.
+     *
+     * @throws std::runtime_error If the frame has invalid dimensions or lacks a plane its format needs.
+     */
+    static uint64_t getInputPlanes(const FrameInput &input, const uint8_t *src_data[4], int src_stride[4],
+        AVPixelFormat &format);
+
+    /**
+     * Copies or converts a frame given as planes into the encoder's frame, then encodes it. Frames in
+     * the output video's dimensions and pixel format are copied, any others converted and resized.
+     *
+     * @param src_data Start of each plane.
+     * @param src_stride Line size of each plane in bytes.
+     * @param width Width of the frame in pixels.
+     * @param height Height of the frame in pixels.
+     * @param format Pixel format of the frame; swscale must support it as input.
+     * @param src_bytes Size of the planes in bytes, for the stage stats.
+     *
+     * @throws std::runtime_error If the frame cannot be converted or encoded.
+     */
+    void encodePlanes(const uint8_t *const src_data[4], const int src_stride[4], int width, int height,
+        AVPixelFormat format, uint64_t src_bytes);
+
+    /**
+     * Fills a blank frame with a writable buffer of the output video's dimensions and pixel format from
+     * the encoder's frame pool. The buffer goes back to the pool once the codec releases it.
+     *
+     * @param frame Frame without buffers.
+     *
+     * @throws std::runtime_error If the buffer cannot be allocated.
+     */
+    void getFrameBuffer(AVFrame *frame);
+
+    /**
+     * Returns the scaling context converting frames of an input size and pixel format to the output
+     * video's, creating it on first use. A few contexts are kept, so sources alternating between
+     * sizes or formats don't rebuild them on every frame.
+     *
+     * @throws std::runtime_error If the scaling context cannot be created.
+     */
+    SwsContext *getScaler(int width, int height, AVPixelFormat format);
+
+    /**
+     * Frees the scaling contexts, frames, packet, and codec context, and closes the output file. Nothing
+     * is flushed or written.
+     */
+    void close();
+
+    /**
+     * Encodes a YUV frame (as an AVFrame) without any colorspace conversion or resizing. The frame
+     * must already have the output video's dimensions and pixel format. Its timestamp is overwritten.
      *
      * @param frame Pointer to the AVFrame representing the YUV frame to be encoded.
      */
     void encodeFrame(AVFrame* frame);
+
+    /**
+     * Receives an encoded packet from the codec.
+     *
+     * @return The result of avcodec_receive_packet(...).
+     */
+    int receivePacket();
+
+    /**
+     * Writes the received packet to the output file and unreferences it.
+     */
+    void writePacket();
 };
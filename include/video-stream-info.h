@@ -0,0 +1,79 @@
+#pragma once
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+}
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+
+/**
+ * An immutable snapshot of what probing (`avformat_find_stream_info`) discovered about a video stream.
+ *
+ * A VideoStreamInfo is captured once, right after a file has been probed, and can then be applied to
+ * freshly opened format contexts of the same file so that they don't have to probe the file again.
+ * Since it is never modified after being captured, it can be shared freely between threads.
+ */
+struct VideoStreamInfo {
+
+    /**
+     * A single entry of the demuxer's seek index.
+     */
+    struct IndexEntry {
+        int64_t position;
+        int64_t timestamp;
+        int size;
+        int distance;
+        int flags;
+    };
+
+    AVCodecParameters *codec_parameters;
+    int stream_index;
+    AVRational time_base;
+    AVRational avg_frame_rate;
+    AVRational r_frame_rate;
+    int64_t start_time;         // in stream time base.
+    int64_t duration;           // in stream time base.
+    int64_t format_start_time;  // in AV_TIME_BASE units.
+    int64_t format_duration;    // in AV_TIME_BASE units.
+    int64_t format_bit_rate;
+    std::vector<IndexEntry> index;
+
+    /**
+     * Constructs an empty VideoStreamInfo with freshly allocated codec parameters.
+     *
+     * @throws std::runtime_error If the codec parameters cannot be allocated.
+     */
+    VideoStreamInfo();
+
+    /**
+     * Releases the codec parameters owned by the snapshot.
+     */
+    ~VideoStreamInfo();
+
+    VideoStreamInfo(const VideoStreamInfo &) = delete;
+    VideoStreamInfo &operator=(const VideoStreamInfo &) = delete;
+
+    /**
+     * Captures the stream information of an already probed format context.
+     *
+     * @param format_context Format context that `avformat_find_stream_info` has been called on.
+     * @param stream_index Index of the video stream to capture.
+     * @return The captured stream information.
+     *
+     * @throws std::runtime_error If the codec parameters cannot be copied.
+     */
+    static std::shared_ptr<const VideoStreamInfo> capture(AVFormatContext *format_context, int stream_index);
+
+    /**
+     * Applies the snapshot to a freshly opened (but not yet probed) format context of the same file.
+     *
+     * @param format_context Format context returned by `avformat_open_input`.
+     * @return `true` if the snapshot matches the opened file and has been applied, `false` if the
+     * format context has to be probed the regular way.
+     */
+    bool apply(AVFormatContext *format_context) const;
+};
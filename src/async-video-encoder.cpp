@@ -0,0 +1,329 @@
+#include "async-video-encoder.h"
+
+extern "C" {
+#include <libavutil/imgutils.h>
+#include <libswscale/swscale.h>
+}
+
+#include <algorithm>
+
+#include "tracer.h"
+
+
+/**
+ * Creates the output file and starts the encoder thread.
+ *
+ * @param filepath Path to the output video file.
+ * @param width Width of the output video in pixels.
+ * @param height Height of the output video in pixels.
+ * @param fps Frames per second of the output video.
+ * @param bitrate Bitrate of the output video in bits per second.
+ * @param encoder_options Options controlling how the video stream is encoded.
+ * @param options Queue capacity and what to do when it is full.
+ */
+AsyncVideoEncoder::AsyncVideoEncoder(const std::string &filepath, int width, int height, double fps,
+    int64_t bitrate, const VideoEncoderOptions &encoder_options, const AsyncEncoderOptions &options)
+    : m_encoder(filepath, width, height, fps, bitrate, encoder_options), m_options(options),
+    m_frames(options.queue_capacity), m_queued_frames(0), m_encoded_frames(0), m_dropped_frames(0),
+    m_stopped(false) {
+    m_options.queue_capacity = std::max(m_options.queue_capacity, size_t{1});
+
+    m_thread = std::thread([this] {
+        if (Tracer::isEnabled()) {
+            Tracer::getInstance().setThreadName("async-encode");
+        }
+        encodeFrames();
+    });
+}
+
+
+/**
+ * Encodes the frames still queued, stops the encoder thread, and finalizes the file. Errors are
+ * swallowed; call finalize() to see them.
+ */
+AsyncVideoEncoder::~AsyncVideoEncoder() {
+    try {
+        finalize();
+    } catch (const std::exception &) {
+    }
+}
+
+
+/**
+ * Copies a frame into a pooled buffer and queues it for encoding.
+ *
+ * @param input Format, dimensions, planes, and strides of the frame. The planes are only read
+ * during the call.
+ * @return Number of the frame, or -1 if it was dropped because the queue was full.
+ */
+int64_t AsyncVideoEncoder::encodeFrame(const FrameInput &input) {
+    checkError();
+    const uint8_t *src_data[4];
+    int src_stride[4];
+    AVPixelFormat format;
+    VideoEncoder::getInputPlanes(input, src_data, src_stride, format);
+
+    // Don't bother copying a frame that would be dropped anyway.
+    if (m_options.full_policy == QueueFullPolicy::DROP && isQueueFull()) {
+        std::lock_guard lock(m_mutex);
+        m_dropped_frames++;
+        return -1;
+    }
+
+    FramePointer frame(av_frame_alloc());
+    if (!frame) {
+        throw std::runtime_error("couldn't allocate frame");
+    }
+    m_pool.getFrame(frame.get(), format, input.width, input.height);
+    av_image_copy(frame->data, frame->linesize, src_data, src_stride, format, input.width, input.height);
+    return queueFrame(frame);
+}
+
+
+/**
+ * Copies an RGB frame (expected buffer size: width x height x 3 bytes) into a pooled buffer and
+ * queues it for encoding.
+ *
+ * @param rgb_buffer Pointer to the RGB buffer representing the frame to be encoded.
+ * @param width Width of the input frame in pixels.
+ * @param height Height of the input frame in pixels.
+ * @return Number of the frame, or -1 if it was dropped because the queue was full.
+ */
+int64_t AsyncVideoEncoder::encodeFrame(const uint8_t *rgb_buffer, int width, int height) {
+    FrameInput input;
+    input.data[0] = rgb_buffer;
+    input.width = width;
+    input.height = height;
+    input.format = FrameInputFormat::RGB24;
+    return encodeFrame(input);
+}
+
+
+/**
+ * Takes over the references of a frame (e.g. a decoded one) and queues it for encoding, without
+ * copying it. Frames in the output video's dimensions and pixel format go to the codec as they
+ * are, except that their picture type is cleared so the encoder places keyframes by its own GOP
+ * structure. A frame that isn't reference counted is copied.
+ *
+ * @param frame Frame in any pixel format swscale can read. It is left blank once queued; a frame
+ * that is dropped, or that an exception is thrown for, keeps its references.
+ * @return Number of the frame, or -1 if it was dropped because the queue was full.
+ */
+int64_t AsyncVideoEncoder::encodeFrame(AVFrame *frame) {
+    checkError();
+    if (!frame || frame->width <= 0 || frame->height <= 0 ||
+        !sws_isSupportedInput(static_cast<AVPixelFormat>(frame->format))) {
+        throw std::runtime_error("unsupported frame for encoding");
+    }
+
+    if (m_options.full_policy == QueueFullPolicy::DROP && isQueueFull()) {
+        std::lock_guard lock(m_mutex);
+        m_dropped_frames++;
+        return -1;
+    }
+
+    FramePointer queued_frame(av_frame_alloc());
+    if (!queued_frame) {
+        throw std::runtime_error("couldn't allocate frame");
+    }
+    const bool moved = frame->buf[0] != nullptr;
+    if (moved) {
+        av_frame_move_ref(queued_frame.get(), frame);
+    } else if (av_frame_ref(queued_frame.get(), frame) < 0) {
+        throw std::runtime_error("couldn't reference frame");
+    }
+
+    // Hand the references back if the frame isn't queued after all.
+    int64_t index;
+    try {
+        index = queueFrame(queued_frame);
+    } catch (...) {
+        if (moved) {
+            av_frame_move_ref(frame, queued_frame.get());
+        }
+        throw;
+    }
+    if (index < 0) {
+        if (moved) {
+            av_frame_move_ref(frame, queued_frame.get());
+        }
+    } else if (!moved) {
+        av_frame_unref(frame);
+    }
+    return index;
+}
+
+
+/**
+ * Returns the number of frames encoded so far. Frames are encoded in order, so every frame whose
+ * number is below this one is done.
+ */
+int64_t AsyncVideoEncoder::getEncodedFrameCount() const {
+    std::lock_guard lock(m_mutex);
+    return m_encoded_frames;
+}
+
+
+/**
+ * Waits until a queued frame has been encoded (and all frames before it).
+ *
+ * @param index Number of the frame, as returned by encodeFrame(...).
+ */
+void AsyncVideoEncoder::waitForFrame(int64_t index) {
+    std::unique_lock lock(m_mutex);
+    if (index < 0 || index >= m_queued_frames) {
+        throw std::runtime_error("no frame " + std::to_string(index) + " was queued");
+    }
+    m_progress.wait(lock, [this, index] { return m_encoded_frames > index || m_error; });
+    if (m_encoded_frames <= index) {
+        std::rethrow_exception(m_error);
+    }
+}
+
+
+/**
+ * Encodes the frames still queued, stops the encoder thread, and finalizes the output file. Frames
+ * can't be queued afterwards. Can be called repeatedly.
+ */
+void AsyncVideoEncoder::finalize() {
+    {
+        std::lock_guard lock(m_mutex);
+        m_stopped = true;
+    }
+    m_frames.close();
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+    checkError();
+    m_encoder.finalize();
+}
+
+
+/**
+ * Returns the number of queued, encoded, and dropped frames and the queue occupancy.
+ */
+AsyncEncoderStats AsyncVideoEncoder::getStats() const {
+    AsyncEncoderStats stats;
+    {
+        std::lock_guard lock(m_mutex);
+        stats.queued_frames = m_queued_frames;
+        stats.encoded_frames = m_encoded_frames;
+        stats.dropped_frames = m_dropped_frames;
+    }
+    stats.pool_allocations = m_pool.getAllocationCount();
+    stats.queue = m_frames.getStats();
+    return stats;
+}
+
+
+/**
+ * Returns the encoder, e.g. to enable its stage stats.
+ */
+VideoEncoder &AsyncVideoEncoder::getEncoder() {
+    return m_encoder;
+}
+
+
+/**
+ * Queues a frame according to the queue-full policy.
+ *
+ * @param frame Frame to queue. Left untouched if it isn't queued.
+ * @return Number of the frame, or -1 if it was dropped.
+ */
+int64_t AsyncVideoEncoder::queueFrame(FramePointer &frame) {
+
+    // Frames are numbered before they are queued, so that the encoder thread never gets ahead of
+    // the count. Only one thread queues frames.
+    int64_t index;
+    {
+        std::lock_guard lock(m_mutex);
+        index = m_queued_frames++;
+    }
+
+    const bool queued = m_options.full_policy == QueueFullPolicy::DROP ?
+        m_frames.tryPush(std::move(frame)) : m_frames.push(std::move(frame));
+    if (queued) {
+        return index;
+    }
+
+    bool stopped;
+    {
+        std::lock_guard lock(m_mutex);
+        m_queued_frames--;
+        stopped = m_stopped || m_error;
+        if (!stopped) {
+            m_dropped_frames++;
+        }
+    }
+    checkError();
+    if (stopped) {
+        throw std::runtime_error("couldn't queue frame: the encoder is finalized");
+    }
+    return -1;
+}
+
+
+/**
+ * Returns whether the queue is full, so that a frame that would be dropped isn't copied or taken
+ * over first.
+ */
+bool AsyncVideoEncoder::isQueueFull() const {
+    return m_frames.size() >= m_options.queue_capacity;
+}
+
+
+/**
+ * Rethrows the encoder thread's error, if it failed.
+ */
+void AsyncVideoEncoder::checkError() const {
+    std::exception_ptr error;
+    {
+        std::lock_guard lock(m_mutex);
+        error = m_error;
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+
+/**
+ * Converts and encodes queued frames until the queue is closed and empty (encoder thread).
+ */
+void AsyncVideoEncoder::encodeFrames() {
+    const AVCodecContext *encoder_context = m_encoder.m_codec_context;
+
+    try {
+        FramePointer frame;
+        while (m_frames.pop(frame)) {
+            const auto format = static_cast<AVPixelFormat>(frame->format);
+
+            // Frames the codec can take are handed over by reference; the pool buffer goes back to the
+            // pool once the codec is done with it. Decoded frames keep their source's picture type,
+            // which would make the encoder copy the input's keyframes instead of placing its own.
+            if (format == encoder_context->pix_fmt && frame->width == encoder_context->width &&
+                frame->height == encoder_context->height) {
+                frame->pict_type = AV_PICTURE_TYPE_NONE;
+                m_encoder.encodeFrame(frame.get());
+            } else {
+                const uint64_t bytes = static_cast<uint64_t>(std::max(
+                    av_image_get_buffer_size(format, frame->width, frame->height, 1), 0));
+                m_encoder.encodePlanes(frame->data, frame->linesize, frame->width, frame->height, format, bytes);
+            }
+            frame.reset();
+
+            {
+                std::lock_guard lock(m_mutex);
+                m_encoded_frames++;
+            }
+            m_progress.notify_all();
+        }
+    } catch (...) {
+        {
+            std::lock_guard lock(m_mutex);
+            m_error = std::current_exception();
+        }
+        m_frames.close();
+        m_progress.notify_all();
+    }
+}
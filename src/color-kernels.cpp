@@ -0,0 +1,459 @@
+#include "color-kernels.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define COLOR_KERNELS_SSE2 1
+#endif
+
+
+namespace {
+
+    /**
+     * Unpacks `count` samples of one component of a row into floats.
+     */
+    void unpackSamples(const uint8_t *row, const AVComponentDescriptor &component, int count, float *samples) {
+        const uint8_t *data = row + component.offset;
+        const unsigned int mask = (1u << component.depth) - 1;
+
+        if (component.depth + component.shift > 8) {
+            for (int i = 0; i < count; i++) {
+                uint16_t value;
+                std::memcpy(&value, data + i * component.step, sizeof(value));
+                samples[i] = static_cast<float>((value >> component.shift) & mask);
+            }
+        } else {
+            for (int i = 0; i < count; i++) {
+                samples[i] = static_cast<float>((data[i * component.step] >> component.shift) & mask);
+            }
+        }
+    }
+
+    /**
+     * Replicates subsampled chroma samples so there is one per pixel.
+     */
+    void upsampleChroma(const float *samples, int log2_chroma_w, int width, float *upsampled) {
+        for (int x = 0; x < width; x++) {
+            upsampled[x] = samples[x >> log2_chroma_w];
+        }
+    }
+
+    /**
+     * The conversion coefficients as separate values, so stores to the scratch rows can't alias them.
+     */
+    struct Matrix {
+        float luma_scale;
+        float luma_offset;
+        float chroma_scale;
+        float chroma_offset;
+        float r_v;
+        float g_u;
+        float g_v;
+        float b_u;
+    };
+
+    /**
+     * Applies the matrix to a row of unpacked samples, starting at column `x`.
+     */
+    void applyMatrixScalar(const float *y, const float *u, const float *v, const Matrix &matrix, int x, int width,
+        float *r, float *g, float *b) {
+        for (; x < width; x++) {
+            const float luma_value = y[x] * matrix.luma_scale + matrix.luma_offset;
+            const float cb = u[x] * matrix.chroma_scale + matrix.chroma_offset;
+            const float cr = v[x] * matrix.chroma_scale + matrix.chroma_offset;
+            r[x] = luma_value + matrix.r_v * cr;
+            g[x] = luma_value + matrix.g_u * cb + matrix.g_v * cr;
+            b[x] = luma_value + matrix.b_u * cb;
+        }
+    }
+
+    /**
+     * Scales a normalized value to 16 bits, clamping it to 0-1 first.
+     */
+    inline uint16_t toUnorm16(float value) {
+        const float clamped = std::min(std::max(value, 0.0f), 1.0f);
+        return static_cast<uint16_t>(static_cast<int>(clamped * 65535.0f + 0.5f));
+    }
+
+    /**
+     * Interleaves a row of R'G'B' into packed float RGB, starting at column `x`.
+     */
+    void packRgbF32Scalar(const float *r, const float *g, const float *b, int x, int width, float *pixels) {
+        for (; x < width; x++) {
+            pixels[3 * x] = r[x];
+            pixels[3 * x + 1] = g[x];
+            pixels[3 * x + 2] = b[x];
+        }
+    }
+
+    /**
+     * Interleaves a row of R'G'B' into packed RGB48, starting at column `x`.
+     */
+    void packRgb48Scalar(const float *r, const float *g, const float *b, int x, int width, uint16_t *pixels) {
+        for (; x < width; x++) {
+            pixels[3 * x] = toUnorm16(r[x]);
+            pixels[3 * x + 1] = toUnorm16(g[x]);
+            pixels[3 * x + 2] = toUnorm16(b[x]);
+        }
+    }
+
+    /**
+     * Interleaves a row of R'G'B' into packed RGBA64 with opaque alpha, starting at column `x`.
+     */
+    void packRgba64Scalar(const float *r, const float *g, const float *b, int x, int width, uint16_t *pixels) {
+        for (; x < width; x++) {
+            pixels[4 * x] = toUnorm16(r[x]);
+            pixels[4 * x + 1] = toUnorm16(g[x]);
+            pixels[4 * x + 2] = toUnorm16(b[x]);
+            pixels[4 * x + 3] = 65535;
+        }
+    }
+
+#ifdef COLOR_KERNELS_SSE2
+
+    /**
+     * Applies the matrix to a row of unpacked samples 4 pixels at a time, with the same operations in
+     * the same order as the scalar kernel. Returns the first column left for the scalar kernel.
+     */
+    int applyMatrixSSE2(const float *y, const float *u, const float *v, const Matrix &matrix, int width,
+        float *r, float *g, float *b) {
+        const __m128 luma_scale = _mm_set1_ps(matrix.luma_scale);
+        const __m128 luma_offset = _mm_set1_ps(matrix.luma_offset);
+        const __m128 chroma_scale = _mm_set1_ps(matrix.chroma_scale);
+        const __m128 chroma_offset = _mm_set1_ps(matrix.chroma_offset);
+        const __m128 r_v = _mm_set1_ps(matrix.r_v);
+        const __m128 g_u = _mm_set1_ps(matrix.g_u);
+        const __m128 g_v = _mm_set1_ps(matrix.g_v);
+        const __m128 b_u = _mm_set1_ps(matrix.b_u);
+
+        int x = 0;
+        for (; x + 4 <= width; x += 4) {
+            const __m128 luma_value = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(y + x), luma_scale), luma_offset);
+            const __m128 cb = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(u + x), chroma_scale), chroma_offset);
+            const __m128 cr = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(v + x), chroma_scale), chroma_offset);
+            _mm_storeu_ps(r + x, _mm_add_ps(luma_value, _mm_mul_ps(r_v, cr)));
+            _mm_storeu_ps(g + x, _mm_add_ps(_mm_add_ps(luma_value, _mm_mul_ps(g_u, cb)), _mm_mul_ps(g_v, cr)));
+            _mm_storeu_ps(b + x, _mm_add_ps(luma_value, _mm_mul_ps(b_u, cb)));
+        }
+        return x;
+    }
+
+    /**
+     * Interleaves a row of R'G'B' into packed float RGB 4 pixels at a time. Returns the first column
+     * left for the scalar kernel.
+     */
+    int packRgbF32SSE2(const float *r, const float *g, const float *b, int width, float *pixels) {
+        int x = 0;
+        for (; x + 4 <= width; x += 4) {
+            const __m128 red = _mm_loadu_ps(r + x);
+            const __m128 green = _mm_loadu_ps(g + x);
+            const __m128 blue = _mm_loadu_ps(b + x);
+
+            // r0 g0 b0 r1 | g1 b1 r2 g2 | b2 r3 g3 b3
+            const __m128 red_green = _mm_unpacklo_ps(red, green);
+            const __m128 blue_red = _mm_unpacklo_ps(blue, red);
+            const __m128 green_blue = _mm_unpacklo_ps(green, blue);
+            float *out = pixels + 3 * x;
+            _mm_storeu_ps(out, _mm_shuffle_ps(red_green, blue_red, _MM_SHUFFLE(3, 0, 1, 0)));
+            _mm_storeu_ps(out + 4, _mm_shuffle_ps(green_blue, _mm_unpackhi_ps(red, green), _MM_SHUFFLE(1, 0, 3, 2)));
+            _mm_storeu_ps(out + 8, _mm_shuffle_ps(_mm_unpackhi_ps(blue, red), _mm_unpackhi_ps(green, blue),
+                _MM_SHUFFLE(3, 2, 3, 0)));
+        }
+        return x;
+    }
+
+    /**
+     * Clamps 8 normalized values to 0-1 and scales them to 16 bits, rounding like toUnorm16(...).
+     */
+    inline __m128i toUnorm16SSE2(const float *values) {
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 scale = _mm_set1_ps(65535.0f);
+        const __m128 half = _mm_set1_ps(0.5f);
+        const __m128i low = _mm_cvttps_epi32(_mm_add_ps(
+            _mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(values), zero), one), scale), half));
+        const __m128i high = _mm_cvttps_epi32(_mm_add_ps(
+            _mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(values + 4), zero), one), scale), half));
+
+        // SSE2 only packs with signed saturation: shift into the signed range and back.
+        const __m128i bias = _mm_set1_epi32(32768);
+        const __m128i packed = _mm_packs_epi32(_mm_sub_epi32(low, bias), _mm_sub_epi32(high, bias));
+        return _mm_xor_si128(packed, _mm_set1_epi16(static_cast<int16_t>(0x8000)));
+    }
+
+    /**
+     * Interleaves a row of R'G'B' into packed RGBA64 with opaque alpha 8 pixels at a time. Returns the
+     * first column left for the scalar kernel.
+     */
+    int packRgba64SSE2(const float *r, const float *g, const float *b, int width, uint16_t *pixels) {
+        const __m128i alpha = _mm_set1_epi16(static_cast<int16_t>(0xffff));
+
+        int x = 0;
+        for (; x + 8 <= width; x += 8) {
+            const __m128i red = toUnorm16SSE2(r + x);
+            const __m128i green = toUnorm16SSE2(g + x);
+            const __m128i blue = toUnorm16SSE2(b + x);
+            const __m128i red_green_low = _mm_unpacklo_epi16(red, green);
+            const __m128i red_green_high = _mm_unpackhi_epi16(red, green);
+            const __m128i blue_alpha_low = _mm_unpacklo_epi16(blue, alpha);
+            const __m128i blue_alpha_high = _mm_unpackhi_epi16(blue, alpha);
+            auto *out = reinterpret_cast<__m128i *>(pixels + 4 * x);
+            _mm_storeu_si128(out, _mm_unpacklo_epi32(red_green_low, blue_alpha_low));
+            _mm_storeu_si128(out + 1, _mm_unpackhi_epi32(red_green_low, blue_alpha_low));
+            _mm_storeu_si128(out + 2, _mm_unpacklo_epi32(red_green_high, blue_alpha_high));
+            _mm_storeu_si128(out + 3, _mm_unpackhi_epi32(red_green_high, blue_alpha_high));
+        }
+        return x;
+    }
+
+    /**
+     * Interleaves a row of R'G'B' into packed RGB48 8 pixels at a time. Each pixel is stored as 8 bytes
+     * whose last 2 are overwritten by the next pixel, so the last pixel of the row is always left for
+     * the scalar kernel. Returns the first column left for it.
+     */
+    int packRgb48SSE2(const float *r, const float *g, const float *b, int width, uint16_t *pixels) {
+        int x = 0;
+        for (; x + 8 < width; x += 8) {
+            const __m128i red = toUnorm16SSE2(r + x);
+            const __m128i green = toUnorm16SSE2(g + x);
+            const __m128i blue = toUnorm16SSE2(b + x);
+            const __m128i red_green_low = _mm_unpacklo_epi16(red, green);
+            const __m128i red_green_high = _mm_unpackhi_epi16(red, green);
+            const __m128i blue_low = _mm_unpacklo_epi16(blue, blue);
+            const __m128i blue_high = _mm_unpackhi_epi16(blue, blue);
+            const __m128i quads[4] = {
+                _mm_unpacklo_epi32(red_green_low, blue_low), _mm_unpackhi_epi32(red_green_low, blue_low),
+                _mm_unpacklo_epi32(red_green_high, blue_high), _mm_unpackhi_epi32(red_green_high, blue_high)
+            };
+
+            uint16_t *out = pixels + 3 * x;
+            for (const __m128i &quad : quads) {
+                _mm_storel_epi64(reinterpret_cast<__m128i *>(out), quad);
+                _mm_storel_epi64(reinterpret_cast<__m128i *>(out + 3), _mm_unpackhi_epi64(quad, quad));
+                out += 6;
+            }
+        }
+        return x;
+    }
+
+#endif
+
+    /**
+     * Scratch rows reused across calls, so steady-state conversion doesn't allocate.
+     */
+    struct ScratchRows {
+        std::vector<float> y, u, v, chroma_u, chroma_v, r, g, b;
+
+        void resize(size_t width) {
+            for (std::vector<float> *row : {&y, &u, &v, &chroma_u, &chroma_v, &r, &g, &b}) {
+                if (row->size() < width) {
+                    row->resize(width);
+                }
+            }
+        }
+    };
+}
+
+
+/**
+ * Computes the conversion coefficients for a colorspace, range, and bit depth.
+ *
+ * @param colorspace Matrix coefficients of the source. Unspecified sources are assumed to be BT.709
+ * if they are at least 720 rows high and BT.601 otherwise.
+ * @param range Range of the source samples. Unspecified ranges are assumed to be limited.
+ * @param depth Bit depth of the source samples.
+ * @param height Height of the source in rows.
+ */
+YuvToRgbCoefficients getYuvToRgbCoefficients(AVColorSpace colorspace, AVColorRange range, int depth, int height) {
+
+    // Luma weights of red (kr) and blue (kb).
+    float kr;
+    float kb;
+    switch (colorspace) {
+        case AVCOL_SPC_BT709:
+            kr = 0.2126f; kb = 0.0722f;
+            break;
+        case AVCOL_SPC_BT2020_NCL:
+        case AVCOL_SPC_BT2020_CL:
+            kr = 0.2627f; kb = 0.0593f;
+            break;
+        case AVCOL_SPC_SMPTE240M:
+            kr = 0.212f; kb = 0.087f;
+            break;
+        case AVCOL_SPC_FCC:
+            kr = 0.30f; kb = 0.11f;
+            break;
+        case AVCOL_SPC_BT470BG:
+        case AVCOL_SPC_SMPTE170M:
+            kr = 0.299f; kb = 0.114f;
+            break;
+        default:
+            if (height >= 720) {
+                kr = 0.2126f; kb = 0.0722f;
+            } else {
+                kr = 0.299f; kb = 0.114f;
+            }
+            break;
+    }
+    const float kg = 1.0f - kr - kb;
+
+    YuvToRgbCoefficients coefficients{};
+    const float maximum = static_cast<float>((1 << depth) - 1);
+    const float scale = static_cast<float>(1 << (depth - 8));
+    if (range == AVCOL_RANGE_JPEG) {
+        coefficients.luma_scale = 1.0f / maximum;
+        coefficients.luma_offset = 0.0f;
+        coefficients.chroma_scale = 1.0f / maximum;
+        coefficients.chroma_offset = -static_cast<float>(1 << (depth - 1)) / maximum;
+    } else {
+        coefficients.luma_scale = 1.0f / (219.0f * scale);
+        coefficients.luma_offset = -16.0f / 219.0f;
+        coefficients.chroma_scale = 1.0f / (224.0f * scale);
+        coefficients.chroma_offset = -128.0f / 224.0f;
+    }
+
+    coefficients.r_v = 2.0f * (1.0f - kr);
+    coefficients.g_u = -2.0f * kb * (1.0f - kb) / kg;
+    coefficients.g_v = -2.0f * kr * (1.0f - kr) / kg;
+    coefficients.b_u = 2.0f * (1.0f - kb);
+    return coefficients;
+}
+
+
+/**
+ * Checks whether convertYuvToRgb(...) can read frames of a pixel format: native-endian planar or
+ * semi-planar Y'CbCr with 8 to 16 bits per sample.
+ */
+bool isYuvToRgbSupported(const AVPixFmtDescriptor *descriptor) {
+    if (!descriptor || descriptor->nb_components < 3 ||
+        (descriptor->flags & (AV_PIX_FMT_FLAG_RGB | AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_BITSTREAM |
+            AV_PIX_FMT_FLAG_HWACCEL | AV_PIX_FMT_FLAG_FLOAT))) {
+        return false;
+    }
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    const bool native_endian = descriptor->flags & AV_PIX_FMT_FLAG_BE;
+#else
+    const bool native_endian = !(descriptor->flags & AV_PIX_FMT_FLAG_BE);
+#endif
+
+    // Packed formats (e.g. YUYV) would need their luma and chroma planes told apart.
+    const AVComponentDescriptor *components = descriptor->comp;
+    return native_endian && components[0].plane != components[1].plane && components[0].plane != components[2].plane &&
+        components[0].depth >= 8 && components[0].depth <= 16;
+}
+
+
+namespace {
+
+    /**
+     * Converts Y'CbCr planes to packed RGB48, RGBA64, or float RGB, with SIMD kernels or the scalar
+     * ones only.
+     */
+    void convertRows(const uint8_t *const planes[4], const int linesizes[4], const AVPixFmtDescriptor *descriptor,
+        const YuvToRgbCoefficients &coefficients, int width, int height, uint8_t *destination,
+        int destination_stride, FrameOutputFormat format, [[maybe_unused]] bool simd) {
+
+        thread_local ScratchRows scratch;
+        scratch.resize(width);
+
+        const Matrix matrix{coefficients.luma_scale, coefficients.luma_offset, coefficients.chroma_scale,
+            coefficients.chroma_offset, coefficients.r_v, coefficients.g_u, coefficients.g_v, coefficients.b_u};
+
+        const AVComponentDescriptor &luma = descriptor->comp[0];
+        const AVComponentDescriptor &blue = descriptor->comp[1];
+        const AVComponentDescriptor &red = descriptor->comp[2];
+        const int chroma_width = -((-width) >> descriptor->log2_chroma_w);
+
+        float *y = scratch.y.data();
+        float *u = scratch.u.data();
+        float *v = scratch.v.data();
+        float *r = scratch.r.data();
+        float *g = scratch.g.data();
+        float *b = scratch.b.data();
+
+        for (int row = 0; row < height; row++) {
+            const int chroma_row = row >> descriptor->log2_chroma_h;
+
+            // Unpack the row into floats, one chroma sample per pixel.
+            unpackSamples(planes[luma.plane] + static_cast<ptrdiff_t>(row) * linesizes[luma.plane], luma, width, y);
+            unpackSamples(planes[blue.plane] + static_cast<ptrdiff_t>(chroma_row) * linesizes[blue.plane], blue,
+                chroma_width, scratch.chroma_u.data());
+            unpackSamples(planes[red.plane] + static_cast<ptrdiff_t>(chroma_row) * linesizes[red.plane], red,
+                chroma_width, scratch.chroma_v.data());
+            upsampleChroma(scratch.chroma_u.data(), descriptor->log2_chroma_w, width, u);
+            upsampleChroma(scratch.chroma_v.data(), descriptor->log2_chroma_w, width, v);
+
+            // Apply the matrix, then pack the row into the destination format. SIMD kernels take what they
+            // can of the row; the scalar kernels finish it.
+            uint8_t *destination_row = destination + static_cast<ptrdiff_t>(row) * destination_stride;
+            int x = 0;
+#ifdef COLOR_KERNELS_SSE2
+            if (simd) {
+                x = applyMatrixSSE2(y, u, v, matrix, width, r, g, b);
+            }
+#endif
+            applyMatrixScalar(y, u, v, matrix, x, width, r, g, b);
+
+            x = 0;
+            if (format == FrameOutputFormat::RGBF32) {
+                auto *pixels = reinterpret_cast<float *>(destination_row);
+#ifdef COLOR_KERNELS_SSE2
+                if (simd) {
+                    x = packRgbF32SSE2(r, g, b, width, pixels);
+                }
+#endif
+                packRgbF32Scalar(r, g, b, x, width, pixels);
+            } else if (format == FrameOutputFormat::RGBA64) {
+                auto *pixels = reinterpret_cast<uint16_t *>(destination_row);
+#ifdef COLOR_KERNELS_SSE2
+                if (simd) {
+                    x = packRgba64SSE2(r, g, b, width, pixels);
+                }
+#endif
+                packRgba64Scalar(r, g, b, x, width, pixels);
+            } else {
+                auto *pixels = reinterpret_cast<uint16_t *>(destination_row);
+#ifdef COLOR_KERNELS_SSE2
+                if (simd) {
+                    x = packRgb48SSE2(r, g, b, width, pixels);
+                }
+#endif
+                packRgb48Scalar(r, g, b, x, width, pixels);
+            }
+        }
+    }
+}
+
+
+/**
+ * Converts Y'CbCr planes to packed RGB48, RGBA64, or float RGB without going through 8 bits.
+ *
+ * Chroma samples are replicated horizontally and vertically. Rows are first unpacked into float
+ * scratch rows, then converted and packed with SSE2 where available. The scalar kernels handle the
+ * rest of each row and produce bit-identical results.
+ *
+ * The destination and its stride must be aligned to the destination's sample size (2 bytes for
+ * RGB48 and RGBA64, 4 bytes for RGBF32).
+ */
+void convertYuvToRgb(const uint8_t *const planes[4], const int linesizes[4], const AVPixFmtDescriptor *descriptor,
+    const YuvToRgbCoefficients &coefficients, int width, int height, uint8_t *destination, int destination_stride,
+    FrameOutputFormat format) {
+    convertRows(planes, linesizes, descriptor, coefficients, width, height, destination, destination_stride, format,
+        true);
+}
+
+
+/**
+ * Scalar reference implementation of convertYuvToRgb(...), producing bit-identical results.
+ */
+void convertYuvToRgbScalar(const uint8_t *const planes[4], const int linesizes[4],
+    const AVPixFmtDescriptor *descriptor, const YuvToRgbCoefficients &coefficients, int width, int height,
+    uint8_t *destination, int destination_stride, FrameOutputFormat format) {
+    convertRows(planes, linesizes, descriptor, coefficients, width, height, destination, destination_stride, format,
+        false);
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+extern "C" {
+#include <libavutil/pixdesc.h>
+#include <libavutil/pixfmt.h>
+}
+
+#include <cstdint>
+
+#include "frame-output.h"
+
+
+/**
+ * Coefficients turning integer Y'CbCr samples of one bit depth and range into normalized R'G'B'.
+ */
+struct YuvToRgbCoefficients {
+    float luma_scale;
+    float luma_offset;
+    float chroma_scale;
+    float chroma_offset;
+    float r_v;
+    float g_u;
+    float g_v;
+    float b_u;
+};
+
+
+/**
+ * Computes the conversion coefficients for a colorspace, range, and bit depth.
+ *
+ * @param colorspace Matrix coefficients of the source. Unspecified sources are assumed to be BT.709
+ * if they are at least 720 rows high and BT.601 otherwise.
+ * @param range Range of the source samples. Unspecified ranges are assumed to be limited.
+ * @param depth Bit depth of the source samples.
+ * @param height Height of the source in rows.
+ */
+YuvToRgbCoefficients getYuvToRgbCoefficients(AVColorSpace colorspace, AVColorRange range, int depth, int height);
+
+
+/**
+ * Checks whether convertYuvToRgb(...) can read frames of a pixel format: native-endian planar or
+ * semi-planar Y'CbCr with 8 to 16 bits per sample.
+ */
+bool isYuvToRgbSupported(const AVPixFmtDescriptor *descriptor);
+
+
+/**
+ * Converts Y'CbCr planes to packed RGB48, RGBA64, or float RGB without going through 8 bits.
+ *
+ * Chroma samples are replicated horizontally and vertically. Rows are first unpacked into float
+ * scratch rows, then converted and packed with SSE2 where available. The scalar kernels handle the
+ * rest of each row and produce bit-identical results.
+ *
+ * The destination and its stride must be aligned to the destination's sample size (2 bytes for
+ * RGB48 and RGBA64, 4 bytes for RGBF32).
+ *
+ * @param planes Plane pointers positioned at the first sample to convert.
+ * @param linesizes Line sizes of the planes in bytes.
+ * @param descriptor Descriptor of the source pixel format (see isYuvToRgbSupported(...)).
+ * @param coefficients Conversion coefficients (see getYuvToRgbCoefficients(...)).
+ * @param width Width of the region to convert in pixels.
+ * @param height Height of the region to convert in rows.
+ * @param destination First destination pixel.
+ * @param destination_stride Distance between destination rows in bytes.
+ * @param format Destination format. Must be RGB48, RGBA64, or RGBF32.
+ */
+void convertYuvToRgb(const uint8_t *const planes[4], const int linesizes[4], const AVPixFmtDescriptor *descriptor,
+    const YuvToRgbCoefficients &coefficients, int width, int height, uint8_t *destination, int destination_stride,
+    FrameOutputFormat format);
+
+
+/**
+ * Scalar reference implementation of convertYuvToRgb(...), producing bit-identical results.
+ */
+void convertYuvToRgbScalar(const uint8_t *const planes[4], const int linesizes[4],
+    const AVPixFmtDescriptor *descriptor, const YuvToRgbCoefficients &coefficients, int width, int height,
+    uint8_t *destination, int destination_stride, FrameOutputFormat format);
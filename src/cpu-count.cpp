@@ -0,0 +1,126 @@
+#include "cpu-count.h"
+
+#include <algorithm>
+#include <fstream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+
+namespace {
+
+    /**
+     * Converts a CPU quota to a number of CPUs, rounding up. Returns nothing for unlimited quotas.
+     */
+    std::optional<int> getQuotaCpuCount(long long quota, long long period) {
+        if (quota <= 0 || period <= 0) {
+            return std::nullopt;
+        }
+        return static_cast<int>(std::max((quota + period - 1) / period, 1LL));
+    }
+
+    /**
+     * Reads a cgroup v2 `cpu.max` file ("max 100000" or "<quota> <period>").
+     */
+    std::optional<int> readCgroupV2Quota(const std::string &path) {
+        std::ifstream file(path);
+        std::string quota;
+        long long period = 0;
+        if (!(file >> quota >> period) || quota == "max") {
+            return std::nullopt;
+        }
+        try {
+            return getQuotaCpuCount(std::stoll(quota), period);
+        } catch (const std::exception &) {
+            return std::nullopt;
+        }
+    }
+
+    /**
+     * Reads the cgroup v1 `cpu.cfs_quota_us` and `cpu.cfs_period_us` files of a directory (a quota of
+     * -1 means unlimited).
+     */
+    std::optional<int> readCgroupV1Quota(const std::string &directory) {
+        std::ifstream quota_file(directory + "/cpu.cfs_quota_us");
+        std::ifstream period_file(directory + "/cpu.cfs_period_us");
+        long long quota = 0;
+        long long period = 0;
+        if (!(quota_file >> quota) || !(period_file >> period)) {
+            return std::nullopt;
+        }
+        return getQuotaCpuCount(quota, period);
+    }
+
+    /**
+     * Returns the smallest CPU quota of the cgroup the process belongs to and its ancestors.
+     */
+    std::optional<int> getCgroupCpuLimit() {
+        std::optional<int> limit;
+        auto applyLimit = [&limit](std::optional<int> quota) {
+            if (quota && (!limit || *quota < *limit)) {
+                limit = quota;
+            }
+        };
+
+        // Find the process's cgroup v2 path ("0::/path") and walk up to the root. Inside containers the
+        // path is usually "/", i.e. the container's own cgroup mounted at the root.
+        std::ifstream cgroups("/proc/self/cgroup");
+        std::string line;
+        while (std::getline(cgroups, line)) {
+            if (line.rfind("0::", 0) != 0) {
+                continue;
+            }
+            std::string path = line.substr(3);
+            while (true) {
+                applyLimit(readCgroupV2Quota("/sys/fs/cgroup" + (path == "/" ? "" : path) + "/cpu.max"));
+                if (path.empty() || path == "/") {
+                    break;
+                }
+                path = path.substr(0, path.find_last_of('/'));
+            }
+        }
+
+        // cgroup v1 hierarchies are mounted per controller.
+        applyLimit(readCgroupV1Quota("/sys/fs/cgroup/cpu"));
+        applyLimit(readCgroupV1Quota("/sys/fs/cgroup/cpu,cpuacct"));
+        return limit;
+    }
+
+    /**
+     * Counts the usable CPUs.
+     */
+    int countAvailableCpus() {
+        int count = static_cast<int>(std::thread::hardware_concurrency());
+
+#ifdef __linux__
+        cpu_set_t cpu_set;
+        CPU_ZERO(&cpu_set);
+        if (sched_getaffinity(0, sizeof(cpu_set), &cpu_set) == 0) {
+            count = CPU_COUNT(&cpu_set);
+        }
+
+        const std::optional<int> limit = getCgroupCpuLimit();
+        if (limit && (count <= 0 || *limit < count)) {
+            count = *limit;
+        }
+#endif
+
+        return std::max(count, 1);
+    }
+}
+
+
+/**
+ * Returns the number of CPUs the process can actually use, which is at least 1.
+ *
+ * @return Number of usable CPUs.
+ */
+int getAvailableCpuCount() {
+    static const int count = countAvailableCpus();
+    return count;
+}
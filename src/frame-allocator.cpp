@@ -0,0 +1,291 @@
+#include "frame-allocator.h"
+
+extern "C" {
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+}
+
+#include <cstdlib>
+#include <new>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+
+namespace {
+
+    // Every block starts with a header recording how it was allocated, padded to keep the data aligned.
+    struct BlockHeader {
+        size_t mapped_size;     // 0 if the block was allocated on the heap.
+    };
+    constexpr size_t HEADER_SIZE = FrameAllocator::ALIGNMENT;
+    static_assert(sizeof(BlockHeader) <= HEADER_SIZE);
+
+    constexpr size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+}
+
+
+/**
+ * Constructs an AlignedFrameAllocator.
+ *
+ * @param huge_pages Whether to back blocks with transparent huge pages (Linux only, ignored elsewhere).
+ * @param pinned Whether to lock blocks in physical memory so they can't be paged out (e.g. for DMA).
+ * Pinned blocks are rounded up to whole pages.
+ */
+AlignedFrameAllocator::AlignedFrameAllocator(bool huge_pages, bool pinned)
+    : m_huge_pages(huge_pages), m_pinned(pinned), m_allocation_count(0), m_live_count(0) {}
+
+
+/**
+ * Allocates a block of memory for one frame plane.
+ *
+ * @param size Size of the block in bytes.
+ * @return Pointer to a block aligned to at least FrameAllocator::ALIGNMENT bytes, or null on failure.
+ */
+uint8_t *AlignedFrameAllocator::allocate(size_t size) {
+    const size_t total_size = HEADER_SIZE + size;
+    uint8_t *block;
+    size_t mapped_size = 0;
+
+    // Pinned blocks get pages of their own: mlock() and munlock() act on whole pages and don't stack,
+    // so unpinning a heap block would also unpin its neighbours on the pages it shares with them.
+    if (m_huge_pages || m_pinned) {
+
+        // Map whole (huge) pages so the kernel can back the block with them.
+        const size_t page_size = m_huge_pages ? HUGE_PAGE_SIZE : static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        mapped_size = (total_size + page_size - 1) / page_size * page_size;
+        void *mapping = mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mapping == MAP_FAILED) {
+            return nullptr;
+        }
+#ifdef MADV_HUGEPAGE
+        if (m_huge_pages) {
+            madvise(mapping, mapped_size, MADV_HUGEPAGE);
+        }
+#endif
+        block = static_cast<uint8_t *>(mapping);
+    } else {
+        const size_t aligned_size = (total_size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+        block = static_cast<uint8_t *>(std::aligned_alloc(ALIGNMENT, aligned_size));
+        if (!block) {
+            return nullptr;
+        }
+    }
+
+    // Pinning is best effort; it commonly fails when RLIMIT_MEMLOCK is low.
+    if (m_pinned) {
+        mlock(block, mapped_size);
+    }
+
+    new (block) BlockHeader{mapped_size};
+    m_allocation_count.fetch_add(1, std::memory_order_relaxed);
+    m_live_count.fetch_add(1, std::memory_order_relaxed);
+    return block + HEADER_SIZE;
+}
+
+
+/**
+ * Releases a block returned by allocate(...).
+ *
+ * @param data Pointer returned by allocate(...).
+ */
+void AlignedFrameAllocator::deallocate(uint8_t *data) {
+    if (!data) {
+        return;
+    }
+
+    uint8_t *block = data - HEADER_SIZE;
+    const BlockHeader header = *reinterpret_cast<BlockHeader *>(block);
+
+    // Pinned blocks are always mapped, and unmapping implicitly unlocks them.
+    if (header.mapped_size) {
+        munmap(block, header.mapped_size);
+    } else {
+        std::free(block);
+    }
+    m_live_count.fetch_sub(1, std::memory_order_relaxed);
+}
+
+
+/**
+ * Returns the total number of blocks allocated so far.
+ */
+uint64_t AlignedFrameAllocator::getAllocationCount() const {
+    return m_allocation_count.load(std::memory_order_relaxed);
+}
+
+
+/**
+ * Returns the number of blocks currently allocated and not yet released.
+ */
+uint64_t AlignedFrameAllocator::getLiveCount() const {
+    return m_live_count.load(std::memory_order_relaxed);
+}
+
+
+/**
+ * Constructs a FrameBufferPool drawing memory from the specified allocator.
+ *
+ * @param allocator Allocator to draw memory from. It must outlive every frame decoded with this pool.
+ */
+FrameBufferPool::FrameBufferPool(FrameAllocator *allocator) : m_planes(allocator, allocateBuffer) {}
+
+
+/**
+ * Releases the buffer pools. Buffers still referenced by frames stay valid until they are released.
+ */
+FrameBufferPool::~FrameBufferPool() = default;
+
+
+/**
+ * Installs the pool as the `get_buffer2` callback of a codec context. Must be called before the
+ * codec context is opened.
+ *
+ * @param codec_context Codec context to install the pool in.
+ */
+void FrameBufferPool::install(AVCodecContext *codec_context) {
+    codec_context->opaque = this;
+    codec_context->get_buffer2 = getBuffer;
+}
+
+
+/**
+ * The `get_buffer2` callback. Falls back to FFmpeg's default allocator for hardware frames,
+ * paletted formats, and codecs that don't support custom buffers.
+ */
+int FrameBufferPool::getBuffer(AVCodecContext *codec_context, AVFrame *frame, int flags) {
+    const AVPixFmtDescriptor *descriptor = av_pix_fmt_desc_get(static_cast<AVPixelFormat>(frame->format));
+    if (!descriptor || (descriptor->flags & (AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_HWACCEL)) ||
+        !(codec_context->codec->capabilities & AV_CODEC_CAP_DR1)) {
+        return avcodec_default_get_buffer2(codec_context, frame, flags);
+    }
+
+    return static_cast<FrameBufferPool *>(codec_context->opaque)->fillFrame(codec_context, frame);
+}
+
+
+/**
+ * Allocates a pool buffer through the FrameAllocator passed as `opaque`.
+ */
+AVBufferRef *FrameBufferPool::allocateBuffer(void *opaque, size_t size) {
+    auto *allocator = static_cast<FrameAllocator *>(opaque);
+    uint8_t *data = allocator->allocate(size);
+    if (!data) {
+        return nullptr;
+    }
+
+    AVBufferRef *buffer = av_buffer_create(data, size, freeBuffer, allocator, 0);
+    if (!buffer) {
+        allocator->deallocate(data);
+    }
+    return buffer;
+}
+
+
+/**
+ * Returns a pool buffer's memory to the FrameAllocator passed as `opaque`.
+ */
+void FrameBufferPool::freeBuffer(void *opaque, uint8_t *data) {
+    static_cast<FrameAllocator *>(opaque)->deallocate(data);
+}
+
+
+/**
+ * Fills in the planes of a frame with buffers from the pools.
+ */
+int FrameBufferPool::fillFrame(AVCodecContext *codec_context, AVFrame *frame) {
+    const auto format = static_cast<AVPixelFormat>(frame->format);
+
+    // Let the codec pad the dimensions the way its DSP routines need them.
+    int width = frame->width;
+    int height = frame->height;
+    int linesize_align[AV_NUM_DATA_POINTERS];
+    avcodec_align_dimensions2(codec_context, &width, &height, linesize_align);
+
+    // Widen the planes until every line size is a multiple of the allocator's alignment.
+    int linesizes[4];
+    while (true) {
+        if (av_image_fill_linesizes(linesizes, format, width) < 0) {
+            return AVERROR(EINVAL);
+        }
+
+        bool aligned = true;
+        for (int linesize : linesizes) {
+            aligned = aligned && linesize % static_cast<int>(FrameAllocator::ALIGNMENT) == 0;
+        }
+        if (aligned) {
+            break;
+        }
+        width += width & ~(width - 1);
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_planes.fillFrame(frame, linesizes, height);
+}
+
+
+/**
+ * Constructs empty pools.
+ *
+ * @param opaque Value passed to `allocate`.
+ * @param allocate Allocates a buffer of a plane's pool, as for av_buffer_pool_init2(...).
+ */
+PlanePools::PlanePools(void *opaque, AVBufferRef *(*allocate)(void *opaque, size_t size))
+    : m_pools{nullptr, nullptr, nullptr, nullptr}, m_pool_sizes{0, 0, 0, 0}, m_opaque(opaque),
+    m_allocate(allocate) {}
+
+
+/**
+ * Releases the pools. Buffers still referenced by frames stay valid until they are released.
+ */
+PlanePools::~PlanePools() {
+    for (AVBufferPool *&pool : m_pools) {
+        av_buffer_pool_uninit(&pool);
+    }
+}
+
+
+/**
+ * Fills in the planes of a frame with pool buffers of the frame's pixel format.
+ *
+ * @param frame Frame without buffers whose `format` is set.
+ * @param linesizes Line size of each plane in bytes, each a multiple of FrameAllocator::ALIGNMENT.
+ * @param height Number of lines of the frame's first plane.
+ * @return 0 on success, or a negative AVERROR code. On failure the frame is left without buffers.
+ */
+int PlanePools::fillFrame(AVFrame *frame, const int linesizes[4], int height) {
+    ptrdiff_t plane_linesizes[4];
+    for (int i = 0; i < 4; i++) {
+        plane_linesizes[i] = linesizes[i];
+    }
+    size_t plane_sizes[4];
+    if (av_image_fill_plane_sizes(plane_sizes, static_cast<AVPixelFormat>(frame->format), height,
+        plane_linesizes) < 0) {
+        return AVERROR(EINVAL);
+    }
+
+    for (int i = 0; i < 4 && plane_sizes[i]; i++) {
+
+        // Leave the same slack past the end of each plane that FFmpeg's own pools leave for overreads.
+        const size_t pool_size = plane_sizes[i] + 16 + FrameAllocator::ALIGNMENT - 1;
+        if (!m_pools[i] || m_pool_sizes[i] != pool_size) {
+            av_buffer_pool_uninit(&m_pools[i]);
+            m_pools[i] = av_buffer_pool_init2(pool_size, m_opaque, m_allocate, nullptr);
+            m_pool_sizes[i] = m_pools[i] ? pool_size : 0;
+        }
+
+        frame->buf[i] = m_pools[i] ? av_buffer_pool_get(m_pools[i]) : nullptr;
+        if (!frame->buf[i]) {
+            for (int j = 0; j < i; j++) {
+                av_buffer_unref(&frame->buf[j]);
+                frame->data[j] = nullptr;
+            }
+            return AVERROR(ENOMEM);
+        }
+        frame->data[i] = frame->buf[i]->data;
+        frame->linesize[i] = linesizes[i];
+    }
+    frame->extended_data = frame->data;
+
+    return 0;
+}
@@ -0,0 +1,264 @@
+#include "frame-arena.h"
+
+extern "C" {
+#include <libavutil/imgutils.h>
+}
+
+#include <stdexcept>
+#include <utility>
+
+#include "video-decoder.h"
+
+
+/**
+ * Constructs an empty buffer handle.
+ */
+FrameArena::Buffer::Buffer() : m_arena(nullptr), m_data(nullptr), m_slot(0) {}
+
+
+/**
+ * Constructs a handle for a slot of an arena.
+ */
+FrameArena::Buffer::Buffer(FrameArena *arena, uint8_t *data, uint32_t slot)
+    : m_arena(arena), m_data(data), m_slot(slot) {}
+
+
+/**
+ * Takes over the buffer of another handle, leaving it empty.
+ */
+FrameArena::Buffer::Buffer(Buffer &&other) noexcept
+    : m_arena(std::exchange(other.m_arena, nullptr)), m_data(std::exchange(other.m_data, nullptr)),
+    m_slot(other.m_slot) {}
+
+
+/**
+ * Releases the current buffer and takes over the buffer of another handle, leaving it empty.
+ */
+FrameArena::Buffer &FrameArena::Buffer::operator=(Buffer &&other) noexcept {
+    if (this != &other) {
+        release();
+        m_arena = std::exchange(other.m_arena, nullptr);
+        m_data = std::exchange(other.m_data, nullptr);
+        m_slot = other.m_slot;
+    }
+    return *this;
+}
+
+
+/**
+ * Returns the buffer to its arena.
+ */
+FrameArena::Buffer::~Buffer() {
+    release();
+}
+
+
+/**
+ * Returns the usable size of the buffer in bytes.
+ */
+size_t FrameArena::Buffer::getSize() const {
+    return m_arena ? m_arena->getBufferSize() : 0;
+}
+
+
+/**
+ * Returns the buffer to its arena early. The handle is empty afterwards.
+ */
+void FrameArena::Buffer::release() {
+    if (m_arena) {
+        m_arena->push(m_slot);
+        m_arena->m_releases.fetch_add(1, std::memory_order_relaxed);
+        m_arena = nullptr;
+        m_data = nullptr;
+    }
+}
+
+
+/**
+ * Constructs an empty FrameArena. Slabs are only allocated once buffers are acquired.
+ *
+ * @param buffer_size Size of each buffer in bytes.
+ * @param buffers_per_slab Number of buffers carved out of each slab.
+ * @param huge_pages Whether to back slabs with transparent huge pages (Linux only, ignored elsewhere).
+ */
+FrameArena::FrameArena(size_t buffer_size, size_t buffers_per_slab, bool huge_pages)
+    : m_buffer_size(buffer_size),
+    m_buffer_stride((buffer_size + FrameAllocator::ALIGNMENT - 1) / FrameAllocator::ALIGNMENT * FrameAllocator::ALIGNMENT),
+    m_buffers_per_slab(buffers_per_slab > 0 ? buffers_per_slab : 1), m_allocator(huge_pages), m_slabs{},
+    m_slab_count(0), m_free_head(0), m_acquisitions(0), m_releases(0) {}
+
+
+/**
+ * Constructs an empty FrameArena with buffers large enough to hold one frame of a decoder's video
+ * stream in the specified pixel format.
+ *
+ * @param decoder Decoder whose frames the buffers are meant for.
+ * @param format Pixel format the frames are converted to.
+ * @param buffers_per_slab Number of buffers carved out of each slab.
+ * @param huge_pages Whether to back slabs with transparent huge pages (Linux only, ignored elsewhere).
+ */
+FrameArena::FrameArena(const VideoDecoder &decoder, AVPixelFormat format, size_t buffers_per_slab, bool huge_pages)
+    : FrameArena(getBufferSize(decoder, format), buffers_per_slab, huge_pages) {}
+
+
+/**
+ * Releases all slabs. Every buffer must have been returned by then.
+ */
+FrameArena::~FrameArena() {
+    const size_t slab_count = m_slab_count.load(std::memory_order_acquire);
+    for (size_t i = 0; i < slab_count; i++) {
+        m_allocator.deallocate(m_slabs[i].data);
+        delete[] m_slabs[i].next;
+    }
+}
+
+
+/**
+ * Hands out a buffer, allocating a new slab only if no released buffer is available.
+ *
+ * @return The acquired buffer.
+ *
+ * @throws std::runtime_error If a new slab is needed but cannot be allocated.
+ */
+FrameArena::Buffer FrameArena::acquire() {
+    uint32_t slot;
+    while (!pop(slot)) {
+        grow();
+    }
+
+    m_acquisitions.fetch_add(1, std::memory_order_relaxed);
+    return {this, getSlotData(slot), slot};
+}
+
+
+/**
+ * Returns the size of the arena's buffers in bytes.
+ */
+size_t FrameArena::getBufferSize() const {
+    return m_buffer_size;
+}
+
+
+/**
+ * Returns a snapshot of the arena's allocation counters.
+ */
+FrameArena::Stats FrameArena::getStats() const {
+    Stats stats{};
+    stats.slab_allocations = m_allocator.getAllocationCount();
+    stats.acquisitions = m_acquisitions.load(std::memory_order_relaxed);
+    stats.releases = m_releases.load(std::memory_order_relaxed);
+    stats.capacity = m_slab_count.load(std::memory_order_acquire) * m_buffers_per_slab;
+    stats.in_use = static_cast<size_t>(stats.acquisitions - stats.releases);
+    return stats;
+}
+
+
+/**
+ * Returns the number of bytes needed to hold one frame of a decoder's video stream in a pixel format.
+ *
+ * @param decoder Decoder whose frames the buffer is meant for.
+ * @param format Pixel format the frames are converted to.
+ * @return Buffer size in bytes.
+ *
+ * @throws std::runtime_error If the size cannot be computed for the pixel format.
+ */
+size_t FrameArena::getBufferSize(const VideoDecoder &decoder, AVPixelFormat format) {
+    const int size = av_image_get_buffer_size(format, decoder.getWidth(), decoder.getHeight(), 1);
+    if (size < 0) {
+        throw std::runtime_error("couldn't compute frame buffer size");
+    }
+    return static_cast<size_t>(size);
+}
+
+
+/**
+ * Returns the free-list link of a slot.
+ */
+std::atomic<uint32_t> &FrameArena::getNext(uint32_t slot) {
+    return m_slabs[slot / m_buffers_per_slab].next[slot % m_buffers_per_slab];
+}
+
+
+/**
+ * Returns the memory of a slot.
+ */
+uint8_t *FrameArena::getSlotData(uint32_t slot) const {
+    return m_slabs[slot / m_buffers_per_slab].data + (slot % m_buffers_per_slab) * m_buffer_stride;
+}
+
+
+/**
+ * Pops a slot off the free list.
+ *
+ * @param slot Receives the popped slot.
+ * @return `true` on success, `false` if the free list is empty.
+ */
+bool FrameArena::pop(uint32_t &slot) {
+    uint64_t head = m_free_head.load(std::memory_order_acquire);
+    while (true) {
+        const auto top = static_cast<uint32_t>(head);
+        if (top == 0) {
+            return false;
+        }
+
+        // The tag in the upper half changes on every update, which keeps a stale `next` from winning.
+        const uint32_t next = getNext(top - 1).load(std::memory_order_relaxed);
+        const uint64_t new_head = ((head >> 32) + 1) << 32 | next;
+        if (m_free_head.compare_exchange_weak(head, new_head, std::memory_order_acq_rel, std::memory_order_acquire)) {
+            slot = top - 1;
+            return true;
+        }
+    }
+}
+
+
+/**
+ * Pushes a slot onto the free list.
+ */
+void FrameArena::push(uint32_t slot) {
+    uint64_t head = m_free_head.load(std::memory_order_relaxed);
+    while (true) {
+        getNext(slot).store(static_cast<uint32_t>(head), std::memory_order_relaxed);
+        const uint64_t new_head = ((head >> 32) + 1) << 32 | (slot + 1);
+        if (m_free_head.compare_exchange_weak(head, new_head, std::memory_order_release, std::memory_order_relaxed)) {
+            return;
+        }
+    }
+}
+
+
+/**
+ * Allocates a new slab and pushes all of its slots onto the free list.
+ *
+ * @throws std::runtime_error If the arena is full or the slab cannot be allocated.
+ */
+void FrameArena::grow() {
+
+    // Growing is rare (only until the steady state is reached), so serialize it with a plain mutex.
+    std::lock_guard<std::mutex> lock(m_grow_mutex);
+
+    // Another thread may have grown the arena (or released buffers) while we were waiting.
+    if (static_cast<uint32_t>(m_free_head.load(std::memory_order_acquire)) != 0) {
+        return;
+    }
+
+    const size_t slab_index = m_slab_count.load(std::memory_order_relaxed);
+    if (slab_index == MAX_SLABS) {
+        throw std::runtime_error("frame arena is full");
+    }
+
+    Slab &slab = m_slabs[slab_index];
+    slab.next = new std::atomic<uint32_t>[m_buffers_per_slab];
+    slab.data = m_allocator.allocate(m_buffer_stride * m_buffers_per_slab);
+    if (!slab.data) {
+        delete[] slab.next;
+        slab.next = nullptr;
+        throw std::runtime_error("couldn't allocate frame arena slab");
+    }
+    m_slab_count.store(slab_index + 1, std::memory_order_release);
+
+    const auto first_slot = static_cast<uint32_t>(slab_index * m_buffers_per_slab);
+    for (size_t i = m_buffers_per_slab; i > 0; i--) {
+        push(first_slot + static_cast<uint32_t>(i - 1));
+    }
+}
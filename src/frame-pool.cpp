@@ -0,0 +1,119 @@
+#include "frame-pool.h"
+
+extern "C" {
+#include <libavutil/imgutils.h>
+}
+
+#include <stdexcept>
+#include <vector>
+
+
+/**
+ * Constructs an empty pool.
+ */
+FramePool::FramePool()
+    : m_planes(this, allocateBuffer), m_linesizes{0, 0, 0, 0}, m_format(AV_PIX_FMT_NONE), m_width(0),
+    m_height(0), m_allocation_count(0) {}
+
+
+/**
+ * Releases the buffer pools. Buffers still referenced by frames stay valid until they are released.
+ */
+FramePool::~FramePool() = default;
+
+
+/**
+ * Fills a blank frame with writable buffers of the given geometry.
+ *
+ * @param frame Frame without buffers (e.g. freshly allocated or unreferenced).
+ * @param format Pixel format of the frame.
+ * @param width Width of the frame in pixels.
+ * @param height Height of the frame in pixels.
+ */
+void FramePool::getFrame(AVFrame *frame, AVPixelFormat format, int width, int height) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (format != m_format || width != m_width || height != m_height) {
+        resize(format, width, height);
+    }
+
+    frame->format = format;
+    frame->width = width;
+    frame->height = height;
+    if (m_planes.fillFrame(frame, m_linesizes, height) < 0) {
+        throw std::runtime_error("couldn't allocate pooled frame buffer");
+    }
+}
+
+
+/**
+ * Grows the pool so that the given number of frames of a geometry can be in flight at once
+ * without allocating.
+ *
+ * @param count Number of frames.
+ * @param format Pixel format of the frames.
+ * @param width Width of the frames in pixels.
+ * @param height Height of the frames in pixels.
+ */
+void FramePool::reserve(int count, AVPixelFormat format, int width, int height) {
+
+    // Buffers taken out of the pools at the same time have to be distinct; releasing them puts
+    // them all back.
+    std::vector<AVFrame *> frames;
+    try {
+        for (int i = 0; i < count; i++) {
+            AVFrame *frame = av_frame_alloc();
+            if (!frame) {
+                throw std::runtime_error("couldn't allocate frame");
+            }
+            frames.push_back(frame);
+            getFrame(frame, format, width, height);
+        }
+    } catch (...) {
+        for (AVFrame *frame : frames) {
+            av_frame_free(&frame);
+        }
+        throw;
+    }
+    for (AVFrame *frame : frames) {
+        av_frame_free(&frame);
+    }
+}
+
+
+/**
+ * Returns the number of plane buffers allocated so far.
+ */
+uint64_t FramePool::getAllocationCount() const {
+    return m_allocation_count.load(std::memory_order_relaxed);
+}
+
+
+/**
+ * Allocates a pool buffer and counts it for the FramePool passed as `opaque`.
+ */
+AVBufferRef *FramePool::allocateBuffer(void *opaque, size_t size) {
+    AVBufferRef *buffer = av_buffer_alloc(size);
+    if (buffer) {
+        static_cast<FramePool *>(opaque)->m_allocation_count.fetch_add(1, std::memory_order_relaxed);
+    }
+    return buffer;
+}
+
+
+/**
+ * Computes the line sizes of a new geometry. The mutex must be held.
+ */
+void FramePool::resize(AVPixelFormat format, int width, int height) {
+    m_format = AV_PIX_FMT_NONE;
+
+    int linesizes[4];
+    if (width <= 0 || height <= 0 || av_image_fill_linesizes(linesizes, format, width) < 0) {
+        throw std::runtime_error("invalid pooled frame geometry");
+    }
+    for (int i = 0; i < 4; i++) {
+        m_linesizes[i] = FFALIGN(linesizes[i], static_cast<int>(FrameAllocator::ALIGNMENT));
+    }
+    m_format = format;
+    m_width = width;
+    m_height = height;
+}
@@ -0,0 +1,220 @@
+#include "ladder-encoder.h"
+
+#include <algorithm>
+#include <cmath>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+#include "cpu-count.h"
+#include "tracer.h"
+
+
+namespace {
+
+    struct FrameDeleter {
+        void operator()(AVFrame *frame) const { av_frame_free(&frame); }
+    };
+
+    using FramePointer = std::unique_ptr<AVFrame, FrameDeleter>;
+}
+
+
+struct LadderEncoder::Output {
+    Rendition rendition;
+    std::unique_ptr<VideoEncoder> encoder;
+    BoundedQueue<FramePointer> frames;
+    AVFrame *scaled_frame;
+    SwsContext *sws_context;
+
+    Output(const Rendition &rendition, size_t queue_capacity)
+        : rendition(rendition), frames(queue_capacity), scaled_frame(nullptr), sws_context(nullptr) {}
+
+    ~Output() {
+        sws_freeContext(sws_context);
+        av_frame_free(&scaled_frame);
+    }
+};
+
+
+/**
+ * Opens the input file and creates one encoder per rendition.
+ *
+ * @param input_path Path to the video file to encode.
+ * @param renditions Outputs to create. Their dimensions must be even.
+ * @param options Keyframe interval and queue capacity.
+ * @param decoder_options Options controlling how the input file is opened.
+ */
+LadderEncoder::LadderEncoder(const std::string &input_path, const std::vector<Rendition> &renditions,
+    const LadderOptions &options, const VideoDecoderOptions &decoder_options)
+    : m_decoder(input_path, decoder_options), m_options(options), m_keyframe_interval(1) {
+
+    if (renditions.empty()) {
+        throw std::runtime_error("no renditions to encode");
+    }
+
+    // Force keyframes at fixed frame numbers, and keep the encoders from adding any in between.
+    m_keyframe_interval = std::max(static_cast<int>(std::lround(options.keyframe_interval * m_decoder.getFPS())), 1);
+    VideoEncoderOptions encoder_options;
+    encoder_options.gop_size = m_keyframe_interval;
+    encoder_options.scene_cut_keyframes = false;
+
+    // The renditions encode side by side, so they share the CPUs rather than each taking all of them.
+    encoder_options.thread_count = std::max(getAvailableCpuCount() / static_cast<int>(renditions.size()), 1);
+
+    for (const Rendition &rendition : renditions) {
+
+        // YUV 4:2:0 needs even dimensions.
+        if (rendition.width <= 0 || rendition.height <= 0 || rendition.width % 2 || rendition.height % 2) {
+            throw std::runtime_error("invalid rendition dimensions");
+        }
+
+        auto output = std::make_unique<Output>(rendition, options.queue_capacity);
+        output->encoder = std::make_unique<VideoEncoder>(rendition.output_path, rendition.width, rendition.height,
+            m_decoder.getFPS(), rendition.bitrate, encoder_options);
+        output->scaled_frame = av_frame_alloc();
+        if (!output->scaled_frame) {
+            throw std::runtime_error("couldn't allocate scaled frame");
+        }
+        m_outputs.push_back(std::move(output));
+    }
+}
+
+
+/**
+ * Frees all resources. Output files are finalized by their encoders if run() didn't do it.
+ */
+LadderEncoder::~LadderEncoder() = default;
+
+
+/**
+ * Decodes the input on the calling thread, encodes every rendition on its own thread, and
+ * finalizes all output files. Can be called once.
+ *
+ * @return Number of frames, keyframe interval, and queue occupancy.
+ */
+LadderStats LadderEncoder::run() {
+    LadderStats stats;
+    stats.keyframe_interval = m_keyframe_interval;
+
+    // The first error stops all renditions.
+    std::mutex error_mutex;
+    std::exception_ptr error;
+    auto fail = [&](std::exception_ptr exception) {
+        {
+            std::lock_guard lock(error_mutex);
+            if (!error) {
+                error = exception;
+            }
+        }
+        closeQueues();
+    };
+
+    std::vector<std::thread> threads;
+    try {
+        for (const std::unique_ptr<Output> &output : m_outputs) {
+            threads.emplace_back([this, &output, &fail] {
+                if (Tracer::isEnabled()) {
+                    Tracer::getInstance().setThreadName("ladder-" + std::to_string(output->rendition.width) + "x" +
+                        std::to_string(output->rendition.height));
+                }
+                try {
+                    encodeRendition(*output);
+                } catch (...) {
+                    fail(std::current_exception());
+                }
+            });
+        }
+
+        // Hand each decoded frame to every rendition. References share the planes, so nothing is copied.
+        FramePointer frame(av_frame_alloc());
+        if (!frame) {
+            throw std::runtime_error("couldn't allocate frame");
+        }
+        bool stopped = false;
+        while (!stopped && m_decoder.getNextFrame(frame.get())) {
+            const bool keyframe = stats.frames % m_keyframe_interval == 0;
+            for (const std::unique_ptr<Output> &output : m_outputs) {
+                FramePointer reference(av_frame_alloc());
+                if (!reference || av_frame_ref(reference.get(), frame.get()) < 0) {
+                    throw std::runtime_error("couldn't reference decoded frame");
+                }
+                reference->pict_type = keyframe ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_NONE;
+                if (!output->frames.push(std::move(reference))) {
+                    stopped = true;
+                    break;
+                }
+            }
+            stats.frames++;
+        }
+        closeQueues();
+    } catch (...) {
+        fail(std::current_exception());
+    }
+
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+
+    for (const std::unique_ptr<Output> &output : m_outputs) {
+        stats.queues.push_back(output->frames.getStats());
+    }
+    return stats;
+}
+
+
+/**
+ * Scales and encodes the queued frames of one rendition, then finalizes its file (rendition
+ * thread).
+ */
+void LadderEncoder::encodeRendition(Output &output) {
+    VideoEncoder &encoder = *output.encoder;
+    const AVCodecContext *encoder_context = encoder.m_codec_context;
+
+    FramePointer frame;
+    while (output.frames.pop(frame)) {
+        AVFrame *encoder_frame = frame.get();
+
+        if (frame->width != encoder_context->width || frame->height != encoder_context->height ||
+            frame->format != encoder_context->pix_fmt) {
+            output.sws_context = sws_getCachedContext(output.sws_context,
+                frame->width, frame->height, static_cast<AVPixelFormat>(frame->format),
+                encoder_context->width, encoder_context->height, encoder_context->pix_fmt,
+                SWS_BICUBIC, nullptr, nullptr, nullptr);
+            if (!output.sws_context) {
+                throw std::runtime_error("couldn't create scaling context");
+            }
+
+            // The encoder may still hold a reference to the previous frame's buffer, so scale into a
+            // fresh one from its pool rather than copying the old one to make it writable.
+            AVFrame *scaled_frame = output.scaled_frame;
+            av_frame_unref(scaled_frame);
+            encoder.getFrameBuffer(scaled_frame);
+            av_frame_copy_props(scaled_frame, frame.get());
+            scaled_frame->pict_type = frame->pict_type;
+
+            ScopedStageTimer timer(encoder.m_convert_counter, encoder.m_stats_enabled.load(std::memory_order_relaxed));
+            sws_scale(output.sws_context, frame->data, frame->linesize, 0, frame->height,
+                scaled_frame->data, scaled_frame->linesize);
+            encoder_frame = scaled_frame;
+        }
+
+        encoder.encodeFrame(encoder_frame);
+        frame.reset();
+    }
+
+    encoder.finalize();
+}
+
+
+/**
+ * Closes all queues, so that all threads wind down after an error.
+ */
+void LadderEncoder::closeQueues() {
+    for (const std::unique_ptr<Output> &output : m_outputs) {
+        output->frames.close();
+    }
+}
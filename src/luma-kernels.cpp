@@ -0,0 +1,127 @@
+#include "luma-kernels.h"
+
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define LUMA_KERNELS_SSE2 1
+#endif
+
+
+namespace {
+
+    /**
+     * Averages factor x factor blocks of one output row, starting at output column `x`.
+     */
+    void downscaleRowScalar(const uint8_t *source, int source_stride, uint8_t *destination, int x, int width,
+        int factor) {
+        const int block_size = factor * factor;
+        for (; x < width; x++) {
+            const uint8_t *block = source + x * factor;
+            int sum = 0;
+            for (int row = 0; row < factor; row++) {
+                for (int column = 0; column < factor; column++) {
+                    sum += block[row * source_stride + column];
+                }
+            }
+            destination[x] = static_cast<uint8_t>((sum + block_size / 2) / block_size);
+        }
+    }
+
+#ifdef LUMA_KERNELS_SSE2
+
+    /**
+     * Averages factor x factor blocks of one output row 16 input columns at a time. Returns the first
+     * output column left for the scalar kernel.
+     */
+    template<int FACTOR>
+    int downscaleRowSSE2(const uint8_t *source, int source_stride, uint8_t *destination, int width) {
+        constexpr int OUTPUTS = 16 / FACTOR;
+        const __m128i low_bytes = _mm_set1_epi16(0x00ff);
+        const __m128i ones = _mm_set1_epi16(1);
+
+        int x = 0;
+        for (; x + OUTPUTS <= width; x += OUTPUTS) {
+
+            // Sum horizontally adjacent pairs over all rows of the block (at most 8 * 2 * 255, fits 16 bits).
+            __m128i pairs = _mm_setzero_si128();
+            for (int row = 0; row < FACTOR; row++) {
+                const __m128i pixels = _mm_loadu_si128(
+                    reinterpret_cast<const __m128i *>(source + row * source_stride + x * FACTOR));
+                pairs = _mm_add_epi16(pairs, _mm_add_epi16(_mm_and_si128(pixels, low_bytes), _mm_srli_epi16(pixels, 8)));
+            }
+
+            if constexpr (FACTOR == 2) {
+                const __m128i averages = _mm_srli_epi16(_mm_add_epi16(pairs, _mm_set1_epi16(2)), 2);
+                _mm_storel_epi64(reinterpret_cast<__m128i *>(destination + x), _mm_packus_epi16(averages, averages));
+            } else if constexpr (FACTOR == 4) {
+                const __m128i sums = _mm_madd_epi16(pairs, ones);
+                const __m128i averages = _mm_srli_epi32(_mm_add_epi32(sums, _mm_set1_epi32(8)), 4);
+                const __m128i packed = _mm_packs_epi32(averages, averages);
+                const int bytes = _mm_cvtsi128_si32(_mm_packus_epi16(packed, packed));
+                std::memcpy(destination + x, &bytes, 4);
+            } else {
+                const __m128i quads = _mm_madd_epi16(pairs, ones);
+                const __m128i sums = _mm_add_epi32(quads, _mm_srli_si128(quads, 4));
+                const __m128i averages = _mm_srli_epi32(_mm_add_epi32(sums, _mm_set1_epi32(32)), 6);
+                destination[x] = static_cast<uint8_t>(_mm_cvtsi128_si32(averages));
+                destination[x + 1] = static_cast<uint8_t>(_mm_cvtsi128_si32(_mm_srli_si128(averages, 8)));
+            }
+        }
+        return x;
+    }
+
+#endif
+}
+
+
+/**
+ * Copies or box-downscales an 8-bit luma plane.
+ *
+ * Each output sample is the rounded average of a factor x factor block of input samples. Factors 2, 4,
+ * and 8 use SIMD where available; other factors (and the right-hand edge) go through the scalar kernel.
+ */
+void downscaleLumaPlane(const uint8_t *source, int source_stride, uint8_t *destination, int destination_stride,
+    int width, int height, int factor) {
+
+    if (factor == 1) {
+        for (int y = 0; y < height; y++) {
+            std::memcpy(destination + y * destination_stride, source + y * source_stride, width);
+        }
+        return;
+    }
+
+#ifdef LUMA_KERNELS_SSE2
+    if (factor == 2 || factor == 4 || factor == 8) {
+        for (int y = 0; y < height; y++) {
+            const uint8_t *source_row = source + y * factor * source_stride;
+            uint8_t *destination_row = destination + y * destination_stride;
+
+            int x;
+            if (factor == 2) {
+                x = downscaleRowSSE2<2>(source_row, source_stride, destination_row, width);
+            } else if (factor == 4) {
+                x = downscaleRowSSE2<4>(source_row, source_stride, destination_row, width);
+            } else {
+                x = downscaleRowSSE2<8>(source_row, source_stride, destination_row, width);
+            }
+            downscaleRowScalar(source_row, source_stride, destination_row, x, width, factor);
+        }
+        return;
+    }
+#endif
+
+    downscaleLumaPlaneScalar(source, source_stride, destination, destination_stride, width, height, factor);
+}
+
+
+/**
+ * Scalar reference implementation of downscaleLumaPlane(...), producing bit-identical results.
+ */
+void downscaleLumaPlaneScalar(const uint8_t *source, int source_stride, uint8_t *destination, int destination_stride,
+    int width, int height, int factor) {
+    for (int y = 0; y < height; y++) {
+        downscaleRowScalar(source + y * factor * source_stride, source_stride, destination + y * destination_stride,
+            0, width, factor);
+    }
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdint>
+
+
+/**
+ * Copies or box-downscales an 8-bit luma plane.
+ *
+ * Each output sample is the rounded average of a factor x factor block of input samples. Factors 2, 4,
+ * and 8 use SIMD where available; other factors (and the right-hand edge) go through the scalar kernel.
+ *
+ * @param source First input sample of the region to downscale.
+ * @param source_stride Distance between input rows in bytes.
+ * @param destination First output sample.
+ * @param destination_stride Distance between output rows in bytes.
+ * @param width Width of the output in samples.
+ * @param height Height of the output in rows.
+ * @param factor Downscale factor (1 copies the plane).
+ */
+void downscaleLumaPlane(const uint8_t *source, int source_stride, uint8_t *destination, int destination_stride,
+    int width, int height, int factor);
+
+
+/**
+ * Scalar reference implementation of downscaleLumaPlane(...), producing bit-identical results.
+ */
+void downscaleLumaPlaneScalar(const uint8_t *source, int source_stride, uint8_t *destination, int destination_stride,
+    int width, int height, int factor);
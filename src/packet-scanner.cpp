@@ -0,0 +1,129 @@
+#include "packet-scanner.h"
+
+
+namespace {
+
+    /**
+     * Returns the index of the video stream declared in a format context, or -1 if there is none.
+     * Attached pictures (cover art) are skipped, as they aren't part of the video.
+     */
+    int findVideoStream(const AVFormatContext *format_context) {
+        int video_stream_index = -1;
+        for (unsigned int i = 0; i < format_context->nb_streams; i++) {
+            const AVStream *stream = format_context->streams[i];
+            if (stream->codecpar->codec_type == AVMEDIA_TYPE_VIDEO &&
+                !(stream->disposition & AV_DISPOSITION_ATTACHED_PIC)) {
+                video_stream_index = static_cast<int>(i);
+            }
+        }
+        return video_stream_index;
+    }
+}
+
+
+/**
+ * Opens a video file for scanning.
+ *
+ * Streams are identified from the container header. Only files whose header doesn't declare a
+ * video stream (e.g. raw elementary streams) are probed with `avformat_find_stream_info`, which
+ * decodes a few frames; a probe cache entry avoids even that.
+ *
+ * @param path Path to the video file.
+ * @param probe_cache Cache of stream probing results (can be null). It is only read, never written.
+ */
+PacketScanner::PacketScanner(const std::string &path, const ProbeCache *probe_cache)
+    : m_format_context(nullptr), m_packet(nullptr), m_video_stream_index(-1) {
+
+    const std::shared_ptr<const VideoStreamInfo> stream_info = probe_cache ? probe_cache->load(path) : nullptr;
+
+    if (avformat_open_input(&m_format_context, path.c_str(), nullptr, nullptr) != 0) {
+        throw std::runtime_error("couldn't open file");
+    }
+
+    // Prefer cached stream information, then the header, and probe only as a last resort.
+    if (stream_info && stream_info->apply(m_format_context)) {
+        m_video_stream_index = stream_info->stream_index;
+    } else {
+        m_video_stream_index = findVideoStream(m_format_context);
+        if (m_video_stream_index == -1 && avformat_find_stream_info(m_format_context, nullptr) >= 0) {
+            m_video_stream_index = findVideoStream(m_format_context);
+        }
+    }
+    if (m_video_stream_index == -1) {
+        avformat_close_input(&m_format_context);
+        throw std::runtime_error("couldn't find a video stream");
+    }
+
+    // Let the demuxer skip the packets of all other streams where it can.
+    for (unsigned int i = 0; i < m_format_context->nb_streams; i++) {
+        if (static_cast<int>(i) != m_video_stream_index) {
+            m_format_context->streams[i]->discard = AVDISCARD_ALL;
+        }
+    }
+
+    m_packet = av_packet_alloc();
+    if (!m_packet) {
+        avformat_close_input(&m_format_context);
+        throw std::runtime_error("couldn't allocate packet");
+    }
+}
+
+
+/**
+ * Closes the video file.
+ */
+PacketScanner::~PacketScanner() {
+    av_packet_free(&m_packet);
+    avformat_close_input(&m_format_context);
+}
+
+
+/**
+ * Reads the next packet of the video stream.
+ *
+ * @param info Receives the metadata of the packet.
+ * @return `true` if a packet has been read, `false` on end of file or error.
+ */
+bool PacketScanner::getNextPacket(PacketInfo &info) {
+    while (av_read_frame(m_format_context, m_packet) >= 0) {
+        if (m_packet->stream_index != m_video_stream_index) {
+            av_packet_unref(m_packet);
+            continue;
+        }
+
+        const AVRational time_base = m_format_context->streams[m_video_stream_index]->time_base;
+        info.pts = m_packet->pts == AV_NOPTS_VALUE ? AV_NOPTS_VALUE :
+            av_rescale_q(m_packet->pts, time_base, AV_TIME_BASE_Q);
+        info.dts = m_packet->dts == AV_NOPTS_VALUE ? AV_NOPTS_VALUE :
+            av_rescale_q(m_packet->dts, time_base, AV_TIME_BASE_Q);
+        info.duration = av_rescale_q(m_packet->duration, time_base, AV_TIME_BASE_Q);
+        info.size = m_packet->size;
+        info.position = m_packet->pos;
+        info.keyframe = m_packet->flags & AV_PKT_FLAG_KEY;
+
+        av_packet_unref(m_packet);
+        return true;
+    }
+    return false;
+}
+
+
+/**
+ * Returns the time base of the video stream, i.e. the unit of its timestamps in the container.
+ * Packet timestamps are converted from it to microseconds.
+ *
+ * @return The time base of the video stream.
+ */
+[[nodiscard]] AVRational PacketScanner::getTimeBase() const {
+    return m_format_context->streams[m_video_stream_index]->time_base;
+}
+
+
+/**
+ * Returns the video stream's index in the file.
+ *
+ * @return The index of the video stream.
+ */
+[[nodiscard]] int PacketScanner::getStreamIndex() const {
+    return m_video_stream_index;
+}
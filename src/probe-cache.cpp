@@ -0,0 +1,320 @@
+#include "probe-cache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+
+#include <unistd.h>
+
+
+namespace {
+
+    // Identifies cache entries and their layout. Bump the version whenever the layout changes.
+    constexpr char ENTRY_MAGIC[4] = {'V', 'P', 'R', 'B'};
+    constexpr uint32_t ENTRY_VERSION = 1;
+
+    /**
+     * Appends trivially copyable values to a byte buffer in host byte order. Cache entries are never
+     * shared between hosts, so there is no need for a portable encoding.
+     */
+    class EntryWriter {
+        std::string m_buffer;
+
+    public:
+        template<typename T>
+        void write(const T &value) {
+            static_assert(std::is_trivially_copyable_v<T>);
+            m_buffer.append(reinterpret_cast<const char *>(&value), sizeof(value));
+        }
+
+        void writeBytes(const void *data, size_t size) {
+            write(static_cast<uint64_t>(size));
+            m_buffer.append(static_cast<const char *>(data), size);
+        }
+
+        [[nodiscard]] const std::string &getBuffer() const { return m_buffer; }
+    };
+
+    /**
+     * Reads back values written by EntryWriter, failing (instead of reading out of bounds) on
+     * truncated or corrupted entries.
+     */
+    class EntryReader {
+        const std::string &m_buffer;
+        size_t m_offset;
+
+    public:
+        explicit EntryReader(const std::string &buffer) : m_buffer(buffer), m_offset(0) {}
+
+        template<typename T>
+        bool read(T &value) {
+            static_assert(std::is_trivially_copyable_v<T>);
+            if (m_buffer.size() - m_offset < sizeof(value)) {
+                return false;
+            }
+            std::memcpy(&value, m_buffer.data() + m_offset, sizeof(value));
+            m_offset += sizeof(value);
+            return true;
+        }
+
+        bool readBytes(std::string &bytes) {
+            uint64_t size;
+            if (!read(size) || m_buffer.size() - m_offset < size) {
+                return false;
+            }
+            bytes.assign(m_buffer, m_offset, size);
+            m_offset += size;
+            return true;
+        }
+    };
+}
+
+
+/**
+ * Constructs a ProbeCache that stores its entries in the specified directory. The directory is
+ * created if it doesn't exist yet.
+ *
+ * @param directory Directory to store cache entries in.
+ *
+ * @throws std::runtime_error If the directory cannot be created.
+ */
+ProbeCache::ProbeCache(const std::string &directory) : m_directory(directory) {
+    std::error_code error;
+    std::filesystem::create_directories(m_directory, error);
+    if (error || !std::filesystem::is_directory(m_directory, error)) {
+        throw std::runtime_error("couldn't create probe cache directory");
+    }
+}
+
+
+/**
+ * Looks up the stream information of a video file.
+ *
+ * @param path Path to the video file.
+ * @return The cached stream information, or null if the file isn't cached, has changed since it
+ * was cached, or its cache entry is unreadable.
+ */
+std::shared_ptr<const VideoStreamInfo> ProbeCache::load(const std::string &path) const {
+    std::string key;
+    if (!makeKey(path, key)) {
+        return nullptr;
+    }
+
+    std::ifstream file(getEntryPath(key), std::ios::binary);
+    if (!file) {
+        return nullptr;
+    }
+    const std::string buffer((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    EntryReader reader(buffer);
+
+    // Reject entries of other layouts and entries whose key merely collides with ours.
+    char magic[sizeof(ENTRY_MAGIC)];
+    uint32_t version;
+    std::string stored_key;
+    if (!reader.read(magic) || std::memcmp(magic, ENTRY_MAGIC, sizeof(magic)) != 0 ||
+        !reader.read(version) || version != ENTRY_VERSION ||
+        !reader.readBytes(stored_key) || stored_key != key) {
+        return nullptr;
+    }
+
+    auto info = std::make_shared<VideoStreamInfo>();
+    AVCodecParameters *parameters = info->codec_parameters;
+    std::string extradata;
+    uint64_t index_size;
+
+    bool ok = reader.read(info->stream_index) &&
+        reader.read(info->time_base) &&
+        reader.read(info->avg_frame_rate) &&
+        reader.read(info->r_frame_rate) &&
+        reader.read(info->start_time) &&
+        reader.read(info->duration) &&
+        reader.read(info->format_start_time) &&
+        reader.read(info->format_duration) &&
+        reader.read(info->format_bit_rate) &&
+        reader.read(parameters->codec_type) &&
+        reader.read(parameters->codec_id) &&
+        reader.read(parameters->codec_tag) &&
+        reader.read(parameters->format) &&
+        reader.read(parameters->bit_rate) &&
+        reader.read(parameters->bits_per_coded_sample) &&
+        reader.read(parameters->bits_per_raw_sample) &&
+        reader.read(parameters->profile) &&
+        reader.read(parameters->level) &&
+        reader.read(parameters->width) &&
+        reader.read(parameters->height) &&
+        reader.read(parameters->sample_aspect_ratio) &&
+        reader.read(parameters->framerate) &&
+        reader.read(parameters->field_order) &&
+        reader.read(parameters->color_range) &&
+        reader.read(parameters->color_primaries) &&
+        reader.read(parameters->color_trc) &&
+        reader.read(parameters->color_space) &&
+        reader.read(parameters->chroma_location) &&
+        reader.read(parameters->video_delay) &&
+        reader.readBytes(extradata) &&
+        reader.read(index_size);
+    if (!ok) {
+        return nullptr;
+    }
+
+    if (!extradata.empty()) {
+
+        // FFmpeg requires extradata to be zero-padded.
+        parameters->extradata = static_cast<uint8_t *>(av_mallocz(extradata.size() + AV_INPUT_BUFFER_PADDING_SIZE));
+        if (!parameters->extradata) {
+            return nullptr;
+        }
+        std::memcpy(parameters->extradata, extradata.data(), extradata.size());
+        parameters->extradata_size = static_cast<int>(extradata.size());
+    }
+
+    if (index_size > buffer.size() / sizeof(VideoStreamInfo::IndexEntry)) {
+        return nullptr;
+    }
+    info->index.resize(index_size);
+    for (VideoStreamInfo::IndexEntry &entry : info->index) {
+        if (!reader.read(entry)) {
+            return nullptr;
+        }
+    }
+
+    return info;
+}
+
+
+/**
+ * Stores the stream information of a video file, replacing any previous entry for it.
+ *
+ * @param path Path to the video file.
+ * @param info Stream information probed from the file.
+ * @return `true` if the entry has been written, `false` if the file can't be cached (e.g. it is
+ * not a regular local file) or the entry couldn't be written.
+ */
+bool ProbeCache::store(const std::string &path, const VideoStreamInfo &info) const {
+    std::string key;
+    if (!makeKey(path, key)) {
+        return false;
+    }
+
+    const AVCodecParameters *parameters = info.codec_parameters;
+    EntryWriter writer;
+    writer.write(ENTRY_MAGIC);
+    writer.write(ENTRY_VERSION);
+    writer.writeBytes(key.data(), key.size());
+    writer.write(info.stream_index);
+    writer.write(info.time_base);
+    writer.write(info.avg_frame_rate);
+    writer.write(info.r_frame_rate);
+    writer.write(info.start_time);
+    writer.write(info.duration);
+    writer.write(info.format_start_time);
+    writer.write(info.format_duration);
+    writer.write(info.format_bit_rate);
+    writer.write(parameters->codec_type);
+    writer.write(parameters->codec_id);
+    writer.write(parameters->codec_tag);
+    writer.write(parameters->format);
+    writer.write(parameters->bit_rate);
+    writer.write(parameters->bits_per_coded_sample);
+    writer.write(parameters->bits_per_raw_sample);
+    writer.write(parameters->profile);
+    writer.write(parameters->level);
+    writer.write(parameters->width);
+    writer.write(parameters->height);
+    writer.write(parameters->sample_aspect_ratio);
+    writer.write(parameters->framerate);
+    writer.write(parameters->field_order);
+    writer.write(parameters->color_range);
+    writer.write(parameters->color_primaries);
+    writer.write(parameters->color_trc);
+    writer.write(parameters->color_space);
+    writer.write(parameters->chroma_location);
+    writer.write(parameters->video_delay);
+    writer.writeBytes(parameters->extradata, parameters->extradata_size > 0 ? parameters->extradata_size : 0);
+    writer.write(static_cast<uint64_t>(info.index.size()));
+    for (const VideoStreamInfo::IndexEntry &entry : info.index) {
+        writer.write(entry);
+    }
+
+    // Write to a temporary file first and rename it into place, so that concurrent readers
+    // never observe a partially written entry. The name is unique to this process and thread, so
+    // concurrent writers of the same entry don't write into each other's file.
+    const std::string entry_path = getEntryPath(key);
+    std::ostringstream temporary_path;
+    temporary_path << entry_path << '.' << getpid() << '.' << std::hash<std::thread::id>{}(std::this_thread::get_id())
+        << ".tmp";
+
+    {
+        std::ofstream file(temporary_path.str(), std::ios::binary | std::ios::trunc);
+        const std::string &buffer = writer.getBuffer();
+        if (!file.write(buffer.data(), static_cast<std::streamsize>(buffer.size()))) {
+            std::error_code error;
+            std::filesystem::remove(temporary_path.str(), error);
+            return false;
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::rename(temporary_path.str(), entry_path, error);
+    if (error) {
+        std::filesystem::remove(temporary_path.str(), error);
+        return false;
+    }
+    return true;
+}
+
+
+/**
+ * Builds the cache key of a video file out of its absolute path, size, and modification time.
+ *
+ * @param path Path to the video file.
+ * @param key Receives the cache key.
+ * @return `true` on success, `false` if the file is not a regular local file.
+ */
+bool ProbeCache::makeKey(const std::string &path, std::string &key) {
+    std::error_code error;
+    const std::filesystem::path absolute_path = std::filesystem::absolute(path, error);
+    if (error || !std::filesystem::is_regular_file(absolute_path, error)) {
+        return false;
+    }
+
+    const uintmax_t size = std::filesystem::file_size(absolute_path, error);
+    if (error) {
+        return false;
+    }
+
+    const auto modification_time = std::filesystem::last_write_time(absolute_path, error);
+    if (error) {
+        return false;
+    }
+
+    std::ostringstream stream;
+    stream << absolute_path.string() << '\n' << size << '\n' << modification_time.time_since_epoch().count();
+    key = stream.str();
+    return true;
+}
+
+
+/**
+ * Returns the path of the cache entry for a cache key.
+ */
+std::string ProbeCache::getEntryPath(const std::string &key) const {
+
+    // 64-bit FNV-1a hash of the key. Collisions are detected by storing the key inside the entry.
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (unsigned char c : key) {
+        hash ^= c;
+        hash *= 0x100000001b3ULL;
+    }
+
+    char file_name[32];
+    std::snprintf(file_name, sizeof(file_name), "%016llx.probe", static_cast<unsigned long long>(hash));
+    return (std::filesystem::path(m_directory) / file_name).string();
+}
@@ -0,0 +1,233 @@
+#include "remuxer.h"
+
+
+/**
+ * Opens the input file and creates the output file, with one output stream per input stream the
+ * output container supports. The output format is guessed from the output path.
+ *
+ * @param input_path Path to the media file to copy.
+ * @param output_path Path to the file to write.
+ * @param options Part of the input to copy and timestamp handling.
+ */
+Remuxer::Remuxer(const std::string &input_path, const std::string &output_path, const RemuxOptions &options)
+    : m_input_context(nullptr), m_output_context(nullptr), m_video_stream_index(-1), m_options(options) {
+
+    try {
+
+        // Open and probe the input. Every stream needs complete codec parameters to be muxed.
+        if (avformat_open_input(&m_input_context, input_path.c_str(), nullptr, nullptr) != 0) {
+            throw std::runtime_error("couldn't open input file");
+        }
+        if (avformat_find_stream_info(m_input_context, nullptr) < 0) {
+            throw std::runtime_error("couldn't retrieve stream information");
+        }
+        m_video_stream_index = av_find_best_stream(m_input_context, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+
+        // Create the output.
+        avformat_alloc_output_context2(&m_output_context, nullptr, nullptr, output_path.c_str());
+        if (!m_output_context) {
+            throw std::runtime_error("couldn't allocate output format context");
+        }
+        createOutputStreams();
+
+        if (!(m_output_context->oformat->flags & AVFMT_NOFILE)) {
+            if (avio_open(&m_output_context->pb, output_path.c_str(), AVIO_FLAG_WRITE) < 0) {
+                throw std::runtime_error("couldn't open output file");
+            }
+        }
+        if (avformat_write_header(m_output_context, nullptr) < 0) {
+            throw std::runtime_error("couldn't write output header");
+        }
+    } catch (const std::runtime_error &) {
+        close();
+        throw;
+    }
+}
+
+
+/**
+ * Closes both files. An output that hasn't been completed by run() is left incomplete.
+ */
+Remuxer::~Remuxer() {
+    close();
+}
+
+
+/**
+ * Copies the selected part of the input into the output and completes the output file.
+ *
+ * @return Number of packets and bytes written, and the actual start of the copied part.
+ */
+RemuxStats Remuxer::run() {
+    RemuxStats stats;
+
+    // Jump to the last keyframe at or before the start, so we don't read what we'd drop anyway.
+    if (m_options.start_time > 0) {
+        const int seek_stream = m_video_stream_index >= 0 ? m_video_stream_index : -1;
+        const int64_t timestamp = seek_stream >= 0 ?
+            av_rescale_q(m_options.start_time, AV_TIME_BASE_Q, m_input_context->streams[seek_stream]->time_base) :
+            m_options.start_time;
+        // Reading from the head instead would start the copy at the first keyframe, far from the start.
+        if (av_seek_frame(m_input_context, seek_stream, timestamp, AVSEEK_FLAG_BACKWARD) < 0) {
+            throw std::runtime_error("couldn't seek to the start of the copied part");
+        }
+    }
+
+    AVPacket *packet = av_packet_alloc();
+    if (!packet) {
+        throw std::runtime_error("couldn't allocate packet");
+    }
+
+    // Without video, any packet can start the copy, so the cut is exact.
+    bool started = m_video_stream_index < 0;
+    int64_t offset = m_video_stream_index < 0 ? m_options.start_time : 0;
+    std::vector<bool> finished(m_stream_mapping.size(), false);
+    size_t finished_count = 0;
+    size_t mapped_count = 0;
+    for (int mapped_index : m_stream_mapping) {
+        mapped_count += mapped_index >= 0;
+    }
+
+    try {
+        while (finished_count < mapped_count && av_read_frame(m_input_context, packet) >= 0) {
+            const int input_index = packet->stream_index;
+            const int output_index = m_stream_mapping[input_index];
+            if (output_index < 0 || finished[input_index]) {
+                av_packet_unref(packet);
+                continue;
+            }
+
+            const AVRational input_time_base = m_input_context->streams[input_index]->time_base;
+            const int64_t timestamp = packet->pts != AV_NOPTS_VALUE ? packet->pts : packet->dts;
+            const int64_t decode_timestamp = packet->dts != AV_NOPTS_VALUE ? packet->dts : packet->pts;
+            const int64_t time = timestamp == AV_NOPTS_VALUE ? AV_NOPTS_VALUE :
+                av_rescale_q(timestamp, input_time_base, AV_TIME_BASE_Q);
+            const int64_t decode_time = decode_timestamp == AV_NOPTS_VALUE ? AV_NOPTS_VALUE :
+                av_rescale_q(decode_timestamp, input_time_base, AV_TIME_BASE_Q);
+
+            // The copy starts at the first video keyframe at or after the seek point.
+            if (!started) {
+                if (input_index != m_video_stream_index || !(packet->flags & AV_PKT_FLAG_KEY) ||
+                    time == AV_NOPTS_VALUE) {
+                    av_packet_unref(packet);
+                    continue;
+                }
+                started = true;
+                offset = time;
+                stats.start_time = time;
+            }
+
+            // Drop what precedes the start (e.g. audio interleaved before the keyframe) and stop each
+            // stream at the end.
+            if (time != AV_NOPTS_VALUE && time < offset && input_index != m_video_stream_index) {
+                av_packet_unref(packet);
+                continue;
+            }
+            if (m_options.end_time >= 0 && decode_time != AV_NOPTS_VALUE && decode_time >= m_options.end_time) {
+                finished[input_index] = true;
+                finished_count++;
+                av_packet_unref(packet);
+                continue;
+            }
+
+            // Rebase and convert the timestamps to the output stream's time base.
+            if (m_options.rebase_timestamps) {
+                const int64_t shift = av_rescale_q(offset, AV_TIME_BASE_Q, input_time_base);
+                if (packet->pts != AV_NOPTS_VALUE) {
+                    packet->pts -= shift;
+                }
+                if (packet->dts != AV_NOPTS_VALUE) {
+                    packet->dts -= shift;
+                }
+            }
+            AVStream *output_stream = m_output_context->streams[output_index];
+            av_packet_rescale_ts(packet, input_time_base, output_stream->time_base);
+            packet->stream_index = output_index;
+            packet->pos = -1;
+
+            stats.packets++;
+            stats.bytes += packet->size;
+            if (av_interleaved_write_frame(m_output_context, packet) < 0) {
+                throw std::runtime_error("couldn't write packet");
+            }
+        }
+    } catch (const std::runtime_error &) {
+        av_packet_free(&packet);
+        throw;
+    }
+    av_packet_free(&packet);
+
+    if (!started) {
+        stats.start_time = m_options.start_time;
+    }
+    if (av_write_trailer(m_output_context) < 0) {
+        throw std::runtime_error("couldn't write output trailer");
+    }
+    return stats;
+}
+
+
+/**
+ * Creates the output streams and fills the stream mapping.
+ */
+void Remuxer::createOutputStreams() {
+    const AVOutputFormat *output_format = m_output_context->oformat;
+    m_stream_mapping.assign(m_input_context->nb_streams, -1);
+
+    int output_index = 0;
+    for (unsigned int i = 0; i < m_input_context->nb_streams; i++) {
+        const AVStream *input_stream = m_input_context->streams[i];
+        const AVCodecParameters *parameters = input_stream->codecpar;
+
+        // Skip data streams, and streams the container is known not to support. A negative result
+        // means the muxer can't tell, in which case we try.
+        if (parameters->codec_type != AVMEDIA_TYPE_VIDEO && parameters->codec_type != AVMEDIA_TYPE_AUDIO &&
+            parameters->codec_type != AVMEDIA_TYPE_SUBTITLE) {
+            continue;
+        }
+        if (avformat_query_codec(output_format, parameters->codec_id, FF_COMPLIANCE_NORMAL) == 0) {
+            continue;
+        }
+
+        AVStream *output_stream = avformat_new_stream(m_output_context, nullptr);
+        if (!output_stream) {
+            throw std::runtime_error("couldn't create output stream");
+        }
+        if (avcodec_parameters_copy(output_stream->codecpar, parameters) < 0) {
+            throw std::runtime_error("couldn't copy codec parameters");
+        }
+
+        // Codec tags are container specific; let the output muxer pick its own.
+        output_stream->codecpar->codec_tag = 0;
+        output_stream->time_base = input_stream->time_base;
+        output_stream->disposition = input_stream->disposition;
+        output_stream->sample_aspect_ratio = input_stream->sample_aspect_ratio;
+        av_dict_copy(&output_stream->metadata, input_stream->metadata, 0);
+
+        m_stream_mapping[i] = output_index++;
+    }
+
+    if (output_index == 0) {
+        throw std::runtime_error("no stream can be stored in the output container");
+    }
+
+    // The video stream may have been left out, in which case there's no keyframe to align cuts to.
+    if (m_video_stream_index >= 0 && m_stream_mapping[m_video_stream_index] < 0) {
+        m_video_stream_index = -1;
+    }
+}
+
+
+/**
+ * Closes both files and frees their contexts.
+ */
+void Remuxer::close() {
+    if (m_output_context) {
+        if (!(m_output_context->oformat->flags & AVFMT_NOFILE)) {
+            avio_closep(&m_output_context->pb);
+        }
+        avformat_free_context(m_output_context);
+        m_output_context = nullptr;
+    }
+    avformat_close_input(&m_input_context);
+}
@@ -0,0 +1,586 @@
+#include "smart-cutter.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+
+namespace {
+
+    /**
+     * Appends a NAL unit with a big-endian length prefix of `length_size` bytes.
+     */
+    void appendNalUnit(std::vector<uint8_t> &output, const uint8_t *data, size_t size, int length_size) {
+        for (int i = length_size - 1; i >= 0; i--) {
+            output.push_back(static_cast<uint8_t>(size >> (8 * i)));
+        }
+        output.insert(output.end(), data, data + size);
+    }
+
+    /**
+     * Extracts the parameter sets of H.264 (avcC) or HEVC (hvcC) extradata as length-prefixed NAL
+     * units. Returns the NAL length size, or 0 if the extradata isn't in one of these formats.
+     */
+    int getLengthPrefixedParameterSets(const AVCodecParameters *parameters, std::vector<uint8_t> &parameter_sets) {
+        const uint8_t *data = parameters->extradata;
+        const size_t size = parameters->extradata_size;
+        if (!data || size < 7 || data[0] != 1) {
+            return 0;
+        }
+
+        // Reads a list of NAL units, each preceded by a 16-bit size. Returns false on truncated data.
+        size_t position = 0;
+        auto readNalUnits = [&](size_t count, int length_size) {
+            for (size_t i = 0; i < count; i++) {
+                if (position + 2 > size) {
+                    return false;
+                }
+                const size_t nal_size = (data[position] << 8) | data[position + 1];
+                position += 2;
+                if (position + nal_size > size) {
+                    return false;
+                }
+                appendNalUnit(parameter_sets, data + position, nal_size, length_size);
+                position += nal_size;
+            }
+            return true;
+        };
+
+        if (parameters->codec_id == AV_CODEC_ID_H264) {
+            const int length_size = (data[4] & 3) + 1;
+            position = 6;
+            if (!readNalUnits(data[5] & 0x1f, length_size) || position >= size ||
+                !readNalUnits(data[position++], length_size)) {
+                parameter_sets.clear();
+                return 0;
+            }
+            return length_size;
+        }
+
+        if (parameters->codec_id == AV_CODEC_ID_HEVC && size >= 23) {
+            const int length_size = (data[21] & 3) + 1;
+            const int arrays = data[22];
+            position = 23;
+            for (int i = 0; i < arrays; i++) {
+                if (position + 3 > size) {
+                    parameter_sets.clear();
+                    return 0;
+                }
+                const size_t count = (data[position + 1] << 8) | data[position + 2];
+                position += 3;
+                if (!readNalUnits(count, length_size)) {
+                    parameter_sets.clear();
+                    return 0;
+                }
+            }
+            return length_size;
+        }
+
+        return 0;
+    }
+
+    /**
+     * Returns the offset of the next Annex B start code at or after `position`, or `size` if there is
+     * none. `start_code_size` receives the length of the start code (3 or 4 bytes).
+     */
+    size_t findStartCode(const uint8_t *data, size_t size, size_t position, size_t &start_code_size) {
+        for (; position + 3 <= size; position++) {
+            if (data[position] == 0 && data[position + 1] == 0) {
+                if (data[position + 2] == 1) {
+                    start_code_size = 3;
+                    return position;
+                }
+                if (position + 4 <= size && data[position + 2] == 0 && data[position + 3] == 1) {
+                    start_code_size = 4;
+                    return position;
+                }
+            }
+        }
+        start_code_size = 0;
+        return size;
+    }
+}
+
+
+/**
+ * Opens the input file, prepares decoding of its video stream, and creates the output file. The
+ * output format is guessed from the output path.
+ *
+ * @param input_path Path to the video file to cut.
+ * @param output_path Path to the file to write.
+ * @param options Part of the video to keep.
+ */
+SmartCutter::SmartCutter(const std::string &input_path, const std::string &output_path,
+    const SmartCutOptions &options)
+    : m_input_context(nullptr), m_output_context(nullptr), m_decoder_context(nullptr), m_packet(nullptr),
+    m_frame(nullptr), m_video_stream_index(-1), m_options(options), m_nal_length_size(0), m_start_timestamp(0),
+    m_last_dts(AV_NOPTS_VALUE) {
+
+    try {
+
+        // Open the input and its video stream.
+        if (avformat_open_input(&m_input_context, input_path.c_str(), nullptr, nullptr) != 0) {
+            throw std::runtime_error("couldn't open input file");
+        }
+        if (avformat_find_stream_info(m_input_context, nullptr) < 0) {
+            throw std::runtime_error("couldn't retrieve stream information");
+        }
+        m_video_stream_index = av_find_best_stream(m_input_context, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+        if (m_video_stream_index < 0) {
+            throw std::runtime_error("couldn't find a video stream");
+        }
+        const AVStream *input_stream = m_input_context->streams[m_video_stream_index];
+
+        // Open the decoder for the edges.
+        const AVCodec *decoder = avcodec_find_decoder(input_stream->codecpar->codec_id);
+        if (!decoder) {
+            throw std::runtime_error("unsupported video codec");
+        }
+        m_decoder_context = avcodec_alloc_context3(decoder);
+        if (!m_decoder_context) {
+            throw std::runtime_error("couldn't allocate video codec context");
+        }
+        if (avcodec_parameters_to_context(m_decoder_context, input_stream->codecpar) < 0) {
+            throw std::runtime_error("couldn't copy codec parameters to codec context");
+        }
+        m_decoder_context->pkt_timebase = input_stream->time_base;
+        if (avcodec_open2(m_decoder_context, decoder, nullptr) < 0) {
+            throw std::runtime_error("couldn't open video codec");
+        }
+
+        m_packet = av_packet_alloc();
+        m_frame = av_frame_alloc();
+        if (!m_packet || !m_frame) {
+            throw std::runtime_error("couldn't allocate packet or frame");
+        }
+
+        // Create the output with the input's codec parameters, so copied packets stay valid as they are.
+        avformat_alloc_output_context2(&m_output_context, nullptr, nullptr, output_path.c_str());
+        if (!m_output_context) {
+            throw std::runtime_error("couldn't allocate output format context");
+        }
+        AVStream *output_stream = avformat_new_stream(m_output_context, nullptr);
+        if (!output_stream) {
+            throw std::runtime_error("couldn't create output stream");
+        }
+        if (avcodec_parameters_copy(output_stream->codecpar, input_stream->codecpar) < 0) {
+            throw std::runtime_error("couldn't copy codec parameters");
+        }
+        output_stream->codecpar->codec_tag = 0;
+        output_stream->time_base = input_stream->time_base;
+        output_stream->sample_aspect_ratio = input_stream->sample_aspect_ratio;
+        m_nal_length_size = getLengthPrefixedParameterSets(input_stream->codecpar, m_parameter_sets);
+
+        if (!(m_output_context->oformat->flags & AVFMT_NOFILE)) {
+            if (avio_open(&m_output_context->pb, output_path.c_str(), AVIO_FLAG_WRITE) < 0) {
+                throw std::runtime_error("couldn't open output file");
+            }
+        }
+    } catch (const std::runtime_error &) {
+        close();
+        throw;
+    }
+}
+
+
+/**
+ * Closes both files. An output that hasn't been completed by run() is left incomplete.
+ */
+SmartCutter::~SmartCutter() {
+    close();
+}
+
+
+/**
+ * Writes the cut video and completes the output file.
+ *
+ * @return Number of copied packets and re-encoded frames.
+ */
+SmartCutStats SmartCutter::run() {
+    const AVRational time_base = m_input_context->streams[m_video_stream_index]->time_base;
+    const int64_t start = av_rescale_q(m_options.start_time, AV_TIME_BASE_Q, time_base);
+    const int64_t end = m_options.end_time < 0 ? std::numeric_limits<int64_t>::max() :
+        av_rescale_q(m_options.end_time, AV_TIME_BASE_Q, time_base);
+    if (end <= start) {
+        throw std::runtime_error("cut ends before it starts");
+    }
+    m_start_timestamp = start;
+
+    if (avformat_write_header(m_output_context, nullptr) < 0) {
+        throw std::runtime_error("couldn't write output header");
+    }
+
+    // The first keyframe inside the cut is where copying can start.
+    int64_t last_timestamp = AV_NOPTS_VALUE;
+    const std::vector<Keyframe> keyframes = scanKeyframes(start, end, last_timestamp);
+    const Keyframe *copy_start = nullptr;
+    for (const Keyframe &keyframe : keyframes) {
+        if (keyframe.pts >= start && keyframe.pts < end) {
+            copy_start = &keyframe;
+            break;
+        }
+    }
+
+    if (!copy_start) {
+
+        // The cut lies within a single GOP: re-encode all of it.
+        encodeRange(start, end, 0);
+    } else {
+
+        // If the cut ends at a keyframe or past the last frame, everything from the first keyframe on
+        // can be copied. Otherwise copying stops at the last keyframe inside the cut, and the rest of
+        // its GOP is re-encoded.
+        const Keyframe *copy_end = nullptr;
+        const Keyframe *tail_start = copy_start;
+        bool encode_tail = last_timestamp >= end;
+        for (const Keyframe &keyframe : keyframes) {
+            if (keyframe.pts >= end) {
+                encode_tail = keyframe.pts != end;
+                copy_end = &keyframe;
+                break;
+            }
+            tail_start = keyframe.pts >= copy_start->pts ? &keyframe : tail_start;
+        }
+        if (encode_tail) {
+            copy_end = tail_start;
+        }
+
+        const bool encode_head = start < copy_start->pts;
+        if (encode_head) {
+            encodeRange(start, copy_start->pts, copy_start->pts - copy_start->dts);
+        }
+        if (copy_end != copy_start) {
+            copyRange(*copy_start, copy_end, encode_head);
+        }
+        if (encode_tail) {
+            encodeRange(tail_start->pts, end, tail_start->pts - tail_start->dts);
+        }
+    }
+
+    if (av_write_trailer(m_output_context) < 0) {
+        throw std::runtime_error("couldn't write output trailer");
+    }
+    return m_stats;
+}
+
+
+/**
+ * Lists the keyframes from the last one at or before `start` up to the first one at or after
+ * `end` (or the end of the file).
+ *
+ * @param last_timestamp Receives the largest presentation timestamp read.
+ */
+std::vector<SmartCutter::Keyframe> SmartCutter::scanKeyframes(int64_t start, int64_t end, int64_t &last_timestamp) {
+    seek(start);
+
+    std::vector<Keyframe> keyframes;
+    while (av_read_frame(m_input_context, m_packet) >= 0) {
+        if (m_packet->stream_index != m_video_stream_index) {
+            av_packet_unref(m_packet);
+            continue;
+        }
+        const int64_t pts = m_packet->pts != AV_NOPTS_VALUE ? m_packet->pts : m_packet->dts;
+        const int64_t dts = m_packet->dts != AV_NOPTS_VALUE ? m_packet->dts : pts;
+        const bool keyframe = m_packet->flags & AV_PKT_FLAG_KEY;
+        av_packet_unref(m_packet);
+        if (pts == AV_NOPTS_VALUE) {
+            continue;
+        }
+
+        last_timestamp = last_timestamp == AV_NOPTS_VALUE ? pts : std::max(last_timestamp, pts);
+        if (keyframe) {
+            keyframes.push_back({pts, dts});
+            if (pts >= end) {
+                break;
+            }
+        }
+    }
+
+    if (keyframes.empty()) {
+        throw std::runtime_error("couldn't find a keyframe");
+    }
+    return keyframes;
+}
+
+
+/**
+ * Decodes the frames with timestamps in [start, end) and re-encodes them as a new GOP.
+ *
+ * @param start Timestamp of the first frame to re-encode.
+ * @param end Timestamp of the first frame not to re-encode.
+ * @param dts_delay Distance between presentation and decoding timestamps to give the encoded
+ * packets, so that their decoding timestamps line up with the surrounding copied packets.
+ */
+void SmartCutter::encodeRange(int64_t start, int64_t end, int64_t dts_delay) {
+    AVCodecContext *encoder_context = openEncoder();
+
+    try {
+        seek(start);
+        avcodec_flush_buffers(m_decoder_context);
+
+        bool done = false;
+        bool flushing = false;
+        while (!done) {
+
+            // Feed the decoder, flushing it at the end of the file.
+            if (!flushing) {
+                if (av_read_frame(m_input_context, m_packet) < 0) {
+                    avcodec_send_packet(m_decoder_context, nullptr);
+                    flushing = true;
+                } else {
+                    if (m_packet->stream_index == m_video_stream_index &&
+                        avcodec_send_packet(m_decoder_context, m_packet) < 0) {
+                        av_packet_unref(m_packet);
+                        throw std::runtime_error("couldn't decode packet");
+                    }
+                    av_packet_unref(m_packet);
+                }
+            }
+
+            // Encode the decoded frames that fall into the range.
+            while (true) {
+                const int ret = avcodec_receive_frame(m_decoder_context, m_frame);
+                if (ret == AVERROR(EAGAIN)) {
+                    break;
+                }
+                if (ret < 0) {
+                    done = true;
+                    break;
+                }
+
+                const int64_t timestamp = m_frame->best_effort_timestamp;
+                if (timestamp != AV_NOPTS_VALUE && timestamp >= end) {
+                    av_frame_unref(m_frame);
+                    done = true;
+                    break;
+                }
+                if (timestamp != AV_NOPTS_VALUE && timestamp >= start) {
+                    m_frame->pts = timestamp;
+                    m_frame->pict_type = AV_PICTURE_TYPE_NONE;
+                    if (avcodec_send_frame(encoder_context, m_frame) < 0) {
+                        av_frame_unref(m_frame);
+                        throw std::runtime_error("couldn't encode frame");
+                    }
+                    m_stats.encoded_frames++;
+                    writeEncodedPackets(encoder_context, dts_delay);
+                }
+                av_frame_unref(m_frame);
+            }
+        }
+
+        // Flush the encoder.
+        avcodec_send_frame(encoder_context, nullptr);
+        writeEncodedPackets(encoder_context, dts_delay);
+    } catch (const std::runtime_error &) {
+        avcodec_free_context(&encoder_context);
+        throw;
+    }
+    avcodec_free_context(&encoder_context);
+}
+
+
+/**
+ * Copies the packets from keyframe `first` up to (but not including) keyframe `last`, or up to
+ * the end of the file if `last` is null.
+ *
+ * @param repeat_parameter_sets Whether to insert the input's parameter sets before the first packet.
+ */
+void SmartCutter::copyRange(const Keyframe &first, const Keyframe *last, bool repeat_parameter_sets) {
+    seek(first.pts);
+
+    bool started = false;
+    while (av_read_frame(m_input_context, m_packet) >= 0) {
+        if (m_packet->stream_index != m_video_stream_index) {
+            av_packet_unref(m_packet);
+            continue;
+        }
+        const bool keyframe = m_packet->flags & AV_PKT_FLAG_KEY;
+        const int64_t pts = m_packet->pts != AV_NOPTS_VALUE ? m_packet->pts : m_packet->dts;
+
+        // Skip ahead to the first keyframe, and stop at the last one.
+        if (!started && !(keyframe && pts == first.pts)) {
+            av_packet_unref(m_packet);
+            continue;
+        }
+        if (started && last && keyframe && pts == last->pts) {
+            av_packet_unref(m_packet);
+            break;
+        }
+
+        // Switch decoders back from the re-encoded head's parameter sets to the input's.
+        if (!started && repeat_parameter_sets && !m_parameter_sets.empty()) {
+            AVPacket *packet = av_packet_alloc();
+            if (!packet || av_new_packet(packet, static_cast<int>(m_parameter_sets.size()) + m_packet->size) < 0) {
+                av_packet_free(&packet);
+                av_packet_unref(m_packet);
+                throw std::runtime_error("couldn't allocate packet");
+            }
+            std::memcpy(packet->data, m_parameter_sets.data(), m_parameter_sets.size());
+            std::memcpy(packet->data + m_parameter_sets.size(), m_packet->data, m_packet->size);
+            av_packet_copy_props(packet, m_packet);
+            av_packet_unref(m_packet);
+            av_packet_move_ref(m_packet, packet);
+            av_packet_free(&packet);
+        }
+        started = true;
+
+        m_stats.copied_packets++;
+        writePacket(m_packet);
+    }
+}
+
+
+/**
+ * Seeks the input to the last keyframe at or before a timestamp of the video stream. Reading from
+ * wherever the input was instead would silently cut at the wrong point.
+ */
+void SmartCutter::seek(int64_t timestamp) {
+    if (av_seek_frame(m_input_context, m_video_stream_index, timestamp, AVSEEK_FLAG_BACKWARD) < 0) {
+        throw std::runtime_error("couldn't seek input");
+    }
+}
+
+
+/**
+ * Allocates and opens an encoder matching the input video stream.
+ */
+AVCodecContext *SmartCutter::openEncoder() const {
+    const AVStream *input_stream = m_input_context->streams[m_video_stream_index];
+    const AVCodecParameters *parameters = input_stream->codecpar;
+
+    const AVCodec *encoder = avcodec_find_encoder(parameters->codec_id);
+    if (!encoder) {
+        throw std::runtime_error("couldn't find an encoder for the video codec");
+    }
+
+    // Try with the input's profile first; encoders that can't produce it get to pick their own.
+    for (const bool keep_profile : {true, false}) {
+        AVCodecContext *encoder_context = avcodec_alloc_context3(encoder);
+        if (!encoder_context) {
+            throw std::runtime_error("couldn't allocate video codec context");
+        }
+
+        encoder_context->width = parameters->width;
+        encoder_context->height = parameters->height;
+        encoder_context->pix_fmt = static_cast<AVPixelFormat>(parameters->format);
+        encoder_context->sample_aspect_ratio = parameters->sample_aspect_ratio;
+        encoder_context->color_range = parameters->color_range;
+        encoder_context->color_primaries = parameters->color_primaries;
+        encoder_context->color_trc = parameters->color_trc;
+        encoder_context->colorspace = parameters->color_space;
+        encoder_context->time_base = input_stream->time_base;
+        encoder_context->framerate = av_guess_frame_rate(m_input_context, const_cast<AVStream *>(input_stream), nullptr);
+        encoder_context->bit_rate = parameters->bit_rate > 0 ? parameters->bit_rate : m_input_context->bit_rate;
+        if (keep_profile) {
+            encoder_context->profile = parameters->profile;
+        }
+
+        // Without B-frames, decoding order is presentation order, which keeps the timestamps simple.
+        // No global header: the encoder's parameter sets go in-band, where decoders expect them.
+        encoder_context->max_b_frames = 0;
+
+        if (avcodec_open2(encoder_context, encoder, nullptr) >= 0) {
+            return encoder_context;
+        }
+        avcodec_free_context(&encoder_context);
+    }
+    throw std::runtime_error("couldn't open an encoder matching the video stream");
+}
+
+
+/**
+ * Writes all packets the encoder has ready, or all remaining ones after it has been flushed.
+ */
+void SmartCutter::writeEncodedPackets(AVCodecContext *encoder_context, int64_t dts_delay) {
+    while (avcodec_receive_packet(encoder_context, m_packet) >= 0) {
+
+        // Line the decoding timestamps up with the copied packets, and keep them increasing.
+        if (m_packet->pts != AV_NOPTS_VALUE) {
+            m_packet->dts = m_packet->pts - dts_delay;
+        }
+        if (m_last_dts != AV_NOPTS_VALUE && m_packet->dts <= m_last_dts) {
+            m_packet->dts = m_last_dts + 1;
+            if (m_packet->pts != AV_NOPTS_VALUE && m_packet->pts < m_packet->dts) {
+                m_packet->pts = m_packet->dts;
+            }
+        }
+        convertToLengthPrefixed(m_packet);
+        writePacket(m_packet);
+    }
+}
+
+
+/**
+ * Rebases a packet's timestamps (given in the input stream's time base), converts them to the
+ * output stream's time base, and writes the packet.
+ */
+void SmartCutter::writePacket(AVPacket *packet) {
+    if (packet->dts != AV_NOPTS_VALUE) {
+        m_last_dts = packet->dts;
+        packet->dts -= m_start_timestamp;
+    }
+    if (packet->pts != AV_NOPTS_VALUE) {
+        packet->pts -= m_start_timestamp;
+    }
+
+    av_packet_rescale_ts(packet, m_input_context->streams[m_video_stream_index]->time_base,
+        m_output_context->streams[0]->time_base);
+    packet->stream_index = 0;
+    packet->pos = -1;
+
+    // Writing consumes the packet's reference.
+    if (av_interleaved_write_frame(m_output_context, packet) < 0) {
+        throw std::runtime_error("couldn't write packet");
+    }
+}
+
+
+/**
+ * Converts a packet of Annex B NAL units (as written by encoders) to length-prefixed NAL units, if
+ * the output stream uses those.
+ */
+void SmartCutter::convertToLengthPrefixed(AVPacket *packet) const {
+    size_t start_code_size;
+    if (!m_nal_length_size || findStartCode(packet->data, packet->size, 0, start_code_size) != 0) {
+        return;
+    }
+
+    std::vector<uint8_t> converted;
+    converted.reserve(packet->size + 16);
+    size_t position = start_code_size;
+    while (position < static_cast<size_t>(packet->size)) {
+        size_t next_start_code_size;
+        const size_t next = findStartCode(packet->data, packet->size, position, next_start_code_size);
+        appendNalUnit(converted, packet->data + position, next - position, m_nal_length_size);
+        position = next + next_start_code_size;
+    }
+
+    AVPacket *result = av_packet_alloc();
+    if (!result || av_new_packet(result, static_cast<int>(converted.size())) < 0) {
+        av_packet_free(&result);
+        throw std::runtime_error("couldn't allocate packet");
+    }
+    std::memcpy(result->data, converted.data(), converted.size());
+    av_packet_copy_props(result, packet);
+    av_packet_unref(packet);
+    av_packet_move_ref(packet, result);
+    av_packet_free(&result);
+}
+
+
+/**
+ * Closes both files and frees all contexts.
+ */
+void SmartCutter::close() {
+    av_frame_free(&m_frame);
+    av_packet_free(&m_packet);
+    avcodec_free_context(&m_decoder_context);
+    if (m_output_context) {
+        if (!(m_output_context->oformat->flags & AVFMT_NOFILE)) {
+            avio_closep(&m_output_context->pb);
+        }
+        avformat_free_context(m_output_context);
+        m_output_context = nullptr;
+    }
+    avformat_close_input(&m_input_context);
+}
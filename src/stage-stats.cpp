@@ -0,0 +1,97 @@
+#include "stage-stats.h"
+
+#include <algorithm>
+#include <bit>
+
+
+/**
+ * Returns the mean call latency in microseconds, or 0 if there were no calls.
+ */
+double StageStats::getAverageMicroseconds() const {
+    return calls ? static_cast<double>(total_ns) / static_cast<double>(calls) / 1000.0 : 0.0;
+}
+
+
+/**
+ * Returns an upper bound of the given latency percentile (0-100) in nanoseconds, with the
+ * power-of-two resolution of the histogram, or 0 if there were no calls.
+ */
+uint64_t StageStats::getPercentileNanoseconds(double percentile) const {
+    uint64_t total = 0;
+    for (uint64_t count : histogram) {
+        total += count;
+    }
+    if (total == 0) {
+        return 0;
+    }
+
+    // Find the bucket holding the call at the requested rank.
+    const auto rank = static_cast<uint64_t>(std::clamp(percentile, 0.0, 100.0) / 100.0 * static_cast<double>(total));
+    uint64_t seen = 0;
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        seen += histogram[i];
+        if (seen > rank) {
+            return i == HISTOGRAM_BUCKETS - 1 ? max_ns : (uint64_t{2} << i) - 1;
+        }
+    }
+    return max_ns;
+}
+
+
+/**
+ * Constructs a counter with all counters at zero.
+ * @param name Name of the stage, used for its trace events (see Tracer). Must outlive the counter.
+ */
+StageCounter::StageCounter(const char *name) : m_name(name) {
+    reset();
+}
+
+
+/**
+ * Records one call of the stage.
+ * @param ns Duration of the call in nanoseconds.
+ * @param bytes Bytes read or written by the call.
+ */
+void StageCounter::record(uint64_t ns, uint64_t bytes) {
+    m_calls.fetch_add(1, std::memory_order_relaxed);
+    m_total_ns.fetch_add(ns, std::memory_order_relaxed);
+    m_bytes.fetch_add(bytes, std::memory_order_relaxed);
+
+    uint64_t max_ns = m_max_ns.load(std::memory_order_relaxed);
+    while (ns > max_ns && !m_max_ns.compare_exchange_weak(max_ns, ns, std::memory_order_relaxed)) {
+    }
+
+    const int bucket = std::min(std::max(static_cast<int>(std::bit_width(ns)), 1) - 1, StageStats::HISTOGRAM_BUCKETS - 1);
+    m_histogram[bucket].fetch_add(1, std::memory_order_relaxed);
+}
+
+
+/**
+ * Returns a snapshot of the counters. Counters recorded concurrently may be partially included.
+ */
+StageStats StageCounter::getStats() const {
+    StageStats stats;
+    stats.calls = m_calls.load(std::memory_order_relaxed);
+    stats.total_ns = m_total_ns.load(std::memory_order_relaxed);
+    stats.max_ns = m_max_ns.load(std::memory_order_relaxed);
+    stats.bytes = m_bytes.load(std::memory_order_relaxed);
+    for (int i = 0; i < StageStats::HISTOGRAM_BUCKETS; i++) {
+        stats.histogram[i] = m_histogram[i].load(std::memory_order_relaxed);
+    }
+    return stats;
+}
+
+
+/**
+ * Sets all counters back to zero.
+ */
+void StageCounter::reset() {
+    m_calls.store(0, std::memory_order_relaxed);
+    m_total_ns.store(0, std::memory_order_relaxed);
+    m_max_ns.store(0, std::memory_order_relaxed);
+    m_bytes.store(0, std::memory_order_relaxed);
+    for (std::atomic<uint64_t> &count : m_histogram) {
+        count.store(0, std::memory_order_relaxed);
+    }
+}
+
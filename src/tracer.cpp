@@ -0,0 +1,248 @@
+#include "tracer.h"
+
+#include <cstdio>
+#include <fstream>
+
+
+namespace {
+
+    /**
+     * Writes a string as a JSON string literal.
+     */
+    void writeJsonString(std::ostream &stream, const std::string &value) {
+        stream << '"';
+        for (char c : value) {
+            if (c == '"' || c == '\\') {
+                stream << '\\' << c;
+            } else if (static_cast<unsigned char>(c) < 0x20) {
+                char escaped[8];
+                std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                stream << escaped;
+            } else {
+                stream << c;
+            }
+        }
+        stream << '"';
+    }
+
+    /**
+     * Writes a nanosecond duration as microseconds, the unit of Chrome trace timestamps.
+     */
+    void writeMicroseconds(std::ostream &stream, int64_t ns) {
+        char value[32];
+        std::snprintf(value, sizeof(value), "%.3f", static_cast<double>(ns) / 1000.0);
+        stream << value;
+    }
+}
+
+
+Tracer::Tracer() : m_origin(std::chrono::steady_clock::now()), m_next_thread_id(1), m_freed_dropped(0) {
+}
+
+
+/**
+ * Hands the exiting thread's buffer back to the tracer.
+ */
+Tracer::ThreadRegistration::~ThreadRegistration() {
+    if (buffer) {
+        getInstance().releaseThreadBuffer(buffer);
+    }
+}
+
+
+/**
+ * Returns the process-wide tracer.
+ */
+Tracer &Tracer::getInstance() {
+    static Tracer tracer;
+    return tracer;
+}
+
+
+/**
+ * Starts recording events. Events recorded earlier are kept; call clear() to discard them.
+ */
+void Tracer::start() {
+    s_enabled.store(true, std::memory_order_relaxed);
+}
+
+
+/**
+ * Stops recording events. Events recorded so far are kept.
+ */
+void Tracer::stop() {
+    s_enabled.store(false, std::memory_order_relaxed);
+}
+
+
+/**
+ * Discards all recorded events and frees the buffers of exited threads. Must not be called while
+ * other threads may be recording, i.e. only after stop() and once the traced work has finished.
+ */
+void Tracer::clear() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    freeExitedBuffers();
+    m_freed_dropped = 0;
+    for (const std::unique_ptr<ThreadBuffer> &buffer : m_buffers) {
+        buffer->count.store(0, std::memory_order_relaxed);
+        buffer->dropped.store(0, std::memory_order_relaxed);
+    }
+}
+
+
+/**
+ * Records an event on the calling thread. Called by ScopedStageTimer; can be used directly to
+ * add application-specific spans.
+ *
+ * @param name Name of the event. Must stay valid until the trace has been written (e.g. a string literal).
+ * @param begin Time the event began.
+ * @param end Time the event ended.
+ */
+void Tracer::record(const char *name, std::chrono::steady_clock::time_point begin,
+    std::chrono::steady_clock::time_point end) {
+    ThreadBuffer &buffer = getThreadBuffer();
+
+    // Only this thread appends to the buffer, so a relaxed load of our own count is enough.
+    const size_t count = buffer.count.load(std::memory_order_relaxed);
+    if (count == EVENTS_PER_THREAD) {
+        buffer.dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    Event &event = buffer.events[count];
+    event.name = name;
+    event.begin_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(begin - m_origin).count();
+    event.end_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - m_origin).count();
+    buffer.count.store(count + 1, std::memory_order_release);
+}
+
+
+/**
+ * Names the calling thread in written traces (e.g. "decoder" or "encoder 2"). Threads that aren't
+ * named are shown by their number.
+ *
+ * @param name Name of the calling thread.
+ */
+void Tracer::setThreadName(const std::string &name) {
+    ThreadBuffer &buffer = getThreadBuffer();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    buffer.thread_name = name;
+}
+
+
+/**
+ * Returns the number of events dropped because their thread's buffer was full.
+ */
+uint64_t Tracer::getDroppedCount() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    uint64_t dropped = m_freed_dropped;
+    for (const std::unique_ptr<ThreadBuffer> &buffer : m_buffers) {
+        dropped += buffer->dropped.load(std::memory_order_relaxed);
+    }
+    return dropped;
+}
+
+
+/**
+ * Writes all recorded events to a file in Chrome trace event JSON format. Once written, the events of
+ * threads that have exited are discarded and their buffers freed.
+ *
+ * @param path Path to the file to write.
+ * @return `true` if the trace has been written, `false` if the file couldn't be written.
+ */
+bool Tracer::writeChromeTrace(const std::string &path) {
+    std::ofstream file(path, std::ios::trunc);
+    if (!file) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    file << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    bool first = true;
+    for (const std::unique_ptr<ThreadBuffer> &buffer : m_buffers) {
+
+        // Name the thread's track.
+        file << (first ? "\n" : ",\n");
+        first = false;
+        file << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" << buffer->thread_id << ",\"args\":{\"name\":";
+        writeJsonString(file, buffer->thread_name.empty() ?
+            "thread " + std::to_string(buffer->thread_id) : buffer->thread_name);
+        file << "}}";
+
+        // Write its events as complete ("X") events.
+        const size_t count = buffer->count.load(std::memory_order_acquire);
+        for (size_t i = 0; i < count; i++) {
+            const Event &event = buffer->events[i];
+            file << ",\n{\"ph\":\"X\",\"cat\":\"video\",\"name\":";
+            writeJsonString(file, event.name);
+            file << ",\"pid\":1,\"tid\":" << buffer->thread_id << ",\"ts\":";
+            writeMicroseconds(file, event.begin_ns);
+            file << ",\"dur\":";
+            writeMicroseconds(file, event.end_ns - event.begin_ns);
+            file << "}";
+        }
+    }
+    file << "\n]}\n";
+
+    // Keep the events of exited threads for another attempt if they didn't make it to the file.
+    if (!file.flush()) {
+        return false;
+    }
+    freeExitedBuffers();
+    return true;
+}
+
+
+/**
+ * Returns the calling thread's buffer, registering one on the thread's first call.
+ */
+Tracer::ThreadBuffer &Tracer::getThreadBuffer() {
+    thread_local ThreadBuffer *thread_buffer = nullptr;
+    if (thread_buffer) {
+        return *thread_buffer;
+    }
+
+    // Buffers outlive their threads until their events have been written, so traces still show
+    // threads that have finished.
+    thread_local ThreadRegistration registration;
+    auto buffer = std::make_unique<ThreadBuffer>();
+    buffer->events = std::make_unique<Event[]>(EVENTS_PER_THREAD);
+    buffer->count.store(0, std::memory_order_relaxed);
+    buffer->dropped.store(0, std::memory_order_relaxed);
+    buffer->exited = false;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    buffer->thread_id = m_next_thread_id++;
+    thread_buffer = buffer.get();
+    registration.buffer = thread_buffer;
+    m_buffers.push_back(std::move(buffer));
+    return *thread_buffer;
+}
+
+
+/**
+ * Takes back the buffer of a thread that is exiting. It is freed right away if it holds no events,
+ * and otherwise once they have been written or cleared.
+ */
+void Tracer::releaseThreadBuffer(ThreadBuffer *buffer) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    buffer->exited = true;
+    if (buffer->count.load(std::memory_order_relaxed) == 0) {
+        m_freed_dropped += buffer->dropped.load(std::memory_order_relaxed);
+        std::erase_if(m_buffers, [buffer](const std::unique_ptr<ThreadBuffer> &other) { return other.get() == buffer; });
+    }
+}
+
+
+/**
+ * Frees the buffers of exited threads. Must be called with m_mutex held.
+ */
+void Tracer::freeExitedBuffers() {
+    std::erase_if(m_buffers, [this](const std::unique_ptr<ThreadBuffer> &buffer) {
+        if (!buffer->exited) {
+            return false;
+        }
+        m_freed_dropped += buffer->dropped.load(std::memory_order_relaxed);
+        return true;
+    });
+}
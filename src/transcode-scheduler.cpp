@@ -0,0 +1,257 @@
+#include "transcode-scheduler.h"
+
+#include <algorithm>
+
+#include "cpu-count.h"
+
+
+namespace {
+
+    /**
+     * Returns the seconds between two points in time.
+     */
+    double getSeconds(std::chrono::steady_clock::duration duration) {
+        return std::chrono::duration<double>(duration).count();
+    }
+
+    /**
+     * Threads a job needs at the least: one for its decoder and one for its encoder.
+     */
+    constexpr int MIN_JOB_THREADS = 2;
+}
+
+
+/**
+ * Returns whether queued entry `a` starts after queued entry `b`.
+ */
+bool TranscodeScheduler::EntryOrder::operator()(size_t a, size_t b) const {
+    const int priority_a = (*entries)[a].job.priority;
+    const int priority_b = (*entries)[b].job.priority;
+    return priority_a != priority_b ? priority_a < priority_b : a > b;
+}
+
+
+/**
+ * Starts the worker threads that run the jobs.
+ *
+ * @param options Thread budget and maximum number of running jobs.
+ */
+TranscodeScheduler::TranscodeScheduler(const SchedulerOptions &options)
+    : m_thread_budget(0), m_max_running_jobs(0), m_available_threads(0), m_queue(EntryOrder{&m_entries}),
+    m_running_jobs(0), m_stopping(false), m_busy_time(0) {
+
+    m_thread_budget = std::max(options.thread_budget > 0 ? options.thread_budget : getAvailableCpuCount(),
+        MIN_JOB_THREADS);
+    m_available_threads = m_thread_budget;
+    m_max_running_jobs = options.max_running_jobs > 0 ? options.max_running_jobs : std::max(m_thread_budget / 4, 1);
+
+    try {
+        for (int i = 0; i < m_max_running_jobs; i++) {
+            m_workers.emplace_back(&TranscodeScheduler::runJobs, this);
+        }
+    } catch (...) {
+        {
+            std::lock_guard lock(m_mutex);
+            m_stopping = true;
+        }
+        m_work_available.notify_all();
+        for (std::thread &worker : m_workers) {
+            worker.join();
+        }
+        throw;
+    }
+}
+
+
+/**
+ * Lets running jobs finish, drops queued ones, and stops the worker threads.
+ */
+TranscodeScheduler::~TranscodeScheduler() {
+    {
+        std::lock_guard lock(m_mutex);
+        m_stopping = true;
+        while (!m_queue.empty()) {
+            m_queue.pop();
+        }
+    }
+    m_work_available.notify_all();
+    for (std::thread &worker : m_workers) {
+        worker.join();
+    }
+}
+
+
+/**
+ * Queues a job. It starts as soon as a worker is free and no job of higher priority is waiting.
+ *
+ * @param job Files and settings of the transcode.
+ * @return Id of the job, for looking up its stats.
+ */
+uint64_t TranscodeScheduler::submit(const TranscodeJob &job) {
+    uint64_t id;
+    {
+        std::lock_guard lock(m_mutex);
+        id = m_entries.size();
+
+        Entry entry;
+        entry.job = job;
+        entry.stats.id = id;
+        entry.stats.priority = job.priority;
+        entry.submit_time = Clock::now();
+        m_entries.push_back(std::move(entry));
+        m_queue.push(id);
+    }
+    m_work_available.notify_one();
+    return id;
+}
+
+
+/**
+ * Waits until all submitted jobs have finished.
+ */
+void TranscodeScheduler::wait() {
+    std::unique_lock lock(m_mutex);
+    m_all_done.wait(lock, [this] { return m_queue.empty() && m_running_jobs == 0; });
+}
+
+
+/**
+ * Returns the stats of every job submitted so far, in submission order (ids count from 0).
+ */
+std::vector<JobStats> TranscodeScheduler::getJobStats() const {
+    std::lock_guard lock(m_mutex);
+    const Clock::time_point now = Clock::now();
+
+    std::vector<JobStats> stats;
+    stats.reserve(m_entries.size());
+    for (const Entry &entry : m_entries) {
+        stats.push_back(entry.stats);
+        if (entry.stats.state == JobState::QUEUED) {
+            stats.back().queued_seconds = getSeconds(now - entry.submit_time);
+        } else if (entry.stats.state == JobState::RUNNING) {
+            stats.back().run_seconds = getSeconds(now - entry.start_time);
+        }
+    }
+    return stats;
+}
+
+
+/**
+ * Returns the throughput of all jobs together and the use of the thread budget.
+ */
+SchedulerStats TranscodeScheduler::getStats() const {
+    std::lock_guard lock(m_mutex);
+
+    SchedulerStats stats;
+    stats.thread_budget = m_thread_budget;
+    stats.threads_in_use = m_thread_budget - m_available_threads;
+    stats.queued_jobs = static_cast<int>(m_queue.size());
+    stats.running_jobs = m_running_jobs;
+    for (const Entry &entry : m_entries) {
+        stats.completed_jobs += entry.stats.state == JobState::COMPLETED;
+        stats.failed_jobs += entry.stats.state == JobState::FAILED;
+        stats.frames += entry.stats.frames;
+    }
+
+    Clock::duration busy_time = m_busy_time;
+    if (m_running_jobs > 0) {
+        busy_time += Clock::now() - m_busy_since;
+    }
+    stats.busy_seconds = getSeconds(busy_time);
+    return stats;
+}
+
+
+/**
+ * Runs queued jobs until the scheduler stops (worker thread).
+ */
+void TranscodeScheduler::runJobs() {
+    std::unique_lock lock(m_mutex);
+    while (true) {
+        m_work_available.wait(lock, [this] {
+            return m_stopping || (!m_queue.empty() && m_available_threads >= MIN_JOB_THREADS);
+        });
+        if (m_stopping) {
+            return;
+        }
+
+        // Start the most important job.
+        const size_t index = m_queue.top();
+        m_queue.pop();
+        Entry &entry = m_entries[index];
+        assignThreads(entry.stats);
+
+        entry.start_time = Clock::now();
+        entry.stats.state = JobState::RUNNING;
+        entry.stats.queued_seconds = getSeconds(entry.start_time - entry.submit_time);
+        if (m_running_jobs++ == 0) {
+            m_busy_since = entry.start_time;
+        }
+
+        // Entries may move while the job runs, so work on copies.
+        const TranscodeJob job = entry.job;
+        const JobStats job_stats = entry.stats;
+        lock.unlock();
+
+        int64_t frames = 0;
+        std::string error;
+        try {
+            frames = runJob(job, job_stats);
+        } catch (const std::exception &exception) {
+            error = exception.what();
+        }
+
+        // Record the results and give the threads back.
+        lock.lock();
+        Entry &finished_entry = m_entries[index];
+        const Clock::time_point end_time = Clock::now();
+        finished_entry.stats.state = error.empty() ? JobState::COMPLETED : JobState::FAILED;
+        finished_entry.stats.frames = frames;
+        finished_entry.stats.run_seconds = getSeconds(end_time - finished_entry.start_time);
+        finished_entry.stats.error = error;
+        m_available_threads += job_stats.decode_threads + job_stats.encode_threads;
+        if (--m_running_jobs == 0) {
+            m_busy_time += end_time - m_busy_since;
+        }
+        m_all_done.notify_all();
+
+        // Workers may be waiting for the threads just given back.
+        m_work_available.notify_all();
+    }
+}
+
+
+/**
+ * Assigns decoder and encoder threads to a job that is about to start. The mutex must be held.
+ */
+void TranscodeScheduler::assignThreads(JobStats &stats) {
+
+    // Share the free threads between this job and the queued jobs that idle workers will start right
+    // after it, so the first job doesn't take everything. No job gets more than its part of the budget
+    // either, so that jobs submitted later still find their threads free. Workers only start a job
+    // once at least MIN_JOB_THREADS are free, so the budget is never exceeded.
+    const int idle_workers = m_max_running_jobs - m_running_jobs;
+    const int starting_jobs = std::max(std::min(idle_workers, static_cast<int>(m_queue.size()) + 1), 1);
+    const int job_limit = std::max(m_thread_budget / m_max_running_jobs, MIN_JOB_THREADS);
+    const int share = std::clamp(std::min(m_available_threads / starting_jobs, job_limit), MIN_JOB_THREADS,
+        m_available_threads);
+
+    // Encoding costs several times as much as decoding, so the encoder gets most of the share.
+    stats.decode_threads = std::max(share / 4, 1);
+    stats.encode_threads = share - stats.decode_threads;
+    m_available_threads -= share;
+}
+
+
+/**
+ * Runs a single job with its assigned threads and returns the number of frames encoded.
+ */
+int64_t TranscodeScheduler::runJob(const TranscodeJob &job, const JobStats &stats) {
+    VideoDecoderOptions decoder_options;
+    decoder_options.thread_count = stats.decode_threads;
+    VideoEncoderOptions encoder_options;
+    encoder_options.thread_count = stats.encode_threads;
+
+    Transcoder transcoder(job.input_path, job.output_path, job.options, decoder_options, encoder_options);
+    return transcoder.run().frames;
+}
@@ -0,0 +1,554 @@
+#include "transcoder.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <semaphore>
+#include <thread>
+#include <vector>
+
+#include "cpu-count.h"
+#include "tracer.h"
+
+
+namespace {
+
+    struct PacketDeleter {
+        void operator()(AVPacket *packet) const { av_packet_free(&packet); }
+    };
+
+    struct FrameDeleter {
+        void operator()(AVFrame *frame) const { av_frame_free(&frame); }
+    };
+
+    using PacketPointer = std::unique_ptr<AVPacket, PacketDeleter>;
+    using FramePointer = std::unique_ptr<AVFrame, FrameDeleter>;
+
+    /**
+     * A decoded frame and its position in presentation order, which scaler threads may change.
+     */
+    struct SequencedFrame {
+        int64_t index = 0;
+        FramePointer frame;
+    };
+
+    /**
+     * Returns the option value if it is set, or the input's value otherwise.
+     */
+    template <typename T>
+    T getValueOrDefault(T value, T default_value) {
+        return value > 0 ? value : default_value;
+    }
+
+    /**
+     * Returns the bit rate to encode with: the requested one, the input's, or, if the input's is
+     * unknown, about a third of a bit per pixel at 24 frames per second.
+     */
+    int64_t getBitrate(const TranscodeOptions &options, const VideoDecoder &decoder, int width, int height) {
+        if (options.bitrate > 0) {
+            return options.bitrate;
+        }
+        if (decoder.getBitrate() > 0) {
+            return decoder.getBitrate();
+        }
+        return int64_t{width} * height * 8;
+    }
+
+    /**
+     * Maps decoded frames onto the constant frame rate of the output by their timestamps. Each frame
+     * covers the output frame slots from its timestamp up to its end, both rounded to the nearest slot,
+     * so frames covering no slot are dropped and frames covering several are repeated. This keeps the
+     * output as long as the input when the frame rates differ or the input's rate is variable.
+     */
+    class FrameRateConverter {
+        AVRational m_time_base;
+        AVRational m_slot_duration;
+        int64_t m_default_duration;
+        int64_t m_start_timestamp;
+        int64_t m_next_slot;
+
+    public:
+
+        /**
+         * Creates a converter for the frames of an input stream.
+         *
+         * @param stream Input video stream, for its time base and average frame rate.
+         * @param frame_rate Frame rate of the output.
+         */
+        FrameRateConverter(const AVStream *stream, AVRational frame_rate)
+            : m_time_base(stream->time_base), m_slot_duration(av_inv_q(frame_rate)),
+            m_default_duration(stream->avg_frame_rate.num > 0 && stream->avg_frame_rate.den > 0 ?
+                av_rescale_q(1, av_inv_q(stream->avg_frame_rate), stream->time_base) : 0),
+            m_start_timestamp(AV_NOPTS_VALUE), m_next_slot(0) {}
+
+        /**
+         * Returns how many times to encode a frame: 0 drops it, more than 1 repeats it. Frames must be
+         * passed in presentation order. Frames without a timestamp are encoded once.
+         */
+        int64_t getRepeatCount(const AVFrame *frame) {
+            const int64_t timestamp = frame->best_effort_timestamp;
+            if (timestamp == AV_NOPTS_VALUE) {
+                m_next_slot++;
+                return 1;
+            }
+            if (m_start_timestamp == AV_NOPTS_VALUE) {
+                m_start_timestamp = timestamp;
+            }
+
+            // Without a duration, a frame covers at least the slot it starts in.
+            const int64_t duration = frame->duration > 0 ? frame->duration : m_default_duration;
+            const int64_t start_slot = toSlot(timestamp);
+            const int64_t end_slot = duration > 0 ? std::max(toSlot(timestamp + duration), start_slot) :
+                start_slot + 1;
+
+            const int64_t count = std::max<int64_t>(end_slot - m_next_slot, 0);
+            m_next_slot += count;
+            return count;
+        }
+
+    private:
+
+        /**
+         * Returns the output frame slot nearest to an input timestamp.
+         */
+        int64_t toSlot(int64_t timestamp) const {
+            return av_rescale_q_rnd(timestamp - m_start_timestamp, m_time_base, m_slot_duration, AV_ROUND_NEAR_INF);
+        }
+    };
+
+    /**
+     * Checks whether a frame has to be scaled or converted before the encoder accepts it.
+     */
+    bool needsScaling(const AVFrame *frame, const AVCodecContext *encoder_context) {
+        return frame->width != encoder_context->width || frame->height != encoder_context->height ||
+            frame->format != encoder_context->pix_fmt;
+    }
+
+    /**
+     * Scales and converts a frame into another one that has a buffer of the encoder's dimensions and
+     * pixel format, and copies its properties.
+     *
+     * @param sws_context Scaling context, (re)created as needed.
+     * @return Size of the source frame in bytes.
+     */
+    uint64_t scaleInto(SwsContext *&sws_context, const AVFrame *source, AVFrame *destination) {
+        sws_context = sws_getCachedContext(sws_context,
+            source->width, source->height, static_cast<AVPixelFormat>(source->format),
+            destination->width, destination->height, static_cast<AVPixelFormat>(destination->format),
+            SWS_BICUBIC, nullptr, nullptr, nullptr);
+        if (!sws_context) {
+            throw std::runtime_error("couldn't create scaling context");
+        }
+
+        av_frame_copy_props(destination, source);
+        sws_scale(sws_context, source->data, source->linesize, 0, source->height,
+            destination->data, destination->linesize);
+        return static_cast<uint64_t>(std::max(av_image_get_buffer_size(static_cast<AVPixelFormat>(source->format),
+            source->width, source->height, 1), 0));
+    }
+}
+
+
+struct Transcoder::Pipeline {
+    BoundedQueue<PacketPointer> packets;
+    BoundedQueue<SequencedFrame> decoded_frames;
+    BoundedQueue<SequencedFrame> encoder_frames;
+
+    /**
+     * Limits the number of decoded frames in flight, so that the reorder buffer of the encode thread
+     * stays bounded even if one scaler thread falls far behind the others.
+     */
+    std::counting_semaphore<> frame_slots;
+    const ptrdiff_t frame_window;
+
+    std::atomic<int> active_scalers;
+    std::atomic<int64_t> scaled_frames;
+    int64_t frames;
+    int64_t dropped_frames;
+    int64_t repeated_frames;
+
+    std::atomic<bool> failed;
+    std::mutex error_mutex;
+    std::exception_ptr error;
+
+    Pipeline(size_t queue_capacity, int scaler_threads)
+        : packets(queue_capacity), decoded_frames(queue_capacity), encoder_frames(queue_capacity),
+        frame_slots(static_cast<ptrdiff_t>(2 * queue_capacity) + scaler_threads),
+        frame_window(static_cast<ptrdiff_t>(2 * queue_capacity) + scaler_threads),
+        active_scalers(scaler_threads), scaled_frames(0), frames(0), dropped_frames(0),
+        repeated_frames(0), failed(false) {}
+
+    /**
+     * Records the first error and wakes every stage, so that all threads wind down.
+     */
+    void fail(std::exception_ptr exception) {
+        {
+            std::lock_guard lock(error_mutex);
+            if (!error) {
+                error = exception;
+            }
+        }
+        failed.store(true);
+        packets.close();
+        decoded_frames.close();
+        encoder_frames.close();
+        frame_slots.release(frame_window);
+    }
+};
+
+
+/**
+ * Opens the input file and creates the output file. The output format (and with it the codec)
+ * is guessed from the output path.
+ *
+ * @param input_path Path to the video file to transcode.
+ * @param output_path Path to the file to write.
+ * @param options Output settings; unset ones are taken from the input.
+ * @param decoder_options Options controlling how the input file is opened.
+ * @param encoder_options Options controlling how the output video stream is encoded.
+ */
+Transcoder::Transcoder(const std::string &input_path, const std::string &output_path,
+    const TranscodeOptions &options, const VideoDecoderOptions &decoder_options,
+    const VideoEncoderOptions &encoder_options)
+    : m_decoder(input_path, decoder_options),
+    m_encoder(output_path,
+        getValueOrDefault(options.width, m_decoder.getWidth()),
+        getValueOrDefault(options.height, m_decoder.getHeight()),
+        getValueOrDefault(options.fps, m_decoder.getFPS()),
+        getBitrate(options, m_decoder, getValueOrDefault(options.width, m_decoder.getWidth()),
+            getValueOrDefault(options.height, m_decoder.getHeight())),
+        encoder_options),
+    m_scaled_frame(nullptr), m_sws_context(nullptr) {
+
+    // The scaled frame gets a buffer of the encoder's dimensions and format from its pool for every frame.
+    m_scaled_frame = av_frame_alloc();
+    if (!m_scaled_frame) {
+        throw std::runtime_error("couldn't allocate scaled frame");
+    }
+}
+
+
+/**
+ * Frees the scaling resources. The output file is finalized by the encoder if run() didn't do it.
+ */
+Transcoder::~Transcoder() {
+    sws_freeContext(m_sws_context);
+    av_frame_free(&m_scaled_frame);
+}
+
+
+/**
+ * Decodes and re-encodes every frame of the input on the calling thread and finalizes the output
+ * file. Either this or runPipelined(...) can be called once.
+ *
+ * @return Number of frames encoded, and how many of them had to be scaled.
+ */
+TranscodeStats Transcoder::run() {
+    TranscodeStats stats;
+    const AVCodecContext *encoder_context = m_encoder.m_codec_context;
+    FrameRateConverter frame_rate_converter(getInputStream(), encoder_context->framerate);
+
+    AVFrame *frame = nullptr;
+    while (m_decoder.getNextFrame(&frame)) {
+        const int64_t repeat_count = frame_rate_converter.getRepeatCount(frame);
+        if (repeat_count == 0) {
+            stats.dropped_frames++;
+            continue;
+        }
+
+        // Frames that already match the encoder are encoded as they are. The decoder overwrites its
+        // frame on the next call anyway, and the encoder keeps its own reference if it needs one.
+        if (needsScaling(frame, encoder_context)) {
+            frame = scaleFrame(frame);
+            stats.scaled_frames++;
+        }
+
+        // Let the encoder place keyframes by its own GOP structure instead of the input's.
+        frame->pict_type = AV_PICTURE_TYPE_NONE;
+        for (int64_t i = 0; i < repeat_count; i++) {
+            m_encoder.encodeFrame(frame);
+        }
+        stats.frames += repeat_count;
+        stats.repeated_frames += repeat_count - 1;
+    }
+
+    m_encoder.finalize();
+    return stats;
+}
+
+
+/**
+ * Decodes and re-encodes every frame of the input and finalizes the output file, running each
+ * stage on its own threads: one demuxing, one decoding, a pool scaling, and one encoding and
+ * muxing. The stages are connected by bounded queues, so the slowest stage (usually the encoder)
+ * sets the pace and is kept busy while the others work ahead. Either this or run() can be called
+ * once.
+ *
+ * @param options Number of scaler threads and queue capacity.
+ * @return Number of frames encoded, how many of them had to be scaled, and queue occupancy.
+ */
+TranscodeStats Transcoder::runPipelined(const PipelineOptions &options) {
+    const int scaler_threads = options.scaler_threads > 0 ? options.scaler_threads :
+        std::clamp(getAvailableCpuCount() / 4, 1, 4);
+    Pipeline pipeline(options.queue_capacity, scaler_threads);
+
+    // Every stage reports its errors to the pipeline, which stops the other stages.
+    std::vector<std::thread> threads;
+    auto startStage = [&](const std::string &name, void (Transcoder::*stage)(Pipeline &)) {
+        threads.emplace_back([this, &pipeline, name, stage] {
+            if (Tracer::isEnabled()) {
+                Tracer::getInstance().setThreadName(name);
+            }
+            try {
+                (this->*stage)(pipeline);
+            } catch (...) {
+                pipeline.fail(std::current_exception());
+            }
+        });
+    };
+
+    try {
+        startStage("transcode-demux", &Transcoder::demuxPackets);
+        startStage("transcode-decode", &Transcoder::decodePackets);
+        for (int i = 0; i < scaler_threads; i++) {
+            startStage("transcode-scale-" + std::to_string(i), &Transcoder::scaleFrames);
+        }
+        startStage("transcode-encode", &Transcoder::encodeFrames);
+    } catch (...) {
+        pipeline.fail(std::current_exception());
+    }
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+    if (pipeline.error) {
+        std::rethrow_exception(pipeline.error);
+    }
+
+    TranscodeStats stats;
+    stats.frames = pipeline.frames;
+    stats.dropped_frames = pipeline.dropped_frames;
+    stats.repeated_frames = pipeline.repeated_frames;
+    stats.scaled_frames = pipeline.scaled_frames.load();
+    stats.pipeline.packets = pipeline.packets.getStats();
+    stats.pipeline.decoded_frames = pipeline.decoded_frames.getStats();
+    stats.pipeline.encoder_frames = pipeline.encoder_frames.getStats();
+    stats.pipeline.scaler_threads = scaler_threads;
+    return stats;
+}
+
+
+/**
+ * Returns the decoder, e.g. to enable its stage stats.
+ */
+VideoDecoder &Transcoder::getDecoder() {
+    return m_decoder;
+}
+
+
+/**
+ * Returns the encoder, e.g. to enable its stage stats.
+ */
+VideoEncoder &Transcoder::getEncoder() {
+    return m_encoder;
+}
+
+
+/**
+ * Returns the input's video stream.
+ */
+const AVStream *Transcoder::getInputStream() const {
+    return m_decoder.m_format_context->streams[m_decoder.m_video_stream_index];
+}
+
+
+/**
+ * Scales and converts a decoded frame to the encoder's dimensions and pixel format.
+ *
+ * @param frame Decoded frame.
+ * @return The scaled frame, owned by the transcoder.
+ */
+AVFrame *Transcoder::scaleFrame(const AVFrame *frame) {
+
+    // The encoder may still hold a reference to the previous frame's buffer, so scale into a fresh
+    // one from its pool rather than copying the old one to make it writable.
+    av_frame_unref(m_scaled_frame);
+    m_encoder.getFrameBuffer(m_scaled_frame);
+
+    ScopedStageTimer timer(m_encoder.m_convert_counter, m_encoder.m_stats_enabled.load(std::memory_order_relaxed));
+    timer.addBytes(scaleInto(m_sws_context, frame, m_scaled_frame));
+    return m_scaled_frame;
+}
+
+
+/**
+ * Reads the video packets of the input and queues them for decoding (demux thread).
+ */
+void Transcoder::demuxPackets(Pipeline &pipeline) {
+    AVFormatContext *format_context = m_decoder.m_format_context;
+
+    while (!pipeline.failed.load(std::memory_order_relaxed)) {
+        PacketPointer packet(av_packet_alloc());
+        if (!packet) {
+            throw std::runtime_error("couldn't allocate packet");
+        }
+
+        int ret;
+        {
+            ScopedStageTimer timer(m_decoder.m_demux_counter, m_decoder.m_stats_enabled.load(std::memory_order_relaxed));
+            ret = av_read_frame(format_context, packet.get());
+            if (ret >= 0) {
+                timer.addBytes(packet->size);
+            }
+        }
+
+        // Like VideoDecoder, treat read errors as the end of the file.
+        if (ret < 0) {
+            break;
+        }
+        if (packet->stream_index == m_decoder.m_video_stream_index && !pipeline.packets.push(std::move(packet))) {
+            return;
+        }
+    }
+    pipeline.packets.close();
+}
+
+
+/**
+ * Decodes queued packets and queues the frames, numbered in presentation order, for scaling
+ * (decode thread).
+ */
+void Transcoder::decodePackets(Pipeline &pipeline) {
+    AVCodecContext *codec_context = m_decoder.m_codec_context;
+    const bool stats_enabled = m_decoder.m_stats_enabled.load(std::memory_order_relaxed);
+
+    int64_t index = 0;
+    bool flushed = false;
+    while (!flushed) {
+
+        // Send the next packet, or flush the decoder once all packets have been sent.
+        PacketPointer packet;
+        flushed = !pipeline.packets.pop(packet);
+        if (pipeline.failed.load(std::memory_order_relaxed)) {
+            return;
+        }
+        {
+            ScopedStageTimer timer(m_decoder.m_decode_counter, stats_enabled);
+            if (packet) {
+                timer.addBytes(packet->size);
+            }
+            if (avcodec_send_packet(codec_context, packet.get()) < 0) {
+                throw std::runtime_error("couldn't decode packet");
+            }
+        }
+
+        // Queue all frames the packet completes.
+        while (true) {
+            FramePointer frame(av_frame_alloc());
+            if (!frame) {
+                throw std::runtime_error("couldn't allocate frame");
+            }
+
+            int ret;
+            {
+                ScopedStageTimer timer(m_decoder.m_decode_counter, stats_enabled);
+                ret = avcodec_receive_frame(codec_context, frame.get());
+            }
+            if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+                break;
+            } else if (ret < 0) {
+                throw std::runtime_error("couldn't decode packet");
+            }
+
+            pipeline.frame_slots.acquire();
+            if (pipeline.failed.load(std::memory_order_relaxed) ||
+                !pipeline.decoded_frames.push({index++, std::move(frame)})) {
+                return;
+            }
+        }
+    }
+    pipeline.decoded_frames.close();
+}
+
+
+/**
+ * Scales queued frames as needed and queues them for encoding (scaler threads).
+ */
+void Transcoder::scaleFrames(Pipeline &pipeline) {
+    const AVCodecContext *encoder_context = m_encoder.m_codec_context;
+    SwsContext *sws_context = nullptr;
+
+    try {
+        SequencedFrame item;
+        while (pipeline.decoded_frames.pop(item)) {
+
+            // Each scaled frame gets its own buffer from the encoder's pool, since the encoder may keep
+            // references to several.
+            if (needsScaling(item.frame.get(), encoder_context)) {
+                FramePointer scaled_frame(av_frame_alloc());
+                if (!scaled_frame) {
+                    throw std::runtime_error("couldn't allocate scaled frame");
+                }
+                m_encoder.getFrameBuffer(scaled_frame.get());
+
+                ScopedStageTimer timer(m_encoder.m_convert_counter,
+                    m_encoder.m_stats_enabled.load(std::memory_order_relaxed));
+                timer.addBytes(scaleInto(sws_context, item.frame.get(), scaled_frame.get()));
+                item.frame = std::move(scaled_frame);
+                pipeline.scaled_frames.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            item.frame->pict_type = AV_PICTURE_TYPE_NONE;
+            if (!pipeline.encoder_frames.push(std::move(item))) {
+                break;
+            }
+        }
+    } catch (...) {
+        sws_freeContext(sws_context);
+        throw;
+    }
+    sws_freeContext(sws_context);
+
+    // The last scaler to finish ends the encoder's input.
+    if (pipeline.active_scalers.fetch_sub(1) == 1) {
+        pipeline.encoder_frames.close();
+    }
+}
+
+
+/**
+ * Restores the order of queued frames and encodes them (encode thread).
+ */
+void Transcoder::encodeFrames(Pipeline &pipeline) {
+    std::map<int64_t, FramePointer> pending_frames;
+    int64_t next_index = 0;
+    FrameRateConverter frame_rate_converter(getInputStream(), m_encoder.m_codec_context->framerate);
+
+    SequencedFrame item;
+    while (pipeline.encoder_frames.pop(item)) {
+        if (pipeline.failed.load(std::memory_order_relaxed)) {
+            return;
+        }
+
+        // Scaler threads can finish frames out of order; encode them once their predecessors are done.
+        pending_frames.emplace(item.index, std::move(item.frame));
+        for (auto it = pending_frames.begin(); it != pending_frames.end() && it->first == next_index;
+            it = pending_frames.erase(it)) {
+            const int64_t repeat_count = frame_rate_converter.getRepeatCount(it->second.get());
+            for (int64_t i = 0; i < repeat_count; i++) {
+                m_encoder.encodeFrame(it->second.get());
+            }
+            pipeline.frames += repeat_count;
+            pipeline.dropped_frames += repeat_count == 0;
+            pipeline.repeated_frames += std::max<int64_t>(repeat_count - 1, 0);
+            next_index++;
+            pipeline.frame_slots.release();
+        }
+    }
+
+    if (!pipeline.failed.load()) {
+        m_encoder.finalize();
+    }
+}
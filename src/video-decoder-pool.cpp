@@ -0,0 +1,104 @@
+#include "video-decoder-pool.h"
+
+
+/**
+ * Returns a pooled decoder to its pool, or destroys it if it doesn't belong to one.
+ */
+void VideoDecoderPool::Releaser::operator()(VideoDecoder *decoder) const {
+    if (m_pool) {
+        m_pool->release(decoder);
+    } else {
+        delete decoder;
+    }
+}
+
+
+/**
+ * Constructs an empty VideoDecoderPool.
+ *
+ * @param max_idle_decoders Maximum number of released decoders kept for reuse. Decoders released
+ * while the pool is full are destroyed.
+ * @param options Options used to open every file handed to the pool.
+ */
+VideoDecoderPool::VideoDecoderPool(size_t max_idle_decoders, const VideoDecoderOptions &options)
+    : m_options(options), m_max_idle_decoders(max_idle_decoders), m_created_count(0), m_reused_count(0) {}
+
+
+/**
+ * Returns a decoder for the specified video file, recycling an idle decoder if there is one.
+ *
+ * @param path The path to the video file to be decoded.
+ * @return A decoder positioned at the start of the video stream.
+ *
+ * @throws std::runtime_error If the video file cannot be opened or the decoder cannot be set up.
+ */
+VideoDecoderPool::Handle VideoDecoderPool::acquire(const std::string &path) {
+    std::unique_ptr<VideoDecoder> decoder;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_idle_decoders.empty()) {
+            decoder = std::move(m_idle_decoders.back());
+            m_idle_decoders.pop_back();
+        }
+    }
+
+    // Open the file outside the lock; that's where all the time goes.
+    if (decoder) {
+        try {
+            decoder->reopen(path);
+        } catch (const std::runtime_error &) {
+
+            // The decoder is still usable, so keep it for the next file.
+            release(decoder.release());
+            throw;
+        }
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_reused_count++;
+    } else {
+        decoder = std::make_unique<VideoDecoder>(path, m_options);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_created_count++;
+    }
+
+    return Handle(decoder.release(), Releaser(this));
+}
+
+
+/**
+ * Returns the number of released decoders currently waiting to be reused.
+ */
+size_t VideoDecoderPool::getIdleCount() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_idle_decoders.size();
+}
+
+
+/**
+ * Returns the number of decoders the pool had to construct from scratch.
+ */
+size_t VideoDecoderPool::getCreatedCount() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_created_count;
+}
+
+
+/**
+ * Returns the number of times an idle decoder has been recycled for a new file.
+ */
+size_t VideoDecoderPool::getReusedCount() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_reused_count;
+}
+
+
+/**
+ * Takes back a decoder that has been handed out by acquire(...).
+ */
+void VideoDecoderPool::release(VideoDecoder *decoder) {
+    std::unique_ptr<VideoDecoder> owned(decoder);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_idle_decoders.size() < m_max_idle_decoders) {
+        m_idle_decoders.push_back(std::move(owned));
+    }
+}
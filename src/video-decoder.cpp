@@ -1,5 +1,12 @@
 #include "video-decoder.h"
 
+#include <algorithm>
+#include <cstring>
+
+#include "color-kernels.h"
+#include "cpu-count.h"
+#include "luma-kernels.h"
+
 
 /**
  * Constructs a VideoDecoder object and initializes the decoding context for a specified video file.
@@ -9,6 +16,7 @@
  * within the file and prepares the decoder for subsequent frame retrieval operations.
  *
  * @param path The path to the video file to be decoded.
+ * @param options Options controlling how the video file is opened.
  *
  * @throws std::runtime_error If the video file cannot be opened.
  * @throws std::runtime_error If the stream information cannot be retrieved.
@@ -20,56 +28,40 @@
  * @throws std::runtime_error If the packet allocation fails.
  * @throws std::runtime_error If the frame allocation fails.
  */
-VideoDecoder::VideoDecoder(const std::string &path) {
-
-    // Open input file.
-    m_format_context = nullptr;
-    if (avformat_open_input(&m_format_context, path.c_str(), nullptr, nullptr) != 0) {
-        throw std::runtime_error("couldn't open file");
-    }
-
-    // Retrieve stream information.
-    if (avformat_find_stream_info(m_format_context, nullptr) < 0) {
-        avformat_close_input(&m_format_context);
-        throw std::runtime_error("couldn't retrieve stream information");
-    }
-
-    // Find video stream index.
-    m_video_stream_index = -1;
-    for (unsigned int i = 0; i < m_format_context->nb_streams; i++) {
-        if (m_format_context->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
-            m_video_stream_index = static_cast<int>(i);
-        }
-    }
-    if (m_video_stream_index == -1) {
-        avformat_close_input(&m_format_context);
-        throw std::runtime_error("couldn't find a video stream");
-    }
+VideoDecoder::VideoDecoder(const std::string &path, const VideoDecoderOptions &options)
+    : VideoDecoder(path, options, nullptr) {}
 
-    // Get a pointer to the codec context for the video stream.
-    AVCodecParameters *codec_parameters = m_format_context->streams[m_video_stream_index]->codecpar;
-    const AVCodec *codec = avcodec_find_decoder(codec_parameters->codec_id);
-    if (!codec) {
-        avformat_close_input(&m_format_context);
-        throw std::runtime_error("unsupported video codec");
-    }
 
-    m_codec_context = avcodec_alloc_context3(codec);
-    if (!m_codec_context) {
-        avformat_close_input(&m_format_context);
-        throw std::runtime_error("couldn't allocate video codec context");
+/**
+ * Constructs a VideoDecoder object, optionally reusing previously probed stream information.
+ *
+ * @param path The path to the video file to be decoded.
+ * @param options Options controlling how the video file is opened.
+ * @param stream_info Stream information to apply instead of probing the file. If null or if it
+ * doesn't match the file, the stream information is looked up in the probe cache (if any) and
+ * the file is probed with `avformat_find_stream_info` as a last resort.
+ */
+VideoDecoder::VideoDecoder(const std::string &path, const VideoDecoderOptions &options,
+    std::shared_ptr<const VideoStreamInfo> stream_info)
+    : m_path(path), m_options(options), m_format_context(nullptr), m_codec_context(nullptr), m_video_stream_index(-1),
+    m_packet(nullptr), m_frame(nullptr), m_sws_context(nullptr), m_has_pending_frames(false),
+    m_stats_enabled(false), m_demux_counter("demux"), m_decode_counter("decode"), m_convert_counter("convert") {
+
+    // Route frame allocations to the application's allocator, if any.
+    if (m_options.frame_allocator) {
+        m_frame_buffer_pool = std::make_unique<FrameBufferPool>(m_options.frame_allocator);
     }
 
-    if (avcodec_parameters_to_context(m_codec_context, codec_parameters) < 0) {
-        avcodec_free_context(&m_codec_context);
-        avformat_close_input(&m_format_context);
-        throw std::runtime_error("couldn't copy video codec context");
-    }
+    // Open input file and find its video stream.
+    m_stream_info = std::move(stream_info);
+    m_format_context = openInput(path, m_stream_info, m_video_stream_index);
 
-    if (avcodec_open2(m_codec_context, codec, nullptr) < 0) {
-        avcodec_free_context(&m_codec_context);
+    // Open the decoder for the video stream.
+    try {
+        m_codec_context = openCodec(getStream()->codecpar);
+    } catch (const std::runtime_error &) {
         avformat_close_input(&m_format_context);
-        throw std::runtime_error("couldn't open video codec");
+        throw;
     }
 
     // Allocate m_packet.
@@ -95,12 +87,78 @@ VideoDecoder::VideoDecoder(const std::string &path) {
  * Destructs the VideoDecoder object, releasing all associated resources.
  */
 VideoDecoder::~VideoDecoder() {
+    sws_freeContext(m_sws_context);
     avcodec_free_context(&m_codec_context);
     avformat_close_input(&m_format_context);
     av_packet_free(&m_packet);
     av_frame_free(&m_frame);
 }
 
+
+/**
+ * Creates an independent decoder for the same video file.
+ *
+ * The clone reuses the stream information (codec parameters, timing and seek index) this decoder
+ * has already probed, so only a new I/O handle and a new codec context are opened. Clones can be
+ * used concurrently with each other and with this decoder, which makes them a cheap way to run
+ * several parallel readers or seekers over one file.
+ *
+ * @return A new decoder positioned at the start of the video stream.
+ *
+ * @throws std::runtime_error If the video file cannot be reopened or the decoder cannot be set up.
+ */
+std::unique_ptr<VideoDecoder> VideoDecoder::clone() const {
+    return std::unique_ptr<VideoDecoder>(new VideoDecoder(m_path, m_options, m_stream_info));
+}
+
+
+/**
+ * Closes the current video file and opens another one in its place.
+ *
+ * The packet, the frame and the conversion context are always kept. The codec context is kept as
+ * well (and merely flushed) if the new video stream uses the same codec, dimensions, pixel format
+ * and codec extradata as the current one, which is the common case for batches of similar clips.
+ * If opening the new file fails, the decoder keeps decoding the current one.
+ *
+ * @param path The path to the video file to be decoded.
+ *
+ * @throws std::runtime_error If the video file cannot be opened or the decoder cannot be set up.
+ */
+void VideoDecoder::reopen(const std::string &path) {
+
+    // Open the new file before letting go of the current one, so a failure leaves us intact.
+    std::shared_ptr<const VideoStreamInfo> stream_info;
+    int video_stream_index;
+    AVFormatContext *format_context = openInput(path, stream_info, video_stream_index);
+    const AVCodecParameters *codec_parameters = format_context->streams[video_stream_index]->codecpar;
+
+    if (isCodecContextReusable(codec_parameters)) {
+
+        // Drop frames buffered for the previous file but keep the codec open.
+        avcodec_flush_buffers(m_codec_context);
+    } else {
+        AVCodecContext *codec_context;
+        try {
+            codec_context = openCodec(codec_parameters);
+        } catch (const std::runtime_error &) {
+            avformat_close_input(&format_context);
+            throw;
+        }
+        avcodec_free_context(&m_codec_context);
+        m_codec_context = codec_context;
+    }
+
+    avformat_close_input(&m_format_context);
+    m_format_context = format_context;
+    m_video_stream_index = video_stream_index;
+    m_stream_info = std::move(stream_info);
+    m_path = path;
+
+    av_packet_unref(m_packet);
+    av_frame_unref(m_frame);
+    m_has_pending_frames = false;
+}
+
 /**
  * Returns the width of the video stream in pixels.
  *
@@ -165,6 +223,25 @@ VideoDecoder::~VideoDecoder() {
 }
 
 
+/**
+ * Returns the color primaries, transfer characteristic, matrix coefficients, range, and bit depth
+ * of the video stream.
+ *
+ * @return Color metadata of the video stream.
+ */
+[[nodiscard]] VideoColorInfo VideoDecoder::getColorInfo() const {
+    VideoColorInfo info;
+    info.primaries = m_codec_context->color_primaries;
+    info.transfer = m_codec_context->color_trc;
+    info.space = m_codec_context->colorspace;
+    info.range = m_codec_context->color_range;
+
+    const AVPixFmtDescriptor *descriptor = av_pix_fmt_desc_get(m_codec_context->pix_fmt);
+    info.bit_depth = descriptor ? descriptor->comp[0].depth : 0;
+    return info;
+}
+
+
 /**
  * Decodes and retrieves the next video m_frame from the stream. The decoder has the ownership of the
  * decoded m_frame and the memory will be overwritten by the next m_frame when this function is called again.
@@ -175,13 +252,18 @@ VideoDecoder::~VideoDecoder() {
  */
 bool VideoDecoder::getNextFrame(AVFrame **out_frame) {
     int ret;
-    static bool hasPendingFrames = false;
 
     while (true) {
 
         // If there are no pending frames, read a new m_packet.
-        if (!hasPendingFrames) {
-            ret = av_read_frame(m_format_context, m_packet);
+        if (!m_has_pending_frames) {
+            {
+                ScopedStageTimer timer(m_demux_counter, m_stats_enabled.load(std::memory_order_relaxed));
+                ret = av_read_frame(m_format_context, m_packet);
+                if (ret >= 0) {
+                    timer.addBytes(m_packet->size);
+                }
+            }
             if (ret == AVERROR_EOF) {
 
                 // End of file, send NULL m_packet to flush the decoder.
@@ -193,27 +275,36 @@ bool VideoDecoder::getNextFrame(AVFrame **out_frame) {
             } else if (m_packet->stream_index == m_video_stream_index) {
 
                 // Send the m_packet to the decoder.
+                ScopedStageTimer timer(m_decode_counter, m_stats_enabled.load(std::memory_order_relaxed));
+                timer.addBytes(m_packet->size);
                 ret = avcodec_send_packet(m_codec_context, m_packet);
                 if (ret < 0) {
 
                     // Error sending m_packet to decoder.
+                    av_packet_unref(m_packet);
                     return false;
                 }
             }
+
+            // The decoder keeps its own reference to the m_packet data.
+            av_packet_unref(m_packet);
         }
 
         // Loop to receive all frames that may be produced from the current m_packet.
         while (true) {
-            ret = avcodec_receive_frame(m_codec_context, m_frame);
+            {
+                ScopedStageTimer timer(m_decode_counter, m_stats_enabled.load(std::memory_order_relaxed));
+                ret = avcodec_receive_frame(m_codec_context, m_frame);
+            }
             if (ret == AVERROR(EAGAIN)) {
 
                 // No more frames available in the current m_packet.
-                hasPendingFrames = false;
+                m_has_pending_frames = false;
                 break;
             } else if (ret == AVERROR_EOF) {
 
                 // End of stream, stop processing.
-                hasPendingFrames = false;
+                m_has_pending_frames = false;
                 return false;
             } else if (ret < 0) {
 
@@ -225,7 +316,7 @@ bool VideoDecoder::getNextFrame(AVFrame **out_frame) {
             *out_frame = m_frame;
 
             // Mark that there might be more frames available.
-            hasPendingFrames = true;
+            m_has_pending_frames = true;
 
             // Return true as we have successfully decoded and processed an m_frame.
             return true;
@@ -265,6 +356,65 @@ bool VideoDecoder::getNextFrame(uint8_t *rgb_buffer, int64_t *pts) {
     return false;
 }
 
+/**
+ * Decodes the next video frame, converts (a region of) it to RGB, and writes it into a caller-provided
+ * buffer as described by an output descriptor.
+ *
+ * @param output Describes the destination buffer, its row stride, the destination offset, and the
+ * region of the frame to convert.
+ * @param pts Pointer (can be null) to store the presentation timestamp (PTS) of the decoded frame in microseconds.
+ * @return `true` if a frame is successfully decoded and converted, `false` on end of stream or error.
+ *
+ * @throws std::runtime_error If the crop rectangle exceeds the frame or the conversion fails.
+ */
+bool VideoDecoder::getNextFrame(const FrameOutput &output, int64_t *pts) {
+
+    AVFrame *frame = nullptr;
+    if (!getNextFrame(&frame)) {
+        return false;
+    }
+
+    convertAVFrame(frame, output);
+
+    if (pts) {
+        *pts = getBestEffortTimestampInMicroseconds(frame, getStream());
+    }
+
+    return true;
+}
+
+/**
+ * Decodes the next video frame and hands out a new reference to it, without any conversion or copying.
+ *
+ * The frame stays valid (and unchanged) until the caller unreferences it, no matter how many frames
+ * are decoded afterwards. With a frame allocator (see VideoDecoderOptions), its planes live in
+ * memory obtained from that allocator.
+ *
+ * @param frame Frame to store the reference in. Any reference it held before is released.
+ * @param pts Pointer (can be null) to store the presentation timestamp (PTS) of the decoded frame in microseconds.
+ * @return `true` if a frame is successfully decoded, `false` on end of stream or error.
+ *
+ * @throws std::runtime_error If the decoded frame cannot be referenced.
+ */
+bool VideoDecoder::getNextFrame(AVFrame *frame, int64_t *pts) {
+
+    AVFrame *decoded_frame = nullptr;
+    if (!getNextFrame(&decoded_frame)) {
+        return false;
+    }
+
+    av_frame_unref(frame);
+    if (av_frame_ref(frame, decoded_frame) < 0) {
+        throw std::runtime_error("couldn't reference decoded frame");
+    }
+
+    if (pts) {
+        *pts = getBestEffortTimestampInMicroseconds(decoded_frame, getStream());
+    }
+
+    return true;
+}
+
 /**
  * Seeks to the nearest keyframe at or before the specified timestamp, then decodes frames
  * until the exact timestamp is reached.
@@ -283,6 +433,7 @@ bool VideoDecoder::seekToTimestamp(int64_t timestamp_in_microseconds) {
 
     // Flush the codec to clear any pending frames.
     avcodec_flush_buffers(m_codec_context);
+    m_has_pending_frames = false;
 
     // Seek to the nearest keyframe before or at the target timestamp_in_microseconds.
     if (av_seek_frame(m_format_context, m_video_stream_index, timestamp_in_time_base, AVSEEK_FLAG_BACKWARD) < 0) {
@@ -306,6 +457,171 @@ bool VideoDecoder::seekToTimestamp(int64_t timestamp_in_microseconds) {
     return false;
 }
 
+
+/**
+ * Turns timing of the demux, decode, and convert stages on or off. Stats are off by default; while
+ * they are off, the instrumentation costs a branch per stage call. Can be called from any thread.
+ *
+ * @param enabled Whether to record stage stats.
+ */
+void VideoDecoder::setStatsEnabled(bool enabled) {
+    m_stats_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+
+/**
+ * Returns the stats recorded so far. Stats accumulate across reopen() and can be polled from any
+ * thread while the decoder is in use.
+ *
+ * @return Call counts, cumulative time, bytes, and latency histograms of each stage.
+ */
+[[nodiscard]] DecoderStats VideoDecoder::getStats() const {
+    DecoderStats stats;
+    stats.demux = m_demux_counter.getStats();
+    stats.decode = m_decode_counter.getStats();
+    stats.convert = m_convert_counter.getStats();
+    return stats;
+}
+
+
+/**
+ * Sets all recorded stats back to zero. Can be called from any thread.
+ */
+void VideoDecoder::resetStats() {
+    m_demux_counter.reset();
+    m_decode_counter.reset();
+    m_convert_counter.reset();
+}
+
+/**
+ * Opens a video file and finds its video stream, reusing previously probed stream information
+ * where possible.
+ *
+ * @param path The path to the video file to be opened.
+ * @param stream_info Stream information to apply instead of probing the file (may be null). On
+ * return, holds the stream information actually used for the file.
+ * @param video_stream_index Receives the index of the video stream.
+ * @return The opened format context.
+ *
+ * @throws std::runtime_error If the video file cannot be opened.
+ * @throws std::runtime_error If the stream information cannot be retrieved.
+ * @throws std::runtime_error If no video stream is found in the file.
+ */
+AVFormatContext *VideoDecoder::openInput(const std::string &path, std::shared_ptr<const VideoStreamInfo> &stream_info,
+    int &video_stream_index) const {
+
+    // Look the stream information up in the probe cache unless we've been handed some already.
+    if (!stream_info && m_options.probe_cache) {
+        stream_info = m_options.probe_cache->load(path);
+    }
+
+    // Open input file.
+    AVFormatContext *format_context = nullptr;
+    if (avformat_open_input(&format_context, path.c_str(), nullptr, nullptr) != 0) {
+        throw std::runtime_error("couldn't open file");
+    }
+
+    // Reuse the already probed stream information if there is any, otherwise probe the file.
+    if (stream_info && stream_info->apply(format_context)) {
+        video_stream_index = stream_info->stream_index;
+        return format_context;
+    }
+    stream_info = nullptr;
+
+    // Retrieve stream information.
+    if (avformat_find_stream_info(format_context, nullptr) < 0) {
+        avformat_close_input(&format_context);
+        throw std::runtime_error("couldn't retrieve stream information");
+    }
+
+    // Find video stream index.
+    video_stream_index = -1;
+    for (unsigned int i = 0; i < format_context->nb_streams; i++) {
+        if (format_context->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
+            video_stream_index = static_cast<int>(i);
+        }
+    }
+    if (video_stream_index == -1) {
+        avformat_close_input(&format_context);
+        throw std::runtime_error("couldn't find a video stream");
+    }
+
+    // Keep the probed stream information around so that clones don't have to probe again.
+    try {
+        stream_info = VideoStreamInfo::capture(format_context, video_stream_index);
+    } catch (const std::runtime_error &) {
+        avformat_close_input(&format_context);
+        throw;
+    }
+
+    // Remember the probing results for the next time this file is opened.
+    if (m_options.probe_cache) {
+        m_options.probe_cache->store(path, *stream_info);
+    }
+
+    return format_context;
+}
+
+/**
+ * Allocates and opens a decoder context for a video stream.
+ *
+ * @param codec_parameters Codec parameters of the video stream.
+ * @return The opened codec context.
+ *
+ * @throws std::runtime_error If the video codec is unsupported.
+ * @throws std::runtime_error If the video codec context cannot be allocated.
+ * @throws std::runtime_error If the codec parameters cannot be copied to the codec context.
+ * @throws std::runtime_error If the video codec cannot be opened.
+ */
+AVCodecContext *VideoDecoder::openCodec(const AVCodecParameters *codec_parameters) const {
+    const AVCodec *codec = avcodec_find_decoder(codec_parameters->codec_id);
+    if (!codec) {
+        throw std::runtime_error("unsupported video codec");
+    }
+
+    AVCodecContext *codec_context = avcodec_alloc_context3(codec);
+    if (!codec_context) {
+        throw std::runtime_error("couldn't allocate video codec context");
+    }
+
+    if (avcodec_parameters_to_context(codec_context, codec_parameters) < 0) {
+        avcodec_free_context(&codec_context);
+        throw std::runtime_error("couldn't copy video codec context");
+    }
+
+    if (m_frame_buffer_pool) {
+        m_frame_buffer_pool->install(codec_context);
+    }
+    codec_context->thread_count = m_options.thread_count > 0 ? m_options.thread_count : getAvailableCpuCount();
+
+    if (avcodec_open2(codec_context, codec, nullptr) < 0) {
+        avcodec_free_context(&codec_context);
+        throw std::runtime_error("couldn't open video codec");
+    }
+
+    return codec_context;
+}
+
+/**
+ * Checks whether the current codec context can decode a video stream with the specified codec
+ * parameters without being reopened.
+ *
+ * @param codec_parameters Codec parameters of the video stream.
+ * @return `true` if codec, dimensions, pixel format, and extradata all match.
+ */
+bool VideoDecoder::isCodecContextReusable(const AVCodecParameters *codec_parameters) const {
+    const AVCodecParameters *current = getStream()->codecpar;
+    if (current->codec_id != codec_parameters->codec_id ||
+        current->width != codec_parameters->width ||
+        current->height != codec_parameters->height ||
+        current->format != codec_parameters->format ||
+        current->extradata_size != codec_parameters->extradata_size) {
+        return false;
+    }
+    return current->extradata_size == 0 ||
+        std::memcmp(current->extradata, codec_parameters->extradata, current->extradata_size) == 0;
+}
+
 /**
  * Converts an AVFrame into a RGB buffer.
  * @param frame AVFrame to convert into RGB buffer.
@@ -313,32 +629,186 @@ bool VideoDecoder::seekToTimestamp(int64_t timestamp_in_microseconds) {
  * write the converted RGB data into.
  */
 void VideoDecoder::convertAVFrameToRGBBuffer(const AVFrame *frame, uint8_t *rgb_buffer) {
+    FrameOutput output;
+    output.data = rgb_buffer;
+    convertAVFrame(frame, output);
+}
+
+/**
+ * Converts (a region of) an AVFrame to RGB and writes it into a caller-provided buffer as described
+ * by an output descriptor.
+ * @param frame AVFrame to convert.
+ * @param output Describes the destination buffer and the region of the frame to convert.
+ */
+void VideoDecoder::convertAVFrame(const AVFrame *frame, const FrameOutput &output) {
+    ScopedStageTimer timer(m_convert_counter, m_stats_enabled.load(std::memory_order_relaxed));
+    const auto source_format = static_cast<AVPixelFormat>(frame->format);
+    const AVPixFmtDescriptor *descriptor = av_pix_fmt_desc_get(source_format);
+    if (!descriptor) {
+        throw std::runtime_error("unsupported pixel format");
+    }
+
+    // Resolve the crop rectangle, snapping its origin to the chroma subsampling grid.
+    FrameRect crop = output.crop;
+    if (crop.width <= 0 || crop.height <= 0) {
+        crop = {0, 0, frame->width, frame->height};
+    }
+    crop.x &= ~((1 << descriptor->log2_chroma_w) - 1);
+    crop.y &= ~((1 << descriptor->log2_chroma_h) - 1);
+    if (crop.x < 0 || crop.y < 0 || crop.x + crop.width > frame->width || crop.y + crop.height > frame->height) {
+        throw std::runtime_error("crop rectangle exceeds frame");
+    }
 
-    // Create a scaling context.
-    SwsContext *sws_ctx = sws_getContext(
-            frame->width, frame->height, (AVPixelFormat) frame->format,     // source width, height, and pixel format.
-            frame->width, frame->height,
-            AV_PIX_FMT_RGB24,                                               // destination width, height, and pixel format.
-            SWS_BICUBIC, nullptr, nullptr, nullptr                          // scaling method and additional parameters.
+    // Point the source planes at the crop origin, so that only the cropped region is converted.
+    const uint8_t *source[4] = {frame->data[0], frame->data[1], frame->data[2], frame->data[3]};
+    if (crop.x || crop.y) {
+        if (descriptor->flags & (AV_PIX_FMT_FLAG_BITSTREAM | AV_PIX_FMT_FLAG_PAL)) {
+            throw std::runtime_error("cropping is unsupported for this pixel format");
+        }
+
+        bool plane_offset[4] = {false, false, false, false};
+        for (int i = 0; i < descriptor->nb_components; i++) {
+            const AVComponentDescriptor &component = descriptor->comp[i];
+            if (plane_offset[component.plane]) {
+                continue;
+            }
+
+            // Chroma components (1 and 2) of YUV formats are subsampled; luma, alpha and RGB aren't.
+            const bool chroma = !(descriptor->flags & AV_PIX_FMT_FLAG_RGB) && (i == 1 || i == 2);
+            const int x = chroma ? crop.x >> descriptor->log2_chroma_w : crop.x;
+            const int y = chroma ? crop.y >> descriptor->log2_chroma_h : crop.y;
+            source[component.plane] += static_cast<ptrdiff_t>(y) * frame->linesize[component.plane] +
+                static_cast<ptrdiff_t>(x) * component.step;
+            plane_offset[component.plane] = true;
+        }
+    }
+
+    // Resolve the size of the output, which is smaller than the region when downscaling.
+    const int downscale = output.downscale > 0 ? output.downscale : 1;
+    const int output_width = crop.width / downscale;
+    const int output_height = crop.height / downscale;
+    if (output_width == 0 || output_height == 0) {
+        throw std::runtime_error("downscale factor exceeds crop rectangle");
+    }
+
+    // Define the (offset) output buffer as the destination.
+    int bytes_per_pixel;
+    AVPixelFormat output_format;
+    switch (output.format) {
+        case FrameOutputFormat::GRAY8:
+            bytes_per_pixel = 1; output_format = AV_PIX_FMT_GRAY8;
+            break;
+        case FrameOutputFormat::RGB48:
+            bytes_per_pixel = 6; output_format = AV_PIX_FMT_RGB48;
+            break;
+        case FrameOutputFormat::RGBA64:
+            bytes_per_pixel = 8; output_format = AV_PIX_FMT_RGBA64;
+            break;
+        case FrameOutputFormat::RGBF32:
+            bytes_per_pixel = 12; output_format = AV_PIX_FMT_NONE;
+            break;
+        default:
+            bytes_per_pixel = 3; output_format = AV_PIX_FMT_RGB24;
+            break;
+    }
+    const int stride = output.stride > 0 ? output.stride : bytes_per_pixel * output_width;
+    uint8_t *dest[1] = {output.data + static_cast<ptrdiff_t>(output.y) * stride + bytes_per_pixel * output.x};
+    int dest_linesize[1] = {stride};
+
+    // 16-bit and float samples are written as such, so rows must start on a sample boundary.
+    const int sample_size = output.format == FrameOutputFormat::RGBF32 ? 4 :
+        output.format == FrameOutputFormat::RGB48 || output.format == FrameOutputFormat::RGBA64 ? 2 : 1;
+    if (reinterpret_cast<uintptr_t>(dest[0]) % sample_size != 0 || stride % sample_size != 0) {
+        throw std::runtime_error("output buffer or stride isn't aligned to the output's sample size");
+    }
+    timer.addBytes(static_cast<uint64_t>(bytes_per_pixel) * output_width * output_height);
+
+    // Luma of 8-bit YUV sources is already what we need: copy or downscale it without touching chroma.
+    if (output.format == FrameOutputFormat::GRAY8 && hasDirectLumaPlane(descriptor)) {
+        downscaleLumaPlane(source[0], frame->linesize[0], dest[0], stride, output_width, output_height, downscale);
+        return;
+    }
+
+    // Convert YUV to high precision RGB directly, so 10- and 12-bit sources never pass through 8 bits.
+    const bool high_precision = output.format == FrameOutputFormat::RGB48 ||
+        output.format == FrameOutputFormat::RGBA64 || output.format == FrameOutputFormat::RGBF32;
+    if (high_precision && downscale == 1 && isYuvToRgbSupported(descriptor)) {
+        const YuvToRgbCoefficients coefficients = getYuvToRgbCoefficients(
+            frame->colorspace, frame->color_range, descriptor->comp[0].depth, frame->height);
+        convertYuvToRgb(source, frame->linesize, descriptor, coefficients, crop.width, crop.height, dest[0], stride,
+            output.format);
+        return;
+    }
+    if (output_format == AV_PIX_FMT_NONE) {
+        throw std::runtime_error("float output is unsupported for this pixel format or downscale factor");
+    }
+
+    // Reuse the scaling context of the previous frame unless the region's geometry or format changed.
+    m_sws_context = sws_getCachedContext(
+            m_sws_context,
+            crop.width, crop.height, source_format,                         // source width, height, and pixel format.
+            output_width, output_height, output_format,                     // destination width, height, and pixel format.
+            downscale > 1 ? SWS_AREA : SWS_BICUBIC, nullptr, nullptr, nullptr
+                                                                            // scaling method and additional parameters.
     );
 
-    if (!sws_ctx) {
+    if (!m_sws_context) {
         throw std::runtime_error("failed to create scaling context");
     }
-
-    // Define the RGB buffer as the destination for sws_scale.
-    uint8_t *dest[1] = {rgb_buffer};
-    int dest_linesize[1] = {3 * frame->width}; // RGB24 has 3 bytes per pixel.
+    applyColorspaceDetails(frame);
 
     // Perform the conversion.
     sws_scale(
-        sws_ctx,
-        frame->data, frame->linesize, 0, frame->height,
+        m_sws_context,
+        source, frame->linesize, 0, crop.height,
         dest, dest_linesize
     );
+}
 
-    // Free the scaling context.
-    sws_freeContext(sws_ctx);
+/**
+ * Checks whether the first plane of frames in a pixel format holds 8-bit luma samples that can be
+ * used as grayscale output as they are.
+ * @param descriptor Descriptor of the pixel format.
+ */
+bool VideoDecoder::hasDirectLumaPlane(const AVPixFmtDescriptor *descriptor) {
+    const AVComponentDescriptor &luma = descriptor->comp[0];
+    return !(descriptor->flags & (AV_PIX_FMT_FLAG_RGB | AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_BITSTREAM |
+        AV_PIX_FMT_FLAG_HWACCEL)) &&
+        luma.plane == 0 && luma.step == 1 && luma.offset == 0 && luma.shift == 0 && luma.depth == 8;
+}
+
+/**
+ * Makes the scaling context convert YUV with the matrix coefficients and range of a frame, instead
+ * of swscale's BT.601 limited range default.
+ * @param frame Frame about to be converted.
+ */
+void VideoDecoder::applyColorspaceDetails(const AVFrame *frame) {
+    int *source_table;
+    int *destination_table;
+    int source_range, destination_range, brightness, contrast, saturation;
+    if (sws_getColorspaceDetails(m_sws_context, &source_table, &source_range, &destination_table, &destination_range,
+        &brightness, &contrast, &saturation) < 0) {
+
+        // YUV and grayscale destinations have no YUV to RGB matrix to set.
+        return;
+    }
+
+    // Unspecified matrices get the same guess as the high precision kernels. Full range (yuvj) pixel
+    // formats already made swscale pick full range, which an unspecified frame range must not undo.
+    AVColorSpace colorspace = frame->colorspace;
+    if (colorspace == AVCOL_SPC_UNSPECIFIED) {
+        colorspace = frame->height >= 720 ? AVCOL_SPC_BT709 : AVCOL_SPC_BT470BG;
+    }
+    const int *coefficients = sws_getCoefficients(colorspace);
+    const int range = frame->color_range == AVCOL_RANGE_JPEG ? 1 :
+        frame->color_range == AVCOL_RANGE_MPEG ? 0 : source_range;
+
+    // Setting the details rebuilds swscale's tables, so only do it when they change.
+    if (range == source_range && std::equal(coefficients, coefficients + 4, source_table)) {
+        return;
+    }
+    sws_setColorspaceDetails(m_sws_context, coefficients, range, destination_table, destination_range,
+        brightness, contrast, saturation);
 }
 
 /**
@@ -1,5 +1,69 @@
 #include "video-encoder.h"
 
+#include "cpu-count.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+extern "C" {
+#include <libavutil/opt.h>
+#include <libavutil/pixdesc.h>
+}
+
+
+namespace {
+
+    /**
+     * Checks whether an encoder has a private option (e.g. "crf" or "preset").
+     */
+    bool hasPrivateOption(const AVCodec *codec, const char *name) {
+        return codec->priv_class &&
+            av_opt_find(const_cast<AVClass **>(&codec->priv_class), name, nullptr, 0, AV_OPT_SEARCH_FAKE_OBJ);
+    }
+
+    /**
+     * Returns the FFmpeg pixel format of an input format.
+     */
+    AVPixelFormat getPixelFormat(FrameInputFormat format) {
+        switch (format) {
+            case FrameInputFormat::I420:
+                return AV_PIX_FMT_YUV420P;
+            case FrameInputFormat::NV12:
+                return AV_PIX_FMT_NV12;
+            case FrameInputFormat::BGRA:
+                return AV_PIX_FMT_BGRA;
+            case FrameInputFormat::RGBA:
+                return AV_PIX_FMT_RGBA;
+            case FrameInputFormat::RGB24:
+                return AV_PIX_FMT_RGB24;
+        }
+        throw std::runtime_error("Unsupported input format");
+    }
+
+    /**
+     * Maximum number of scaling contexts an encoder keeps. Beyond this, all are dropped and rebuilt
+     * as needed.
+     */
+    constexpr size_t MAX_SCALERS = 4;
+
+    /**
+     * Frames of this many pixels or more (on either side of a conversion) are scaled with slice
+     * threads by default.
+     */
+    constexpr int64_t THREADED_SCALING_PIXELS = int64_t{1280} * 720;
+
+    /**
+     * Maximum number of frames the encoder's frame pool is warmed up with.
+     */
+    constexpr int MAX_RESERVED_FRAMES = 16;
+
+    /**
+     * Frees a buffer owned by the caller: nothing to do.
+     */
+    void keepBuffer(void *, uint8_t *) {}
+}
+
 
 /**
  * Initializes the encoder with the specified parameters.
@@ -11,89 +75,171 @@
  * @param bitrate Bitrate of the output video in bits per second.
  */
 VideoEncoder::VideoEncoder(const std::string &filepath, int width, int height, double fps, int64_t bitrate)
+    : VideoEncoder(filepath, width, height, fps, bitrate, VideoEncoderOptions{}) {
+}
+
+
+/**
+ * Initializes the encoder with the specified parameters and encoding options.
+ *
+ * @param filepath Path to the output video file.
+ * @param width Width of the output video in pixels.
+ * @param height Height of the output video in pixels.
+ * @param fps Frames per second of the output video.
+ * @param bitrate Bitrate of the output video in bits per second.
+ * @param options Options controlling how the video stream is encoded.
+ */
+VideoEncoder::VideoEncoder(const std::string &filepath, int width, int height, double fps, int64_t bitrate,
+    const VideoEncoderOptions &options)
     : m_format_context(nullptr), m_codec_context(nullptr), m_stream(nullptr), m_frame(nullptr), m_packet(nullptr),
-    m_sws_context(nullptr), m_finalized(false), m_pts(0) {
+    m_input_frame(nullptr), m_scaler_threads(options.scaler_threads), m_finalized(false), m_pts(0), m_stats_enabled(false),
+    m_convert_counter("convert"), m_encode_counter("encode"), m_mux_counter("mux") {
 
-    // Initialize the format context.
-    avformat_alloc_output_context2(&m_format_context, nullptr, nullptr, filepath.c_str());
-    if (!m_format_context) {
-        throw std::runtime_error("Could not allocate output format context");
-    }
+    try {
 
-    // Open the output file.
-    if (!(m_format_context->oformat->flags & AVFMT_NOFILE)) {
-        if (avio_open(&m_format_context->pb, filepath.c_str(), AVIO_FLAG_WRITE) < 0) {
-            throw std::runtime_error("Could not open output file");
+        // Initialize the format context.
+        avformat_alloc_output_context2(&m_format_context, nullptr, nullptr, filepath.c_str());
+        if (!m_format_context) {
+            throw std::runtime_error("Could not allocate output format context");
         }
-    }
 
-    // Find the encoder.
-    const AVCodec *codec = avcodec_find_encoder(m_format_context->oformat->video_codec);
+        // Open the output file.
+        if (!(m_format_context->oformat->flags & AVFMT_NOFILE)) {
+            if (avio_open(&m_format_context->pb, filepath.c_str(), AVIO_FLAG_WRITE) < 0) {
+                throw std::runtime_error("Could not open output file");
+            }
+        }
 
-    if (!codec) {
-        throw std::runtime_error("Could not find encoder");
-    }
+        // Find the encoder, and make sure the container can hold its output.
+        const AVCodec *codec = options.codec_name.empty() ?
+            avcodec_find_encoder(m_format_context->oformat->video_codec) :
+            avcodec_find_encoder_by_name(options.codec_name.c_str());
 
-    // Create a new stream.
-    m_stream = avformat_new_stream(m_format_context, nullptr);
-    if (!m_stream) {
-        throw std::runtime_error("Could not create new stream");
-    }
+        if (!codec || codec->type != AVMEDIA_TYPE_VIDEO) {
+            throw std::runtime_error("Could not find encoder");
+        }
+        if (avformat_query_codec(m_format_context->oformat, codec->id, FF_COMPLIANCE_NORMAL) == 0) {
+            throw std::runtime_error("Codec not supported by the output format");
+        }
 
-    // Allocate codec context.
-    m_codec_context = avcodec_alloc_context3(codec);
-    if (!m_codec_context) {
-        throw std::runtime_error("Could not allocate video codec context");
-    }
+        // Create a new stream.
+        m_stream = avformat_new_stream(m_format_context, nullptr);
+        if (!m_stream) {
+            throw std::runtime_error("Could not create new stream");
+        }
 
-    // Set codec parameters.
-    m_codec_context->width = width;
-    m_codec_context->height = height;
-    m_codec_context->time_base = AVRational{1000, static_cast<int>(lround(fps * 1000))};
-    m_codec_context->framerate = av_d2q(fps, 100000);
-    m_codec_context->gop_size = 12;
-    m_codec_context->pix_fmt = AV_PIX_FMT_YUV420P;
-    m_codec_context->bit_rate = bitrate;
-
-    if (m_format_context->oformat->flags & AVFMT_GLOBALHEADER) {
-        m_codec_context->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
-    }
+        // Allocate codec context.
+        m_codec_context = avcodec_alloc_context3(codec);
+        if (!m_codec_context) {
+            throw std::runtime_error("Could not allocate video codec context");
+        }
 
-    // Open codec.
-    if (avcodec_open2(m_codec_context, codec, nullptr) < 0) {
-        throw std::runtime_error("Could not open codec");
-    }
+        // Set codec parameters.
+        m_codec_context->width = width;
+        m_codec_context->height = height;
+        m_codec_context->time_base = AVRational{1000, static_cast<int>(lround(fps * 1000))};
+        m_codec_context->framerate = av_d2q(fps, 100000);
+        m_codec_context->gop_size = options.gop_size;
+        m_codec_context->pix_fmt = AV_PIX_FMT_YUV420P;
+        m_codec_context->bit_rate = bitrate;
+        m_codec_context->thread_count = options.thread_count > 0 ? options.thread_count : getAvailableCpuCount();
+        if (options.thread_type == EncoderThreadType::FRAME) {
+            m_codec_context->thread_type = FF_THREAD_FRAME;
+        } else if (options.thread_type == EncoderThreadType::SLICE) {
+            m_codec_context->thread_type = FF_THREAD_SLICE;
+        }
 
-    // Copy codec parameters to stream.
-    if (avcodec_parameters_from_context(m_stream->codecpar, m_codec_context) < 0) {
-        throw std::runtime_error("Could not copy codec parameters to stream");
-    }
+        // Collect the encoder options. Named options go last so they take precedence.
+        AVDictionary *codec_options = nullptr;
+        for (const auto &[name, value] : options.codec_options) {
+            av_dict_set(&codec_options, name.c_str(), value.c_str(), 0);
+        }
+        if (!options.preset.empty()) {
+            av_dict_set(&codec_options, "preset", options.preset.c_str(), 0);
+        }
+        if (!options.tune.empty()) {
+            av_dict_set(&codec_options, "tune", options.tune.c_str(), 0);
+        }
+        if (!options.profile.empty()) {
+            av_dict_set(&codec_options, "profile", options.profile.c_str(), 0);
+        }
 
-    m_stream->time_base = m_codec_context->time_base;
+        // Constant quality. Encoders without CRF or QP options get a fixed quantizer instead.
+        const int quantizer = options.qp >= 0 ? options.qp : options.crf;
+        const char *quality_option = options.qp >= 0 ? "qp" : "crf";
+        if (quantizer >= 0) {
+            m_codec_context->bit_rate = 0;
+            if (hasPrivateOption(codec, quality_option)) {
+                av_dict_set_int(&codec_options, quality_option, quantizer, 0);
+            } else {
+                m_codec_context->flags |= AV_CODEC_FLAG_QSCALE;
+                m_codec_context->global_quality = quantizer * FF_QP2LAMBDA;
+                m_codec_context->qmin = quantizer;
+                m_codec_context->qmax = quantizer;
+            }
+        }
 
-    // Write the header.
-    if (avformat_write_header(m_format_context, nullptr) < 0) {
-        throw std::runtime_error("Could not write format header");
-    }
+        // libx264 turns scene change detection off at 0, the MPEG-4 part 2 encoder (and its relatives)
+        // only at a huge threshold.
+        if (!options.scene_cut_keyframes && hasPrivateOption(codec, "sc_threshold")) {
+            av_dict_set(&codec_options, "sc_threshold", codec->id == AV_CODEC_ID_H264 ? "0" : "1000000000", 0);
+        }
 
-    // Allocate frame.
-    m_frame = av_frame_alloc();
-    if (!m_frame) {
-        throw std::runtime_error("Could not allocate video frame");
-    }
+        if (m_format_context->oformat->flags & AVFMT_GLOBALHEADER) {
+            m_codec_context->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+        }
 
-    m_frame->format = m_codec_context->pix_fmt;
-    m_frame->width = width;
-    m_frame->height = height;
+        // Open codec. Options the codec used are removed from the dictionary; any left are unknown to it.
+        const int open_result = avcodec_open2(m_codec_context, codec, &codec_options);
+        const AVDictionaryEntry *unknown_option = av_dict_get(codec_options, "", nullptr, AV_DICT_IGNORE_SUFFIX);
+        const std::string unknown_option_name = unknown_option ? unknown_option->key : "";
+        av_dict_free(&codec_options);
+        if (open_result < 0) {
+            throw std::runtime_error("Could not open codec");
+        }
+        if (!unknown_option_name.empty()) {
+            throw std::runtime_error("Unknown codec option: " + unknown_option_name);
+        }
 
-    if (av_frame_get_buffer(m_frame, 32) < 0) {
-        throw std::runtime_error("Could not allocate frame buffer");
-    }
+        // Copy codec parameters to stream.
+        if (avcodec_parameters_from_context(m_stream->codecpar, m_codec_context) < 0) {
+            throw std::runtime_error("Could not copy codec parameters to stream");
+        }
+
+        m_stream->time_base = m_codec_context->time_base;
 
-    // Allocate packet.
-    m_packet = av_packet_alloc();
-    if (!m_packet) {
-        throw std::runtime_error("Could not allocate packet");
+        // Write the header.
+        if (avformat_write_header(m_format_context, nullptr) < 0) {
+            throw std::runtime_error("Could not write format header");
+        }
+
+        // Allocate frame. Its buffers come from the pool, a fresh one for every input frame.
+        m_frame = av_frame_alloc();
+        if (!m_frame) {
+            throw std::runtime_error("Could not allocate video frame");
+        }
+
+        // Warm the pool up for the frames the codec keeps referenced while it works on later ones:
+        // those of its frame threads, plus the one being converted. Codecs that hold on to frames for
+        // longer (e.g. for lookahead) grow the pool to their delay on their own.
+        const int frame_threads = m_codec_context->active_thread_type & FF_THREAD_FRAME ?
+            m_codec_context->thread_count : 0;
+        m_frame_pool.reserve(std::min(frame_threads + 1, MAX_RESERVED_FRAMES), m_codec_context->pix_fmt, width, height);
+
+        // Allocate packet.
+        m_packet = av_packet_alloc();
+        if (!m_packet) {
+            throw std::runtime_error("Could not allocate packet");
+        }
+
+        // Allocate the frame describing caller-owned input planes for scaling.
+        m_input_frame = av_frame_alloc();
+        if (!m_input_frame) {
+            throw std::runtime_error("Could not allocate input frame");
+        }
+    } catch (const std::runtime_error &) {
+        close();
+        throw;
     }
 }
 
@@ -104,9 +250,21 @@ VideoEncoder::VideoEncoder(const std::string &filepath, int width, int height, d
  */
 VideoEncoder::~VideoEncoder() {
     finalize();  // Ensure finalization before cleanup
+    close();
+}
 
-    if (m_sws_context) {
-        sws_freeContext(m_sws_context);
+
+/**
+ * Frees the scaling contexts, frames, packet, and codec context, and closes the output file. Nothing
+ * is flushed or written.
+ */
+void VideoEncoder::close() {
+    for (const auto &[key, sws_context] : m_sws_contexts) {
+        sws_freeContext(sws_context);
+    }
+    m_sws_contexts.clear();
+    if (m_input_frame) {
+        av_frame_free(&m_input_frame);
     }
     if (m_frame) {
         av_frame_free(&m_frame);
@@ -122,6 +280,7 @@ VideoEncoder::~VideoEncoder() {
             avio_closep(&m_format_context->pb);
         }
         avformat_free_context(m_format_context);
+        m_format_context = nullptr;
     }
 }
 
@@ -135,38 +294,29 @@ VideoEncoder::~VideoEncoder() {
  * @param height Height of the input frame in pixels.
  */
 void VideoEncoder::encodeFrame(const uint8_t *rgb_buffer, int width, int height) {
+    FrameInput input;
+    input.data[0] = rgb_buffer;
+    input.width = width;
+    input.height = height;
+    input.format = FrameInputFormat::RGB24;
+    encodeFrame(input);
+}
 
-    // Initialize the scaling context if necessary.
-    if (!m_sws_context || width != m_frame->width || height != m_frame->height) {
-        sws_freeContext(m_sws_context);
-        m_sws_context = sws_getContext(
-            width, height, AV_PIX_FMT_RGB24,                                // Source dimensions and format.
-            m_frame->width, m_frame->height, m_codec_context->pix_fmt,      // Destination dimensions and format.
-            SWS_BICUBIC, nullptr, nullptr, nullptr
-        );
-        if (!m_sws_context) {
-            throw std::runtime_error("Failed to create scaling context");
-        }
-    }
-
-    // Convert RGB to YUV and scale.
-    uint8_t *src_slices[1] = {const_cast<uint8_t *>(rgb_buffer)};
-    int src_stride[1] = {3 * width};                                        // RGB24 has 3 bytes per pixel.
-
-    sws_scale(
-        m_sws_context,
-
-        src_slices,
-        src_stride,
-        0,
-        height,
-
-        m_frame->data,
-        m_frame->linesize
-    );
 
-    // Encode the frame.
-    encodeFrame(m_frame);
+/**
+ * Encodes a frame in one of several pixel formats, described plane by plane with strides. A frame
+ * that already has the output video's dimensions and pixel format (I420, i.e. YUV 4:2:0) is copied
+ * as is, without any conversion; any other frame is converted and resized as needed.
+ *
+ * @param input Format, dimensions, planes, and strides of the frame. The planes are only read
+ * during the call.
+ */
+void VideoEncoder::encodeFrame(const FrameInput &input) {
+    const uint8_t *src_data[4];
+    int src_stride[4];
+    AVPixelFormat format;
+    const uint64_t src_bytes = getInputPlanes(input, src_data, src_stride, format);
+    encodePlanes(src_data, src_stride, input.width, input.height, format, src_bytes);
 }
 
 
@@ -178,14 +328,16 @@ void VideoEncoder::finalize() {
     if (!m_finalized) {
 
         // Flush the encoder.
-        avcodec_send_frame(m_codec_context, nullptr);
+        {
+            ScopedStageTimer timer(m_encode_counter, m_stats_enabled.load(std::memory_order_relaxed));
+            avcodec_send_frame(m_codec_context, nullptr);
+        }
         while (true) {
-            int ret = avcodec_receive_packet(m_codec_context, m_packet);
+            int ret = receivePacket();
             if (ret == AVERROR_EOF || ret == AVERROR(EAGAIN)) {
                 break;
             }
-            av_interleaved_write_frame(m_format_context, m_packet);
-            av_packet_unref(m_packet);
+            writePacket();
         }
 
         // Write the trailer.
@@ -197,8 +349,200 @@ void VideoEncoder::finalize() {
 
 
 /**
- * Encodes a YUV frame (as an AVFrame) without any colorspace conversion. However,
- * the frame is resized to output video dimensions as needed before encoding.
+ * Turns timing of the convert, encode, and mux stages on or off. Stats are off by default; while
+ * they are off, the instrumentation costs a branch per stage call. Can be called from any thread.
+ *
+ * @param enabled Whether to record stage stats.
+ */
+void VideoEncoder::setStatsEnabled(bool enabled) {
+    m_stats_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+
+/**
+ * Returns the stats recorded so far. Can be polled from any thread while the encoder is in use.
+ *
+ * @return Call counts, cumulative time, bytes, and latency histograms of each stage.
+ */
+[[nodiscard]] EncoderStats VideoEncoder::getStats() const {
+    EncoderStats stats;
+    stats.convert = m_convert_counter.getStats();
+    stats.encode = m_encode_counter.getStats();
+    stats.mux = m_mux_counter.getStats();
+    stats.frame_allocations = m_frame_pool.getAllocationCount();
+    return stats;
+}
+
+
+/**
+ * Sets all recorded stage stats back to zero; the frame allocation count keeps counting. Can be
+ * called from any thread.
+ */
+void VideoEncoder::resetStats() {
+    m_convert_counter.reset();
+    m_encode_counter.reset();
+    m_mux_counter.reset();
+}
+
+
+/**
+ * Checks a frame description and gathers its planes, filling in the strides of tightly packed ones.
+ *
+ * @param input Frame description.
+ * @param src_data Receives the start of each plane; unused entries are null.
+ * @param src_stride Receives the line size of each plane in bytes; unused entries are 0.
+ * @param format Receives the FFmpeg pixel format of the frame.
+ * @return Size of the planes in bytes.
+ */
+uint64_t VideoEncoder::getInputPlanes(const FrameInput &input, const uint8_t *src_data[4], int src_stride[4],
+    AVPixelFormat &format) {
+    if (input.width <= 0 || input.height <= 0) {
+        throw std::runtime_error("Invalid input frame dimensions");
+    }
+
+    format = getPixelFormat(input.format);
+    int packed_stride[4];
+    if (av_image_fill_linesizes(packed_stride, format, input.width) < 0) {
+        throw std::runtime_error("Invalid input frame dimensions");
+    }
+
+    uint64_t src_bytes = 0;
+    for (int plane = 0; plane < 4; plane++) {
+        src_data[plane] = nullptr;
+        src_stride[plane] = 0;
+    }
+    for (int plane = 0; plane < av_pix_fmt_count_planes(format); plane++) {
+        if (!input.data[plane]) {
+            throw std::runtime_error("Missing input frame plane");
+        }
+        src_data[plane] = input.data[plane];
+        src_stride[plane] = input.stride[plane] > 0 ? input.stride[plane] : packed_stride[plane];
+
+        // All multi-plane input formats are 4:2:0, with half-height chroma planes.
+        const int rows = plane == 0 ? input.height : (input.height + 1) / 2;
+        src_bytes += static_cast<uint64_t>(src_stride[plane]) * rows;
+    }
+    return src_bytes;
+}
+
+
+/**
+ * Copies or converts a frame given as planes into the encoder's frame, then encodes it. Frames in
+ * the output video's dimensions and pixel format are copied, any others converted and resized.
+ *
+ * @param src_data Start of each plane.
+ * @param src_stride Line size of each plane in bytes.
+ * @param width Width of the frame in pixels.
+ * @param height Height of the frame in pixels.
+ * @param format Pixel format of the frame; swscale must support it as input.
+ * @param src_bytes Size of the planes in bytes, for the stage stats.
+ */
+void VideoEncoder::encodePlanes(const uint8_t *const src_data[4], const int src_stride[4], int width, int height,
+    AVPixelFormat format, uint64_t src_bytes) {
+    const bool native = format == m_codec_context->pix_fmt &&
+        width == m_codec_context->width && height == m_codec_context->height;
+    SwsContext *sws_context = native ? nullptr : getScaler(width, height, format);
+
+    // The codec may still hold references to the buffers of previous frames, so convert into a
+    // fresh one instead of overwriting them.
+    av_frame_unref(m_frame);
+    getFrameBuffer(m_frame);
+
+    // Copy a frame already in the output format, convert and scale any other. The input planes are
+    // wrapped in a frame whose buffer doesn't own them, which lets swscale run its slice threads.
+    {
+        ScopedStageTimer timer(m_convert_counter, m_stats_enabled.load(std::memory_order_relaxed));
+        timer.addBytes(src_bytes);
+        if (native) {
+            av_image_copy(m_frame->data, m_frame->linesize, src_data, src_stride, format, width, height);
+        } else {
+            m_input_frame->format = format;
+            m_input_frame->width = width;
+            m_input_frame->height = height;
+            for (int plane = 0; plane < 4; plane++) {
+                m_input_frame->data[plane] = const_cast<uint8_t *>(src_data[plane]);
+                m_input_frame->linesize[plane] = src_stride[plane];
+            }
+            m_input_frame->buf[0] = av_buffer_create(const_cast<uint8_t *>(src_data[0]), src_bytes, keepBuffer,
+                nullptr, AV_BUFFER_FLAG_READONLY);
+            if (!m_input_frame->buf[0]) {
+                throw std::runtime_error("Could not allocate input frame buffer");
+            }
+            const int scale_result = sws_scale_frame(sws_context, m_frame, m_input_frame);
+            av_frame_unref(m_input_frame);
+            if (scale_result < 0) {
+                throw std::runtime_error("Failed to scale input frame");
+            }
+        }
+    }
+
+    // Encode the frame.
+    encodeFrame(m_frame);
+}
+
+
+/**
+ * Fills a blank frame with a writable buffer of the output video's dimensions and pixel format from
+ * the encoder's frame pool. The buffer goes back to the pool once the codec releases it.
+ *
+ * @param frame Frame without buffers.
+ */
+void VideoEncoder::getFrameBuffer(AVFrame *frame) {
+    m_frame_pool.getFrame(frame, m_codec_context->pix_fmt, m_codec_context->width, m_codec_context->height);
+}
+
+
+/**
+ * Returns the scaling context converting frames of an input size and pixel format to the output
+ * video's, creating it on first use. A few contexts are kept, so sources alternating between
+ * sizes or formats don't rebuild them on every frame.
+ */
+SwsContext *VideoEncoder::getScaler(int width, int height, AVPixelFormat format) {
+    const ScalerKey key{width, height, format};
+    const auto cached = m_sws_contexts.find(key);
+    if (cached != m_sws_contexts.end()) {
+        return cached->second;
+    }
+    if (m_sws_contexts.size() >= MAX_SCALERS) {
+        for (const auto &[old_key, sws_context] : m_sws_contexts) {
+            sws_freeContext(sws_context);
+        }
+        m_sws_contexts.clear();
+    }
+
+    // Large frames are split into slices scaled in parallel.
+    int threads = m_scaler_threads;
+    if (threads <= 0) {
+        const int64_t pixels = std::max(int64_t{width} * height,
+            int64_t{m_codec_context->width} * m_codec_context->height);
+        threads = pixels >= THREADED_SCALING_PIXELS ? std::min(getAvailableCpuCount(), 4) : 1;
+    }
+
+    SwsContext *sws_context = sws_alloc_context();
+    if (!sws_context) {
+        throw std::runtime_error("Failed to create scaling context");
+    }
+    av_opt_set_int(sws_context, "srcw", width, 0);
+    av_opt_set_int(sws_context, "srch", height, 0);
+    av_opt_set_int(sws_context, "src_format", format, 0);
+    av_opt_set_int(sws_context, "dstw", m_codec_context->width, 0);
+    av_opt_set_int(sws_context, "dsth", m_codec_context->height, 0);
+    av_opt_set_int(sws_context, "dst_format", m_codec_context->pix_fmt, 0);
+    av_opt_set_int(sws_context, "sws_flags", SWS_BICUBIC, 0);
+    av_opt_set_int(sws_context, "threads", threads, 0);
+    if (sws_init_context(sws_context, nullptr, nullptr) < 0) {
+        sws_freeContext(sws_context);
+        throw std::runtime_error("Failed to create scaling context");
+    }
+
+    m_sws_contexts.emplace(key, sws_context);
+    return sws_context;
+}
+
+
+/**
+ * Encodes a YUV frame (as an AVFrame) without any colorspace conversion or resizing. The frame
+ * must already have the output video's dimensions and pixel format. Its timestamp is overwritten.
  *
  * @param frame Pointer to the AVFrame representing the YUV frame to be encoded.
  */
@@ -211,12 +555,15 @@ void VideoEncoder::encodeFrame(AVFrame* frame) {
 
     // Send the frame to the encoder.
     while (true) {
-        ret = avcodec_send_frame(m_codec_context, frame);
+        {
+            ScopedStageTimer timer(m_encode_counter, m_stats_enabled.load(std::memory_order_relaxed));
+            ret = avcodec_send_frame(m_codec_context, frame);
+        }
         if (ret == AVERROR(EAGAIN)) {
 
             // The encoder cannot accept new frames until we receive more packets.
             while (true) {
-                ret = avcodec_receive_packet(m_codec_context, m_packet);
+                ret = receivePacket();
                 if (ret == AVERROR(EAGAIN)) {
 
                     // No more packets to receive, break out of the loop.
@@ -230,8 +577,7 @@ void VideoEncoder::encodeFrame(AVFrame* frame) {
                 }
 
                 // Write the encoded packet to the output file.
-                av_interleaved_write_frame(m_format_context, m_packet);
-                av_packet_unref(m_packet);
+                writePacket();
             }
         } else if (ret == AVERROR_EOF) {
 
@@ -248,7 +594,7 @@ void VideoEncoder::encodeFrame(AVFrame* frame) {
 
     // Receive all available packets from the encoder after sending a frame.
     while (true) {
-        ret = avcodec_receive_packet(m_codec_context, m_packet);
+        ret = receivePacket();
         if (ret == AVERROR(EAGAIN)) {
 
             // No more packets available right now, return.
@@ -262,7 +608,28 @@ void VideoEncoder::encodeFrame(AVFrame* frame) {
         }
 
         // Write the encoded packet to the output file.
-        av_interleaved_write_frame(m_format_context, m_packet);
-        av_packet_unref(m_packet);
+        writePacket();
     }
 }
+
+
+/**
+ * Receives an encoded packet from the codec.
+ *
+ * @return The result of avcodec_receive_packet(...).
+ */
+int VideoEncoder::receivePacket() {
+    ScopedStageTimer timer(m_encode_counter, m_stats_enabled.load(std::memory_order_relaxed));
+    return avcodec_receive_packet(m_codec_context, m_packet);
+}
+
+
+/**
+ * Writes the received packet to the output file and unreferences it.
+ */
+void VideoEncoder::writePacket() {
+    ScopedStageTimer timer(m_mux_counter, m_stats_enabled.load(std::memory_order_relaxed));
+    timer.addBytes(m_packet->size);
+    av_interleaved_write_frame(m_format_context, m_packet);
+    av_packet_unref(m_packet);
+}
@@ -0,0 +1,110 @@
+#include "video-stream-info.h"
+
+#include <stdexcept>
+
+
+/**
+ * Constructs an empty VideoStreamInfo with freshly allocated codec parameters.
+ *
+ * @throws std::runtime_error If the codec parameters cannot be allocated.
+ */
+VideoStreamInfo::VideoStreamInfo()
+    : codec_parameters(avcodec_parameters_alloc()), stream_index(-1), time_base{0, 1}, avg_frame_rate{0, 1},
+    r_frame_rate{0, 1}, start_time(AV_NOPTS_VALUE), duration(AV_NOPTS_VALUE), format_start_time(AV_NOPTS_VALUE),
+    format_duration(AV_NOPTS_VALUE), format_bit_rate(0) {
+
+    if (!codec_parameters) {
+        throw std::runtime_error("couldn't allocate codec parameters");
+    }
+}
+
+
+/**
+ * Releases the codec parameters owned by the snapshot.
+ */
+VideoStreamInfo::~VideoStreamInfo() {
+    avcodec_parameters_free(&codec_parameters);
+}
+
+
+/**
+ * Captures the stream information of an already probed format context.
+ *
+ * @param format_context Format context that `avformat_find_stream_info` has been called on.
+ * @param stream_index Index of the video stream to capture.
+ * @return The captured stream information.
+ *
+ * @throws std::runtime_error If the codec parameters cannot be copied.
+ */
+std::shared_ptr<const VideoStreamInfo> VideoStreamInfo::capture(AVFormatContext *format_context, int stream_index) {
+    AVStream *stream = format_context->streams[stream_index];
+
+    auto info = std::make_shared<VideoStreamInfo>();
+    if (avcodec_parameters_copy(info->codec_parameters, stream->codecpar) < 0) {
+        throw std::runtime_error("couldn't copy codec parameters");
+    }
+
+    info->stream_index = stream_index;
+    info->time_base = stream->time_base;
+    info->avg_frame_rate = stream->avg_frame_rate;
+    info->r_frame_rate = stream->r_frame_rate;
+    info->start_time = stream->start_time;
+    info->duration = stream->duration;
+    info->format_start_time = format_context->start_time;
+    info->format_duration = format_context->duration;
+    info->format_bit_rate = format_context->bit_rate;
+
+    // Copy the seek index built so far, so that clones can seek without rebuilding it.
+    int entry_count = avformat_index_get_entries_count(stream);
+    info->index.reserve(entry_count);
+    for (int i = 0; i < entry_count; i++) {
+        const AVIndexEntry *entry = avformat_index_get_entry(stream, i);
+        info->index.push_back({entry->pos, entry->timestamp, entry->size, entry->min_distance, entry->flags});
+    }
+
+    return info;
+}
+
+
+/**
+ * Applies the snapshot to a freshly opened (but not yet probed) format context of the same file.
+ *
+ * @param format_context Format context returned by `avformat_open_input`.
+ * @return `true` if the snapshot matches the opened file and has been applied, `false` if the
+ * format context has to be probed the regular way.
+ */
+bool VideoStreamInfo::apply(AVFormatContext *format_context) const {
+
+    // Streams that are only discovered while probing can't be restored from a snapshot.
+    if (stream_index < 0 || static_cast<unsigned int>(stream_index) >= format_context->nb_streams) {
+        return false;
+    }
+
+    AVStream *stream = format_context->streams[stream_index];
+    if (stream->codecpar->codec_type != AVMEDIA_TYPE_VIDEO ||
+        stream->codecpar->codec_id != codec_parameters->codec_id ||
+        av_cmp_q(stream->time_base, time_base) != 0) {
+        return false;
+    }
+
+    if (avcodec_parameters_copy(stream->codecpar, codec_parameters) < 0) {
+        return false;
+    }
+
+    stream->avg_frame_rate = avg_frame_rate;
+    stream->r_frame_rate = r_frame_rate;
+    stream->start_time = start_time;
+    stream->duration = duration;
+    format_context->start_time = format_start_time;
+    format_context->duration = format_duration;
+    format_context->bit_rate = format_bit_rate;
+
+    // Restore the seek index unless the demuxer has already read a complete one from the file header.
+    if (avformat_index_get_entries_count(stream) < static_cast<int>(index.size())) {
+        for (const IndexEntry &entry : index) {
+            av_add_index_entry(stream, entry.position, entry.timestamp, entry.size, entry.distance, entry.flags);
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,289 @@
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "color-kernels.h"
+#include "luma-kernels.h"
+#include "test-utils.h"
+#include "video-decoder.h"
+
+
+namespace {
+
+    constexpr int WIDTH = 320;
+    constexpr int HEIGHT = 240;
+    constexpr int FRAMES = 12;
+
+    struct FrameDeleter {
+        void operator()(AVFrame *frame) const { av_frame_free(&frame); }
+    };
+    using FramePtr = std::unique_ptr<AVFrame, FrameDeleter>;
+
+    /**
+     * Encodes the test clip once per process and returns its path.
+     */
+    const std::string &getTestClip() {
+        static const std::string path = [] {
+            std::string clip_path = getTemporaryPath("conversion.mp4");
+            encodeTestClip(clip_path, WIDTH, HEIGHT, FRAMES, 24.0);
+            return clip_path;
+        }();
+        return path;
+    }
+
+    /**
+     * Decodes every frame of the test clip without conversion.
+     */
+    std::vector<FramePtr> decodeTestClip() {
+        VideoDecoder decoder(getTestClip());
+        std::vector<FramePtr> frames;
+        while (true) {
+            FramePtr frame(av_frame_alloc());
+            if (!frame || !decoder.getNextFrame(frame.get())) {
+                break;
+            }
+            frames.push_back(std::move(frame));
+        }
+        return frames;
+    }
+
+    /**
+     * Converts a frame to another pixel format and size with swscale.
+     * @param colorspace Matrix coefficients to convert YUV with (swscale's SWS_CS_* or AVColorSpace values).
+     * @param source_range Range of the source (0 limited, 1 full).
+     * @param destination_range Range of the destination (0 limited, 1 full).
+     */
+    FramePtr convertWithSwscale(const AVFrame *source, AVPixelFormat format, int width, int height, int flags,
+        int colorspace = SWS_CS_DEFAULT, int source_range = 0, int destination_range = 0) {
+        FramePtr destination(av_frame_alloc());
+        if (!destination) {
+            throw std::runtime_error("couldn't allocate frame");
+        }
+        destination->format = format;
+        destination->width = width;
+        destination->height = height;
+        if (av_frame_get_buffer(destination.get(), 0) < 0) {
+            throw std::runtime_error("couldn't allocate frame buffer");
+        }
+
+        SwsContext *context = sws_getContext(source->width, source->height, static_cast<AVPixelFormat>(source->format),
+            width, height, format, flags, nullptr, nullptr, nullptr);
+        if (!context) {
+            throw std::runtime_error("couldn't create scaling context");
+        }
+        const int *coefficients = sws_getCoefficients(colorspace);
+        sws_setColorspaceDetails(context, coefficients, source_range, coefficients, destination_range,
+            0, 1 << 16, 1 << 16);
+        sws_scale(context, source->data, source->linesize, 0, source->height, destination->data, destination->linesize);
+        sws_freeContext(context);
+        return destination;
+    }
+
+    /**
+     * Checks the SIMD luma kernel against the scalar reference on random planes of awkward sizes.
+     */
+    void checkLumaKernelsOnRandomData(bool &test_failed) {
+        std::mt19937 random(42);
+        for (int factor = 1; factor <= 8; factor++) {
+            for (int width : {1, 2, 7, 15, 16, 17, 31, 33, 64, 67}) {
+                const int height = 5;
+                const int source_stride = width * factor + 13;
+                std::vector<uint8_t> source(static_cast<size_t>(source_stride) * height * factor + 16);
+                for (uint8_t &sample : source) {
+                    sample = static_cast<uint8_t>(random());
+                }
+
+                std::vector<uint8_t> simd(static_cast<size_t>(width) * height);
+                std::vector<uint8_t> scalar(simd.size());
+                downscaleLumaPlane(source.data(), source_stride, simd.data(), width, width, height, factor);
+                downscaleLumaPlaneScalar(source.data(), source_stride, scalar.data(), width, width, height, factor);
+                CHECK(simd == scalar);
+            }
+        }
+    }
+
+    /**
+     * Checks per-frame checksums of the decoder's GRAY8 output (the SIMD luma path) against the scalar
+     * kernel applied to the same decoded frames, for every fast-path downscale factor.
+     */
+    void checkLumaOutputMatchesScalar(bool &test_failed) {
+        const std::vector<FramePtr> frames = decodeTestClip();
+        CHECK(frames.size() == FRAMES);
+
+        for (int factor : {1, 2, 4, 8}) {
+            const int width = WIDTH / factor;
+            const int height = HEIGHT / factor;
+            std::vector<uint8_t> luma(static_cast<size_t>(width) * height);
+            FrameOutput output;
+            output.data = luma.data();
+            output.format = FrameOutputFormat::GRAY8;
+            output.downscale = factor;
+
+            VideoDecoder decoder(getTestClip());
+            std::vector<uint8_t> reference(luma.size());
+            for (const FramePtr &frame : frames) {
+                CHECK(decoder.getNextFrame(output));
+                downscaleLumaPlaneScalar(frame->data[0], frame->linesize[0], reference.data(), width, width, height,
+                    factor);
+                CHECK(getChecksum(luma.data(), width, width, height) ==
+                    getChecksum(reference.data(), width, width, height));
+            }
+        }
+    }
+
+    /**
+     * Checks the luma kernels against swscale: a full-size GRAY8 conversion that keeps the source range
+     * must match exactly (up to rounding), and area downscaling closely.
+     */
+    void checkLumaOutputMatchesSwscale(bool &test_failed) {
+        const std::vector<FramePtr> frames = decodeTestClip();
+        for (const FramePtr &frame : frames) {
+            const FramePtr gray = convertWithSwscale(frame.get(), AV_PIX_FMT_GRAY8, WIDTH, HEIGHT,
+                SWS_POINT | SWS_ACCURATE_RND);
+            int max_difference = 0;
+            for (int y = 0; y < HEIGHT; y++) {
+                for (int x = 0; x < WIDTH; x++) {
+                    max_difference = std::max(max_difference, std::abs(
+                        frame->data[0][y * frame->linesize[0] + x] - gray->data[0][y * gray->linesize[0] + x]));
+                }
+            }
+            CHECK(max_difference <= 1);
+
+            for (int factor : {2, 4, 8}) {
+                const int width = WIDTH / factor;
+                const int height = HEIGHT / factor;
+                const FramePtr scaled = convertWithSwscale(gray.get(), AV_PIX_FMT_GRAY8, width, height,
+                    SWS_AREA | SWS_ACCURATE_RND);
+                std::vector<uint8_t> luma(static_cast<size_t>(width) * height);
+                downscaleLumaPlane(gray->data[0], gray->linesize[0], luma.data(), width, width, height, factor);
+
+                uint64_t total_difference = 0;
+                for (int y = 0; y < height; y++) {
+                    for (int x = 0; x < width; x++) {
+                        total_difference += std::abs(luma[y * width + x] - scaled->data[0][y * scaled->linesize[0] + x]);
+                    }
+                }
+                CHECK(static_cast<double>(total_difference) / (width * height) <= 2.0);
+            }
+        }
+    }
+
+    /**
+     * Checks the SIMD YUV to RGB kernels against the scalar reference on random 10-bit 4:2:0 planes of
+     * awkward widths, in every output format. Random samples include out-of-range ones, so clamping is
+     * covered as well.
+     */
+    void checkColorKernelsOnRandomData(bool &test_failed) {
+        const AVPixFmtDescriptor *descriptor = av_pix_fmt_desc_get(AV_PIX_FMT_YUV420P10LE);
+        CHECK(isYuvToRgbSupported(descriptor));
+        const YuvToRgbCoefficients coefficients =
+            getYuvToRgbCoefficients(AVCOL_SPC_BT709, AVCOL_RANGE_MPEG, 10, HEIGHT);
+
+        std::mt19937 random(42);
+        for (int width : {1, 2, 7, 8, 9, 15, 16, 17, 33, 67}) {
+            const int height = 5;
+            const int chroma_width = (width + 1) / 2;
+            std::vector<uint16_t> luma(static_cast<size_t>(width) * height);
+            std::vector<uint16_t> blue(static_cast<size_t>(chroma_width) * ((height + 1) / 2));
+            std::vector<uint16_t> red(blue.size());
+            for (std::vector<uint16_t> *plane : {&luma, &blue, &red}) {
+                for (uint16_t &sample : *plane) {
+                    sample = static_cast<uint16_t>(random() % 1024);
+                }
+            }
+            const uint8_t *planes[4] = {reinterpret_cast<const uint8_t *>(luma.data()),
+                reinterpret_cast<const uint8_t *>(blue.data()), reinterpret_cast<const uint8_t *>(red.data()), nullptr};
+            const int linesizes[4] = {width * 2, chroma_width * 2, chroma_width * 2, 0};
+
+            for (const auto &[format, bytes_per_pixel] : {std::pair{FrameOutputFormat::RGB48, 6},
+                std::pair{FrameOutputFormat::RGBA64, 8}, std::pair{FrameOutputFormat::RGBF32, 12}}) {
+                const int stride = width * bytes_per_pixel;
+                std::vector<float> simd(static_cast<size_t>(stride) * height / sizeof(float) + 1);
+                std::vector<float> scalar(simd.size());
+                convertYuvToRgb(planes, linesizes, descriptor, coefficients, width, height,
+                    reinterpret_cast<uint8_t *>(simd.data()), stride, format);
+                convertYuvToRgbScalar(planes, linesizes, descriptor, coefficients, width, height,
+                    reinterpret_cast<uint8_t *>(scalar.data()), stride, format);
+                CHECK(std::memcmp(simd.data(), scalar.data(), static_cast<size_t>(stride) * height) == 0);
+            }
+        }
+    }
+
+    /**
+     * Checks the high precision YUV to RGB kernels against swscale on 10-bit 4:4:4 frames (so chroma
+     * upsampling doesn't differ) for several matrices and ranges.
+     */
+    void checkColorKernelsMatchSwscale(bool &test_failed) {
+        struct Variant {
+            AVColorSpace colorspace;
+            AVColorRange range;
+        };
+        const Variant variants[] = {
+            {AVCOL_SPC_BT709, AVCOL_RANGE_MPEG},
+            {AVCOL_SPC_BT2020_NCL, AVCOL_RANGE_MPEG},
+            {AVCOL_SPC_SMPTE170M, AVCOL_RANGE_JPEG},
+        };
+        const AVPixFmtDescriptor *descriptor = av_pix_fmt_desc_get(AV_PIX_FMT_YUV444P10LE);
+        CHECK(isYuvToRgbSupported(descriptor));
+
+        const std::vector<FramePtr> frames = decodeTestClip();
+        for (const Variant &variant : variants) {
+            const int full_range = variant.range == AVCOL_RANGE_JPEG;
+            for (const FramePtr &frame : frames) {
+                const FramePtr yuv = convertWithSwscale(frame.get(), AV_PIX_FMT_YUV444P10LE, WIDTH, HEIGHT,
+                    SWS_POINT | SWS_ACCURATE_RND, SWS_CS_DEFAULT, 0, full_range);
+                const FramePtr rgb = convertWithSwscale(yuv.get(), AV_PIX_FMT_RGB48, WIDTH, HEIGHT,
+                    SWS_POINT | SWS_ACCURATE_RND | SWS_FULL_CHR_H_INT | SWS_FULL_CHR_H_INP, variant.colorspace,
+                    full_range, 1);
+
+                const YuvToRgbCoefficients coefficients =
+                    getYuvToRgbCoefficients(variant.colorspace, variant.range, 10, HEIGHT);
+                const uint8_t *planes[4] = {yuv->data[0], yuv->data[1], yuv->data[2], yuv->data[3]};
+                std::vector<uint16_t> rgb48(static_cast<size_t>(WIDTH) * HEIGHT * 3);
+                std::vector<float> rgbf32(rgb48.size());
+                convertYuvToRgb(planes, yuv->linesize, descriptor, coefficients, WIDTH, HEIGHT,
+                    reinterpret_cast<uint8_t *>(rgb48.data()), WIDTH * 6, FrameOutputFormat::RGB48);
+                convertYuvToRgb(planes, yuv->linesize, descriptor, coefficients, WIDTH, HEIGHT,
+                    reinterpret_cast<uint8_t *>(rgbf32.data()), WIDTH * 12, FrameOutputFormat::RGBF32);
+
+                // swscale's fixed point math is accurate to a fraction of a percent.
+                uint64_t total_difference = 0;
+                int max_difference = 0;
+                int max_float_difference = 0;
+                for (int y = 0; y < HEIGHT; y++) {
+                    const auto *expected = reinterpret_cast<const uint16_t *>(rgb->data[0] + y * rgb->linesize[0]);
+                    for (int i = 0; i < WIDTH * 3; i++) {
+                        const size_t index = static_cast<size_t>(y) * WIDTH * 3 + i;
+                        const int difference = std::abs(rgb48[index] - expected[i]);
+                        total_difference += difference;
+                        max_difference = std::max(max_difference, difference);
+
+                        const float clamped = std::clamp(rgbf32[index], 0.0f, 1.0f);
+                        max_float_difference = std::max(max_float_difference,
+                            std::abs(static_cast<int>(clamped * 65535.0f + 0.5f) - rgb48[index]));
+                    }
+                }
+                CHECK(static_cast<double>(total_difference) / (WIDTH * HEIGHT * 3) < 65535 * 0.005);
+                CHECK(max_difference < 65535 * 0.02);
+                CHECK(max_float_difference <= 1);
+            }
+        }
+    }
+}
+
+
+int main(int argc, char **argv) {
+    return runTests({
+        {"luma_kernels_random", checkLumaKernelsOnRandomData},
+        {"luma_output_scalar", checkLumaOutputMatchesScalar},
+        {"luma_output_swscale", checkLumaOutputMatchesSwscale},
+        {"color_kernels_random", checkColorKernelsOnRandomData},
+        {"color_kernels_swscale", checkColorKernelsMatchSwscale},
+    }, argc, argv);
+}
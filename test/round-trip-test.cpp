@@ -0,0 +1,1121 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "async-video-encoder.h"
+#include "cpu-count.h"
+#include "frame-allocator.h"
+#include "ladder-encoder.h"
+#include "packet-scanner.h"
+#include "probe-cache.h"
+#include "remuxer.h"
+#include "smart-cutter.h"
+#include "test-utils.h"
+#include "tracer.h"
+#include "transcode-scheduler.h"
+#include "transcoder.h"
+#include "video-decoder-pool.h"
+#include "video-decoder.h"
+
+
+namespace {
+
+    constexpr int WIDTH = 320;
+    constexpr int HEIGHT = 240;
+    constexpr int FRAMES = 48;
+    constexpr double FPS = 24.0;
+
+    /**
+     * Containers the round trip is checked with. They pick different default codecs and muxers.
+     */
+    const char *const EXTENSIONS[] = {".mp4", ".mkv"};
+
+    /**
+     * Decodes every frame of a clip as RGB and checks the frame count, the dimensions, the monotonicity
+     * of the timestamps, and that each frame is close to the pattern it was encoded from.
+     */
+    void checkRoundTrip(bool &test_failed) {
+        for (const char *extension : EXTENSIONS) {
+            const std::string path = getTemporaryPath(std::string("round-trip") + extension);
+            encodeTestClip(path, WIDTH, HEIGHT, FRAMES, FPS);
+
+            VideoDecoder decoder(path);
+            CHECK(decoder.getWidth() == WIDTH);
+            CHECK(decoder.getHeight() == HEIGHT);
+
+            std::vector<uint8_t> decoded(static_cast<size_t>(WIDTH) * HEIGHT * 3);
+            std::vector<uint8_t> expected(decoded.size());
+            int frames = 0;
+            int64_t pts = 0;
+            int64_t previous_pts = INT64_MIN;
+            while (decoder.getNextFrame(decoded.data(), &pts)) {
+                CHECK(pts > previous_pts);
+                previous_pts = pts;
+
+                // Lossy coding changes pixels a little, but never the picture.
+                fillPattern(expected.data(), WIDTH, HEIGHT, frames);
+                uint64_t total_error = 0;
+                for (size_t i = 0; i < decoded.size(); i++) {
+                    total_error += std::abs(decoded[i] - expected[i]);
+                }
+                CHECK(static_cast<double>(total_error) / static_cast<double>(decoded.size()) < 12.0);
+                frames++;
+            }
+            CHECK(frames == FRAMES);
+        }
+    }
+
+    /**
+     * Seeks to the timestamps of a sequential decode and checks that decoding continues with exactly
+     * the frame that followed the target frame, pixel for pixel.
+     */
+    void checkSeekAccuracy(bool &test_failed) {
+        for (const char *extension : EXTENSIONS) {
+            const std::string path = getTemporaryPath(std::string("seek") + extension);
+            encodeTestClip(path, WIDTH, HEIGHT, FRAMES, FPS);
+
+            std::vector<uint8_t> luma(static_cast<size_t>(WIDTH) * HEIGHT);
+            FrameOutput output;
+            output.data = luma.data();
+            output.format = FrameOutputFormat::GRAY8;
+
+            // Record the timestamp and checksum of every frame.
+            VideoDecoder decoder(path);
+            std::vector<int64_t> timestamps;
+            std::vector<uint64_t> checksums;
+            int64_t pts = 0;
+            while (decoder.getNextFrame(output, &pts)) {
+                timestamps.push_back(pts);
+                checksums.push_back(getChecksum(luma.data(), WIDTH, WIDTH, HEIGHT));
+            }
+            CHECK(timestamps.size() == FRAMES);
+            if (timestamps.size() != FRAMES) {
+                continue;
+            }
+
+            // seekToTimestamp(...) decodes up to and including the target frame, so the next frame
+            // returned is the one after it. Targets cover the first GOP, GOP boundaries, and the tail.
+            for (int target : {0, 5, 11, 12, 13, 30, 46, 3}) {
+                CHECK(decoder.seekToTimestamp(timestamps[target]));
+                CHECK(decoder.getNextFrame(output, &pts));
+                CHECK(pts == timestamps[target + 1]);
+                CHECK(getChecksum(luma.data(), WIDTH, WIDTH, HEIGHT) == checksums[target + 1]);
+            }
+        }
+    }
+
+    /**
+     * Scans the packets of a clip and checks that there is one packet per encoded frame, that the
+     * stream starts with a keyframe, and that keyframes follow the encoder's GOP size.
+     */
+    void checkPacketScan(bool &test_failed) {
+        for (const char *extension : EXTENSIONS) {
+            const std::string path = getTemporaryPath(std::string("scan") + extension);
+            encodeTestClip(path, WIDTH, HEIGHT, FRAMES, FPS);
+
+            PacketScanner scanner(path);
+            PacketInfo info{};
+            int packets = 0;
+            int keyframes = 0;
+            int64_t total_size = 0;
+            while (scanner.getNextPacket(info)) {
+                CHECK(packets > 0 || info.keyframe);
+                CHECK(info.size > 0);
+                keyframes += info.keyframe;
+                total_size += info.size;
+                packets++;
+            }
+            CHECK(packets == FRAMES);
+            CHECK(keyframes >= FRAMES / 12);
+            CHECK(total_size > 0);
+        }
+    }
+
+    /**
+     * Decodes the remaining frames of a decoder and appends their timestamps and luma checksums.
+     */
+    void decodeChecksums(VideoDecoder &decoder, std::vector<int64_t> &timestamps, std::vector<uint64_t> &checksums) {
+        std::vector<uint8_t> luma(static_cast<size_t>(decoder.getWidth()) * decoder.getHeight());
+        FrameOutput output;
+        output.data = luma.data();
+        output.format = FrameOutputFormat::GRAY8;
+
+        int64_t pts = 0;
+        while (decoder.getNextFrame(output, &pts)) {
+            timestamps.push_back(pts);
+            checksums.push_back(getChecksum(luma.data(), decoder.getWidth(), decoder.getWidth(), decoder.getHeight()));
+        }
+    }
+
+    /**
+     * Decodes a clip and returns the timestamps and luma checksums of its frames.
+     */
+    void decodeChecksums(const std::string &path, std::vector<int64_t> &timestamps, std::vector<uint64_t> &checksums) {
+        VideoDecoder decoder(path);
+        decodeChecksums(decoder, timestamps, checksums);
+    }
+
+    /**
+     * Decodes a clone made before decoding and one made halfway through, and checks that both (and the
+     * original) return exactly the frames of a plain decode.
+     */
+    void checkCloneMatchesDecode(bool &test_failed) {
+        for (const char *extension : EXTENSIONS) {
+            const std::string path = getTemporaryPath(std::string("clone") + extension);
+            encodeTestClip(path, WIDTH, HEIGHT, FRAMES, FPS);
+
+            std::vector<int64_t> expected_timestamps;
+            std::vector<uint64_t> expected_checksums;
+            decodeChecksums(path, expected_timestamps, expected_checksums);
+            CHECK(expected_timestamps.size() == FRAMES);
+
+            VideoDecoder decoder(path);
+            const std::unique_ptr<VideoDecoder> first_clone = decoder.clone();
+
+            // Clones start at the beginning of the stream, wherever the original is.
+            std::vector<uint8_t> rgb_buffer(static_cast<size_t>(WIDTH) * HEIGHT * 3);
+            for (int i = 0; i < FRAMES / 2; i++) {
+                CHECK(decoder.getNextFrame(rgb_buffer.data()));
+            }
+            const std::unique_ptr<VideoDecoder> second_clone = decoder.clone();
+
+            for (VideoDecoder *clone : {first_clone.get(), second_clone.get()}) {
+                std::vector<int64_t> timestamps;
+                std::vector<uint64_t> checksums;
+                decodeChecksums(*clone, timestamps, checksums);
+                CHECK(timestamps == expected_timestamps);
+                CHECK(checksums == expected_checksums);
+            }
+
+            std::vector<int64_t> timestamps;
+            std::vector<uint64_t> checksums;
+            decodeChecksums(decoder, timestamps, checksums);
+            CHECK(timestamps.size() == expected_timestamps.size() - FRAMES / 2);
+            CHECK(std::equal(checksums.begin(), checksums.end(), expected_checksums.end() - checksums.size()));
+        }
+    }
+
+    /**
+     * Opens a clip through a probe cache twice, once probing it and once from the cached entry, and
+     * checks that both decoders return exactly the frames of a plain decode, also after seeking.
+     */
+    void checkProbeCacheMatchesDecode(bool &test_failed) {
+        const ProbeCache cache(getTemporaryPath("probe-cache"));
+        for (const char *extension : EXTENSIONS) {
+            const std::string path = getTemporaryPath(std::string("probe-cache") + extension);
+            encodeTestClip(path, WIDTH, HEIGHT, FRAMES, FPS);
+
+            std::vector<int64_t> expected_timestamps;
+            std::vector<uint64_t> expected_checksums;
+            decodeChecksums(path, expected_timestamps, expected_checksums);
+            CHECK(expected_timestamps.size() == FRAMES);
+            if (expected_timestamps.size() != FRAMES) {
+                continue;
+            }
+
+            VideoDecoderOptions options;
+            options.probe_cache = &cache;
+            CHECK(!cache.load(path));
+            for (int open = 0; open < 2; open++) {
+                VideoDecoder decoder(path, options);
+                CHECK(cache.load(path));
+
+                std::vector<int64_t> timestamps;
+                std::vector<uint64_t> checksums;
+                decodeChecksums(decoder, timestamps, checksums);
+                CHECK(timestamps == expected_timestamps);
+                CHECK(checksums == expected_checksums);
+
+                // Seeking relies on the cached index as well.
+                CHECK(decoder.seekToTimestamp(expected_timestamps[29]));
+                timestamps.clear();
+                checksums.clear();
+                decodeChecksums(decoder, timestamps, checksums);
+                CHECK(timestamps.size() == FRAMES - 30);
+                CHECK(std::equal(checksums.begin(), checksums.end(), expected_checksums.begin() + 30));
+            }
+        }
+    }
+
+    /**
+     * Reopens one decoder on clips of both containers, and recycles decoders through a pool, and checks
+     * that every file decodes to exactly the frames of a plain decode of it.
+     */
+    void checkReopenMatchesDecode(bool &test_failed) {
+        std::vector<std::string> paths;
+        std::vector<std::vector<int64_t>> expected_timestamps;
+        std::vector<std::vector<uint64_t>> expected_checksums;
+        for (const char *extension : EXTENSIONS) {
+            paths.push_back(getTemporaryPath(std::string("reopen") + extension));
+            encodeTestClip(paths.back(), WIDTH, HEIGHT, FRAMES, FPS);
+            expected_timestamps.emplace_back();
+            expected_checksums.emplace_back();
+            decodeChecksums(paths.back(), expected_timestamps.back(), expected_checksums.back());
+        }
+
+        // The second file of each pair is opened while the previous one is partly decoded.
+        VideoDecoder decoder(paths[0]);
+        std::vector<uint8_t> rgb_buffer(static_cast<size_t>(WIDTH) * HEIGHT * 3);
+        CHECK(decoder.getNextFrame(rgb_buffer.data()));
+        for (size_t i : {1, 0, 1}) {
+            decoder.reopen(paths[i]);
+            std::vector<int64_t> timestamps;
+            std::vector<uint64_t> checksums;
+            decodeChecksums(decoder, timestamps, checksums);
+            CHECK(timestamps == expected_timestamps[i]);
+            CHECK(checksums == expected_checksums[i]);
+        }
+
+        VideoDecoderPool pool(1);
+        for (size_t i : {0, 1, 1, 0}) {
+            const VideoDecoderPool::Handle pooled_decoder = pool.acquire(paths[i]);
+            std::vector<int64_t> timestamps;
+            std::vector<uint64_t> checksums;
+            decodeChecksums(*pooled_decoder, timestamps, checksums);
+            CHECK(timestamps == expected_timestamps[i]);
+            CHECK(checksums == expected_checksums[i]);
+        }
+        CHECK(pool.getCreatedCount() == 1);
+        CHECK(pool.getReusedCount() == 3);
+    }
+
+    /**
+     * Decodes clips into frames allocated by a FrameAllocator (through a FrameBufferPool), single- and
+     * frame-threaded, and checks that they match a plain decode exactly.
+     */
+    void checkFrameAllocatorMatchesDecode(bool &test_failed) {
+        for (const char *extension : EXTENSIONS) {
+            const std::string path = getTemporaryPath(std::string("frame-allocator") + extension);
+            encodeTestClip(path, WIDTH, HEIGHT, FRAMES, FPS);
+
+            std::vector<int64_t> expected_timestamps;
+            std::vector<uint64_t> expected_checksums;
+            decodeChecksums(path, expected_timestamps, expected_checksums);
+            CHECK(expected_timestamps.size() == FRAMES);
+
+            for (const int thread_count : {1, 4}) {
+                AlignedFrameAllocator allocator;
+                VideoDecoderOptions options;
+                options.frame_allocator = &allocator;
+                options.thread_count = thread_count;
+                VideoDecoder decoder(path, options);
+
+                std::vector<int64_t> timestamps;
+                std::vector<uint64_t> checksums;
+                decodeChecksums(decoder, timestamps, checksums);
+                CHECK(timestamps == expected_timestamps);
+                CHECK(checksums == expected_checksums);
+            }
+        }
+    }
+
+    /**
+     * Writes cropped luma and padded RGB output into larger canvases and checks that the written pixels
+     * match the corresponding pixels of a plain decode exactly, and that the rest of the canvas is left
+     * untouched.
+     */
+    void checkCroppedOutputMatchesDecode(bool &test_failed) {
+        constexpr uint8_t CANVAS_FILL = 0xa5;
+        const FrameRect crop{66, 34, 128, 96};
+        constexpr int CANVAS_X = 5;
+        constexpr int CANVAS_Y = 3;
+        constexpr int LUMA_STRIDE = WIDTH + 37;
+        constexpr int RGB_STRIDE = WIDTH * 3 + 64;
+
+        for (const char *extension : EXTENSIONS) {
+            const std::string path = getTemporaryPath(std::string("cropped-output") + extension);
+            encodeTestClip(path, WIDTH, HEIGHT, FRAMES, FPS);
+
+            VideoDecoder plain_decoder(path);
+            VideoDecoder decoder(path);
+            std::vector<uint8_t> plain_luma(static_cast<size_t>(WIDTH) * HEIGHT);
+            std::vector<uint8_t> plain_rgb(static_cast<size_t>(WIDTH) * HEIGHT * 3);
+            std::vector<uint8_t> luma_canvas(static_cast<size_t>(LUMA_STRIDE) * (HEIGHT + 8));
+            std::vector<uint8_t> rgb_canvas(static_cast<size_t>(RGB_STRIDE) * HEIGHT);
+
+            FrameOutput plain_output;
+            plain_output.data = plain_luma.data();
+            plain_output.format = FrameOutputFormat::GRAY8;
+
+            FrameOutput luma_output;
+            luma_output.data = luma_canvas.data();
+            luma_output.stride = LUMA_STRIDE;
+            luma_output.x = CANVAS_X;
+            luma_output.y = CANVAS_Y;
+            luma_output.crop = crop;
+            luma_output.format = FrameOutputFormat::GRAY8;
+
+            FrameOutput rgb_output;
+            rgb_output.data = rgb_canvas.data();
+            rgb_output.stride = RGB_STRIDE;
+
+            // Frames alternate between the two kinds of output, each compared with the plain decode of
+            // the same frame in the matching format.
+            int frames = 0;
+            while (true) {
+                const bool luma_frame = frames % 2 == 0;
+                const bool plain_decoded = luma_frame ? plain_decoder.getNextFrame(plain_output) :
+                    plain_decoder.getNextFrame(plain_rgb.data());
+                std::fill(luma_canvas.begin(), luma_canvas.end(), CANVAS_FILL);
+                std::fill(rgb_canvas.begin(), rgb_canvas.end(), CANVAS_FILL);
+                const bool decoded = decoder.getNextFrame(luma_frame ? luma_output : rgb_output);
+                CHECK(decoded == plain_decoded);
+                if (!decoded || !plain_decoded) {
+                    break;
+                }
+
+                if (luma_frame) {
+                    const uint8_t *region = luma_canvas.data() + CANVAS_Y * LUMA_STRIDE + CANVAS_X;
+                    CHECK(getChecksum(region, LUMA_STRIDE, crop.width, crop.height) ==
+                        getChecksum(plain_luma.data() + crop.y * WIDTH + crop.x, WIDTH, crop.width, crop.height));
+
+                    size_t untouched = 0;
+                    for (size_t i = 0; i < luma_canvas.size(); i++) {
+                        untouched += luma_canvas[i] == CANVAS_FILL;
+                    }
+                    CHECK(untouched >= luma_canvas.size() - static_cast<size_t>(crop.width) * crop.height);
+                    CHECK(luma_canvas[(CANVAS_Y - 1) * LUMA_STRIDE + CANVAS_X] == CANVAS_FILL);
+                    CHECK(luma_canvas[CANVAS_Y * LUMA_STRIDE + CANVAS_X - 1] == CANVAS_FILL);
+                    CHECK(luma_canvas[(CANVAS_Y + crop.height) * LUMA_STRIDE + CANVAS_X] == CANVAS_FILL);
+                    CHECK(luma_canvas[CANVAS_Y * LUMA_STRIDE + CANVAS_X + crop.width] == CANVAS_FILL);
+                } else {
+                    CHECK(getChecksum(rgb_canvas.data(), RGB_STRIDE, WIDTH * 3, HEIGHT) ==
+                        getChecksum(plain_rgb.data(), WIDTH * 3, WIDTH * 3, HEIGHT));
+                    bool padding_untouched = true;
+                    for (int y = 0; y < HEIGHT; y++) {
+                        const uint8_t *padding = rgb_canvas.data() + static_cast<size_t>(y) * RGB_STRIDE + WIDTH * 3;
+                        padding_untouched = padding_untouched &&
+                            std::all_of(padding, padding + RGB_STRIDE - WIDTH * 3,
+                                [](uint8_t sample) { return sample == CANVAS_FILL; });
+                    }
+                    CHECK(padding_untouched);
+                }
+                frames++;
+            }
+            CHECK(frames == FRAMES);
+        }
+    }
+
+    /**
+     * Trims a clip by stream copy into another container and checks that the copy starts at the
+     * keyframe before the requested start, with rebased timestamps and unchanged frames.
+     */
+    void checkRemuxTrim(bool &test_failed) {
+        const std::string input_path = getTemporaryPath("remux-input.mp4");
+        const std::string output_path = getTemporaryPath("remux-output.mkv");
+        encodeTestClip(input_path, WIDTH, HEIGHT, FRAMES, FPS);
+
+        std::vector<int64_t> input_timestamps;
+        std::vector<uint64_t> input_checksums;
+        decodeChecksums(input_path, input_timestamps, input_checksums);
+        CHECK(input_timestamps.size() == FRAMES);
+        if (input_timestamps.size() != FRAMES) {
+            return;
+        }
+
+        // The encoder writes a keyframe every 12 frames, so a start at frame 15 snaps back to frame 12.
+        RemuxOptions options;
+        options.start_time = input_timestamps[15];
+        options.end_time = input_timestamps[36];
+        RemuxStats stats;
+        {
+            Remuxer remuxer(input_path, output_path, options);
+            stats = remuxer.run();
+        }
+        CHECK(stats.start_time == input_timestamps[12]);
+        CHECK(stats.packets > 0);
+
+        std::vector<int64_t> output_timestamps;
+        std::vector<uint64_t> output_checksums;
+        decodeChecksums(output_path, output_timestamps, output_checksums);
+        CHECK(output_timestamps.size() >= 24);
+        if (output_timestamps.size() < 24) {
+            return;
+        }
+        CHECK(std::abs(output_timestamps[0]) < 1000);
+        for (size_t i = 0; i < 24; i++) {
+            CHECK(output_checksums[i] == input_checksums[12 + i]);
+        }
+    }
+
+    /**
+     * Cuts a clip between two frames that aren't keyframes and checks that exactly the frames in
+     * between are kept, and that the complete GOP in the middle is copied unchanged.
+     */
+    void checkSmartCut(bool &test_failed) {
+        const std::string input_path = getTemporaryPath("smart-cut-input.mp4");
+        const std::string output_path = getTemporaryPath("smart-cut-output.mp4");
+        encodeTestClip(input_path, WIDTH, HEIGHT, FRAMES, FPS);
+
+        std::vector<int64_t> input_timestamps;
+        std::vector<uint64_t> input_checksums;
+        decodeChecksums(input_path, input_timestamps, input_checksums);
+        CHECK(input_timestamps.size() == FRAMES);
+        if (input_timestamps.size() != FRAMES) {
+            return;
+        }
+
+        // Keyframes are at 0, 12, 24, and 36: frames 15 to 23 are re-encoded, 24 to 35 copied, and 36
+        // to 42 re-encoded again.
+        SmartCutOptions options;
+        options.start_time = input_timestamps[15];
+        options.end_time = input_timestamps[43];
+        SmartCutStats stats;
+        {
+            SmartCutter cutter(input_path, output_path, options);
+            stats = cutter.run();
+        }
+        CHECK(stats.encoded_frames == 16);
+        CHECK(stats.copied_packets == 12);
+
+        std::vector<int64_t> output_timestamps;
+        std::vector<uint64_t> output_checksums;
+        decodeChecksums(output_path, output_timestamps, output_checksums);
+        CHECK(output_timestamps.size() == 28);
+        if (output_timestamps.size() != 28) {
+            return;
+        }
+        CHECK(std::abs(output_timestamps[0]) < 1000);
+        for (size_t i = 9; i < 21; i++) {
+            CHECK(output_checksums[i] == input_checksums[15 + i]);
+        }
+    }
+
+    /**
+     * Transcodes a clip at its own size and at half its size, and checks that only the second needs
+     * scaling and that both keep every frame.
+     */
+    void checkTranscode(bool &test_failed) {
+        const std::string input_path = getTemporaryPath("transcode-input.mp4");
+        encodeTestClip(input_path, WIDTH, HEIGHT, FRAMES, FPS);
+
+        for (const int divisor : {1, 2}) {
+            const std::string output_path = getTemporaryPath("transcode-output-" + std::to_string(divisor) + ".mkv");
+            TranscodeOptions options;
+            options.width = WIDTH / divisor;
+            options.height = HEIGHT / divisor;
+            TranscodeStats stats;
+            {
+                Transcoder transcoder(input_path, output_path, options);
+                stats = transcoder.run();
+            }
+            CHECK(stats.frames == FRAMES);
+            CHECK(stats.scaled_frames == (divisor == 1 ? 0 : FRAMES));
+
+            std::vector<int64_t> timestamps;
+            std::vector<uint64_t> checksums;
+            decodeChecksums(output_path, timestamps, checksums);
+            CHECK(timestamps.size() == FRAMES);
+            CHECK(VideoDecoder(output_path).getWidth() == WIDTH / divisor);
+        }
+    }
+
+    /**
+     * Transcodes a clip at half and at twice its frame rate, serially and pipelined, and checks that
+     * frames are dropped or repeated so that the output lasts as long as the input.
+     */
+    void checkTranscodeFrameRate(bool &test_failed) {
+        const std::string input_path = getTemporaryPath("frame-rate-input.mp4");
+        encodeTestClip(input_path, WIDTH, HEIGHT, FRAMES, FPS);
+
+        std::vector<int64_t> input_timestamps;
+        std::vector<uint64_t> input_checksums;
+        decodeChecksums(input_path, input_timestamps, input_checksums);
+        CHECK(input_timestamps.size() == FRAMES);
+        if (input_timestamps.size() != FRAMES) {
+            return;
+        }
+        const double input_duration = static_cast<double>(input_timestamps.back() - input_timestamps.front()) +
+            1000000.0 / FPS;
+
+        for (const double fps : {FPS / 2, FPS * 2}) {
+            for (const bool pipelined : {false, true}) {
+                const std::string output_path = getTemporaryPath("frame-rate-" + std::to_string(static_cast<int>(fps)) +
+                    (pipelined ? "-pipelined.mkv" : "-serial.mkv"));
+                TranscodeOptions options;
+                options.fps = fps;
+                TranscodeStats stats;
+                {
+                    Transcoder transcoder(input_path, output_path, options);
+                    stats = pipelined ? transcoder.runPipelined() : transcoder.run();
+                }
+                const auto expected_frames = static_cast<int64_t>(std::lround(FRAMES * fps / FPS));
+                CHECK(stats.frames == expected_frames);
+                CHECK(stats.frames == FRAMES - stats.dropped_frames + stats.repeated_frames);
+                CHECK(fps < FPS ? stats.repeated_frames == 0 : stats.dropped_frames == 0);
+
+                std::vector<int64_t> timestamps;
+                std::vector<uint64_t> checksums;
+                decodeChecksums(output_path, timestamps, checksums);
+                CHECK(static_cast<int64_t>(timestamps.size()) == expected_frames);
+                if (timestamps.empty()) {
+                    continue;
+                }
+                const double duration = static_cast<double>(timestamps.back() - timestamps.front()) + 1000000.0 / fps;
+                CHECK(std::abs(duration - input_duration) < 1000000.0 / fps);
+            }
+        }
+    }
+
+    /**
+     * Transcodes a clip with scaling on several threads and checks that the frames come out complete
+     * and in order, by comparing them with a serial transcode.
+     */
+    void checkPipelinedTranscode(bool &test_failed) {
+        const std::string input_path = getTemporaryPath("pipeline-input.mp4");
+        encodeTestClip(input_path, WIDTH, HEIGHT, FRAMES, FPS);
+
+        TranscodeOptions options;
+        options.width = WIDTH / 2;
+        options.height = HEIGHT / 2;
+        std::vector<uint64_t> checksums[2];
+        for (const bool pipelined : {false, true}) {
+            const std::string output_path = getTemporaryPath(pipelined ? "pipelined.mkv" : "serial.mkv");
+            Transcoder transcoder(input_path, output_path, options);
+            if (pipelined) {
+                PipelineOptions pipeline_options;
+                pipeline_options.scaler_threads = 3;
+                pipeline_options.queue_capacity = 2;
+                const TranscodeStats stats = transcoder.runPipelined(pipeline_options);
+                CHECK(stats.frames == FRAMES);
+                CHECK(stats.scaled_frames == FRAMES);
+                CHECK(stats.pipeline.scaler_threads == 3);
+                CHECK(stats.pipeline.decoded_frames.pushes == FRAMES);
+                CHECK(stats.pipeline.encoder_frames.peak_occupancy <= 2);
+            } else {
+                CHECK(transcoder.run().frames == FRAMES);
+            }
+
+            std::vector<int64_t> timestamps;
+            decodeChecksums(output_path, timestamps, checksums[pipelined]);
+        }
+        CHECK(checksums[0].size() == FRAMES);
+        CHECK(checksums[0] == checksums[1]);
+    }
+
+    /**
+     * Encodes two renditions from one decode and checks that both keep every frame and have their
+     * keyframes at exactly the requested interval.
+     */
+    void checkLadder(bool &test_failed) {
+        const std::string input_path = getTemporaryPath("ladder-input.mp4");
+        encodeTestClip(input_path, WIDTH, HEIGHT, FRAMES, FPS);
+
+        const std::vector<Rendition> renditions = {
+            {getTemporaryPath("ladder-240.mp4"), WIDTH, HEIGHT, int64_t{WIDTH} * HEIGHT * 8},
+            {getTemporaryPath("ladder-120.mp4"), WIDTH / 2, HEIGHT / 2, int64_t{WIDTH} * HEIGHT * 2},
+        };
+        LadderOptions options;
+        options.keyframe_interval = 8 / FPS;
+        const LadderStats stats = LadderEncoder(input_path, renditions, options).run();
+        CHECK(stats.frames == FRAMES);
+        CHECK(stats.keyframe_interval == 8);
+        CHECK(stats.queues.size() == renditions.size());
+
+        for (const Rendition &rendition : renditions) {
+            PacketScanner scanner(rendition.output_path);
+            std::vector<int64_t> keyframe_timestamps;
+            int64_t first_timestamp = 0;
+            int packets = 0;
+            PacketInfo info{};
+            while (scanner.getNextPacket(info)) {
+                first_timestamp = packets == 0 ? info.pts : std::min(first_timestamp, info.pts);
+                if (info.keyframe) {
+                    keyframe_timestamps.push_back(info.pts);
+                }
+                packets++;
+            }
+            CHECK(packets == FRAMES);
+            CHECK(keyframe_timestamps.size() == FRAMES / 8);
+
+            // Keyframes sit at frames 0, 8, 16, ... of every rendition.
+            const double frame_duration = 1000000.0 / FPS;
+            for (size_t i = 0; i < keyframe_timestamps.size(); i++) {
+                const double expected = first_timestamp + static_cast<double>(i) * 8 * frame_duration;
+                CHECK(std::abs(static_cast<double>(keyframe_timestamps[i]) - expected) < frame_duration / 2);
+            }
+        }
+    }
+
+    /**
+     * Runs several transcodes (one of them failing) on a scheduler with a small thread budget and
+     * checks that every job finishes within its share of the budget and is accounted for.
+     */
+    void checkScheduler(bool &test_failed) {
+        const std::string input_path = getTemporaryPath("scheduler-input.mp4");
+        encodeTestClip(input_path, WIDTH, HEIGHT, FRAMES, FPS);
+
+        SchedulerOptions options;
+        options.thread_budget = 4;
+        options.max_running_jobs = 2;
+        TranscodeScheduler scheduler(options);
+        for (int i = 0; i < 3; i++) {
+            TranscodeJob job;
+            job.input_path = input_path;
+            job.output_path = getTemporaryPath("scheduler-output-" + std::to_string(i) + ".mkv");
+            job.priority = i;
+            scheduler.submit(job);
+        }
+        TranscodeJob failing_job;
+        failing_job.input_path = getTemporaryPath("missing.mp4");
+        failing_job.output_path = getTemporaryPath("scheduler-output-missing.mkv");
+        scheduler.submit(failing_job);
+        scheduler.wait();
+
+        const std::vector<JobStats> jobs = scheduler.getJobStats();
+        CHECK(jobs.size() == 4);
+        for (size_t i = 0; i < jobs.size(); i++) {
+            CHECK(jobs[i].id == i);
+            CHECK(jobs[i].decode_threads >= 1);
+            CHECK(jobs[i].encode_threads >= 1);
+            CHECK(jobs[i].decode_threads + jobs[i].encode_threads <= options.thread_budget);
+        }
+        for (size_t i = 0; i < 3; i++) {
+            CHECK(jobs[i].state == JobState::COMPLETED);
+            CHECK(jobs[i].frames == FRAMES);
+        }
+        CHECK(jobs[3].state == JobState::FAILED);
+        CHECK(!jobs[3].error.empty());
+
+        const SchedulerStats stats = scheduler.getStats();
+        CHECK(stats.completed_jobs == 3);
+        CHECK(stats.failed_jobs == 1);
+        CHECK(stats.frames == 3 * FRAMES);
+        CHECK(stats.threads_in_use == 0);
+        CHECK(stats.getFramesPerSecond() > 0.0);
+    }
+
+    /**
+     * Submits jobs one after another, each once the previous one has started, and checks that the
+     * running jobs together never use more threads than the budget.
+     */
+    void checkSchedulerBudget(bool &test_failed) {
+        const std::string input_path = getTemporaryPath("scheduler-budget-input.mp4");
+        encodeTestClip(input_path, WIDTH, HEIGHT, FRAMES, FPS);
+
+        SchedulerOptions options;
+        options.thread_budget = 8;
+        options.max_running_jobs = 4;
+        TranscodeScheduler scheduler(options);
+
+        // Sums the threads of the running jobs and checks them against the budget.
+        auto checkBudget = [&] {
+            int threads = 0;
+            for (const JobStats &job : scheduler.getJobStats()) {
+                if (job.state == JobState::RUNNING) {
+                    threads += job.decode_threads + job.encode_threads;
+                }
+            }
+            CHECK(threads <= options.thread_budget);
+            CHECK(scheduler.getStats().threads_in_use <= options.thread_budget);
+        };
+
+        for (int i = 0; i < 6; i++) {
+            TranscodeJob job;
+            job.input_path = input_path;
+            job.output_path = getTemporaryPath("scheduler-budget-output-" + std::to_string(i) + ".mkv");
+            const uint64_t id = scheduler.submit(job);
+            while (scheduler.getJobStats()[id].state == JobState::QUEUED) {
+                checkBudget();
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            checkBudget();
+        }
+        scheduler.wait();
+
+        for (const JobStats &job : scheduler.getJobStats()) {
+            CHECK(job.state == JobState::COMPLETED);
+            CHECK(job.decode_threads + job.encode_threads <= options.thread_budget / options.max_running_jobs);
+        }
+        CHECK(scheduler.getStats().threads_in_use == 0);
+    }
+
+    /**
+     * Encodes with an explicitly chosen codec, a fixed quantizer, and a GOP size, and checks that
+     * the options take effect and that unknown codec options are rejected.
+     */
+    void checkEncoderOptions(bool &test_failed) {
+        const std::string path = getTemporaryPath("encoder-options.mkv");
+        VideoEncoderOptions options;
+        options.codec_name = "mpeg4";
+        options.qp = 3;
+        options.gop_size = 6;
+        options.scene_cut_keyframes = false;
+        {
+            std::vector<uint8_t> rgb_buffer(static_cast<size_t>(WIDTH) * HEIGHT * 3);
+            VideoEncoder encoder(path, WIDTH, HEIGHT, FPS, 0, options);
+            for (int i = 0; i < FRAMES; i++) {
+                fillPattern(rgb_buffer.data(), WIDTH, HEIGHT, i);
+                encoder.encodeFrame(rgb_buffer.data(), WIDTH, HEIGHT);
+            }
+            encoder.finalize();
+        }
+
+        PacketScanner scanner(path);
+        PacketInfo info{};
+        int packets = 0;
+        int keyframes = 0;
+        while (scanner.getNextPacket(info)) {
+            keyframes += info.keyframe;
+            packets++;
+        }
+        CHECK(packets == FRAMES);
+        CHECK(keyframes == FRAMES / 6);
+
+        VideoEncoderOptions unknown_options;
+        unknown_options.codec_name = "mpeg4";
+        unknown_options.codec_options["no-such-option"] = "1";
+        bool thrown = false;
+        try {
+            VideoEncoder encoder(getTemporaryPath("encoder-unknown-option.mkv"), WIDTH, HEIGHT, FPS, 1000000,
+                unknown_options);
+        } catch (const std::runtime_error &) {
+            thrown = true;
+        }
+        CHECK(thrown);
+    }
+
+    /**
+     * Encodes with frame and with slice threading and checks that no frame gets lost or reordered
+     * out of the file.
+     */
+    void checkEncoderThreads(bool &test_failed) {
+        CHECK(getAvailableCpuCount() >= 1);
+
+        for (const EncoderThreadType thread_type : {EncoderThreadType::FRAME, EncoderThreadType::SLICE}) {
+            const bool frame_threads = thread_type == EncoderThreadType::FRAME;
+            const std::string path = getTemporaryPath(
+                frame_threads ? "encoder-frame-threads.mkv" : "encoder-slice-threads.mkv");
+            VideoEncoderOptions options;
+            options.codec_name = "mpeg4";
+            options.thread_type = thread_type;
+            options.thread_count = 2;
+            {
+                std::vector<uint8_t> rgb_buffer(static_cast<size_t>(WIDTH) * HEIGHT * 3);
+                VideoEncoder encoder(path, WIDTH, HEIGHT, FPS, 1000000, options);
+                for (int i = 0; i < FRAMES; i++) {
+                    fillPattern(rgb_buffer.data(), WIDTH, HEIGHT, i);
+                    encoder.encodeFrame(rgb_buffer.data(), WIDTH, HEIGHT);
+                }
+                encoder.finalize();
+            }
+
+            PacketScanner scanner(path);
+            PacketInfo info{};
+            int packets = 0;
+            while (scanner.getNextPacket(info)) {
+                packets++;
+            }
+            CHECK(packets == FRAMES);
+        }
+    }
+
+    /**
+     * Encodes flat gray frames handed over as padded I420, as NV12, and as BGRA, and checks that
+     * each decoded frame has the luma it was encoded with.
+     */
+    void checkNativeInput(bool &test_failed) {
+        constexpr int PADDED_STRIDE = WIDTH + 64;
+        std::vector<uint8_t> y_plane(static_cast<size_t>(PADDED_STRIDE) * HEIGHT);
+        std::vector<uint8_t> chroma_plane(static_cast<size_t>(PADDED_STRIDE) * HEIGHT / 2, 128);
+        std::vector<uint8_t> bgra(static_cast<size_t>(WIDTH) * HEIGHT * 4);
+
+        const std::pair<FrameInputFormat, const char *> formats[] = {
+            {FrameInputFormat::I420, "i420"},
+            {FrameInputFormat::NV12, "nv12"},
+            {FrameInputFormat::BGRA, "bgra"},
+        };
+        for (const auto &[format, name] : formats) {
+            const std::string path = getTemporaryPath(std::string("native-input-") + name + ".mkv");
+            {
+                VideoEncoder encoder(path, WIDTH, HEIGHT, FPS, 4000000);
+                for (int i = 0; i < FRAMES; i++) {
+                    const uint8_t value = static_cast<uint8_t>(40 + 3 * i);
+                    FrameInput input;
+                    input.width = WIDTH;
+                    input.height = HEIGHT;
+                    input.format = format;
+                    if (format == FrameInputFormat::BGRA) {
+                        std::fill(bgra.begin(), bgra.end(), value);
+                        input.data[0] = bgra.data();
+                    } else {
+                        std::fill(y_plane.begin(), y_plane.end(), value);
+                        input.data[0] = y_plane.data();
+                        input.data[1] = chroma_plane.data();
+                        input.data[2] = chroma_plane.data();
+                        input.stride[0] = PADDED_STRIDE;
+                        input.stride[1] = format == FrameInputFormat::NV12 ? PADDED_STRIDE : PADDED_STRIDE / 2;
+                        input.stride[2] = PADDED_STRIDE / 2;
+                    }
+                    encoder.encodeFrame(input);
+                }
+                encoder.finalize();
+            }
+
+            // Gray RGB maps to limited range luma; YUV luma is passed through.
+            VideoDecoder decoder(path);
+            std::vector<uint8_t> luma(static_cast<size_t>(WIDTH) * HEIGHT);
+            FrameOutput output;
+            output.data = luma.data();
+            output.format = FrameOutputFormat::GRAY8;
+            int frames = 0;
+            while (decoder.getNextFrame(output)) {
+                const double value = 40 + 3 * frames;
+                const double expected = format == FrameInputFormat::BGRA ? 16 + value * 219 / 255 : value;
+                double sum = 0.0;
+                for (const uint8_t sample : luma) {
+                    sum += sample;
+                }
+                CHECK(std::abs(sum / static_cast<double>(luma.size()) - expected) < 3.0);
+                frames++;
+            }
+            CHECK(frames == FRAMES);
+        }
+    }
+
+    /**
+     * Encodes frames that alternate between a larger RGB input and a smaller BGRA one, both resized
+     * to the output size with threaded scaling, and checks that every frame makes it into the file.
+     */
+    void checkScaledInput(bool &test_failed) {
+        const std::string path = getTemporaryPath("scaled-input.mkv");
+        std::vector<uint8_t> rgb_buffer(static_cast<size_t>(WIDTH) * HEIGHT * 4 * 3);
+        std::vector<uint8_t> bgra(static_cast<size_t>(WIDTH / 2) * HEIGHT / 2 * 4, 200);
+        VideoEncoderOptions options;
+        options.scaler_threads = 2;
+        {
+            VideoEncoder encoder(path, WIDTH, HEIGHT, FPS, 1000000, options);
+            for (int i = 0; i < FRAMES; i++) {
+                if (i % 2 == 0) {
+                    fillPattern(rgb_buffer.data(), WIDTH * 2, HEIGHT * 2, i);
+                    encoder.encodeFrame(rgb_buffer.data(), WIDTH * 2, HEIGHT * 2);
+                } else {
+                    FrameInput input;
+                    input.data[0] = bgra.data();
+                    input.width = WIDTH / 2;
+                    input.height = HEIGHT / 2;
+                    input.format = FrameInputFormat::BGRA;
+                    encoder.encodeFrame(input);
+                }
+            }
+            encoder.finalize();
+        }
+
+        VideoDecoder decoder(path);
+        CHECK(decoder.getWidth() == WIDTH);
+        CHECK(decoder.getHeight() == HEIGHT);
+        std::vector<uint8_t> decoded(static_cast<size_t>(WIDTH) * HEIGHT * 3);
+        int frames = 0;
+        while (decoder.getNextFrame(decoded.data())) {
+            frames++;
+        }
+        CHECK(frames == FRAMES);
+    }
+
+    /**
+     * Encodes on a background thread, once blocking on a full queue and once dropping frames, and
+     * checks that every frame accepted (and only those) ends up in the file.
+     */
+    void checkAsyncEncode(bool &test_failed) {
+        for (const QueueFullPolicy policy : {QueueFullPolicy::BLOCK, QueueFullPolicy::DROP}) {
+            const bool drop = policy == QueueFullPolicy::DROP;
+            const std::string path = getTemporaryPath(drop ? "async-drop.mkv" : "async-block.mkv");
+            AsyncEncoderOptions options;
+            options.queue_capacity = drop ? 1 : 4;
+            options.full_policy = policy;
+
+            std::vector<uint8_t> rgb_buffer(static_cast<size_t>(WIDTH) * HEIGHT * 3);
+            AsyncEncoderStats stats;
+            {
+                AsyncVideoEncoder encoder(path, WIDTH, HEIGHT, FPS, 1000000, {}, options);
+                int64_t last_index = -1;
+                for (int i = 0; i < FRAMES; i++) {
+                    fillPattern(rgb_buffer.data(), WIDTH, HEIGHT, i);
+                    const int64_t index = encoder.encodeFrame(rgb_buffer.data(), WIDTH, HEIGHT);
+                    CHECK(index == -1 || index == last_index + 1);
+                    last_index = std::max(index, last_index);
+                }
+                CHECK(last_index >= 0);
+                if (last_index >= 0) {
+                    encoder.waitForFrame(last_index);
+                    CHECK(encoder.getEncodedFrameCount() == last_index + 1);
+                }
+                encoder.finalize();
+                stats = encoder.getStats();
+            }
+            CHECK(stats.encoded_frames == stats.queued_frames);
+            CHECK(stats.queued_frames + stats.dropped_frames == FRAMES);
+            CHECK(drop || stats.dropped_frames == 0);
+
+            PacketScanner scanner(path);
+            PacketInfo info{};
+            int64_t packets = 0;
+            while (scanner.getNextPacket(info)) {
+                packets++;
+            }
+            CHECK(packets == stats.encoded_frames);
+        }
+    }
+
+    /**
+     * Hands decoded-style frames to an AsyncVideoEncoder with a one-frame queue that drops frames, and
+     * checks that queued frames are taken over and that dropped frames keep their buffers and pixels.
+     */
+    void checkAsyncFrameDrop(bool &test_failed) {
+        const std::string path = getTemporaryPath("async-frame-drop.mkv");
+        AsyncEncoderOptions options;
+        options.queue_capacity = 1;
+        options.full_policy = QueueFullPolicy::DROP;
+
+        AVFrame *frame = av_frame_alloc();
+        CHECK(frame != nullptr);
+        if (!frame) {
+            return;
+        }
+        AsyncEncoderStats stats;
+        {
+            AsyncVideoEncoder encoder(path, WIDTH, HEIGHT, FPS, 1000000, {}, options);
+            for (int i = 0; i < FRAMES; i++) {
+                if (!frame->buf[0]) {
+                    frame->format = AV_PIX_FMT_YUV420P;
+                    frame->width = WIDTH;
+                    frame->height = HEIGHT;
+                    CHECK(av_frame_get_buffer(frame, 0) == 0);
+                }
+                const uint8_t *const data = frame->data[0];
+                const auto sample = static_cast<uint8_t>(i);
+                std::fill_n(frame->data[0], frame->linesize[0] * HEIGHT, sample);
+
+                const int64_t index = encoder.encodeFrame(frame);
+                if (index < 0) {
+                    CHECK(frame->buf[0] != nullptr && frame->data[0] == data && frame->data[0][0] == sample);
+                } else {
+                    CHECK(frame->buf[0] == nullptr);
+                }
+            }
+            encoder.finalize();
+            stats = encoder.getStats();
+        }
+        av_frame_free(&frame);
+        CHECK(stats.dropped_frames > 0);
+        CHECK(stats.encoded_frames == stats.queued_frames);
+        CHECK(stats.queued_frames + stats.dropped_frames == FRAMES);
+    }
+
+    /**
+     * Encodes flat frames of changing brightness losslessly with frame threading, which keeps several
+     * input frames referenced at once, and checks that none of them was overwritten before it was
+     * encoded and that the encoder recycled its frame buffers instead of allocating one per frame.
+     */
+    void checkFramePool(bool &test_failed) {
+        const std::string path = getTemporaryPath("frame-pool.mkv");
+        VideoEncoderOptions options;
+        options.codec_name = "ffvhuff";
+        options.thread_type = EncoderThreadType::FRAME;
+        options.thread_count = 4;
+
+        std::vector<uint8_t> y_plane(static_cast<size_t>(WIDTH) * HEIGHT);
+        std::vector<uint8_t> chroma_plane(static_cast<size_t>(WIDTH / 2) * HEIGHT / 2, 128);
+        EncoderStats stats;
+        {
+            VideoEncoder encoder(path, WIDTH, HEIGHT, FPS, 0, options);
+            for (int i = 0; i < FRAMES; i++) {
+                std::fill(y_plane.begin(), y_plane.end(), static_cast<uint8_t>(40 + 3 * i));
+                FrameInput input;
+                input.data[0] = y_plane.data();
+                input.data[1] = chroma_plane.data();
+                input.data[2] = chroma_plane.data();
+                input.width = WIDTH;
+                input.height = HEIGHT;
+                encoder.encodeFrame(input);
+            }
+            encoder.finalize();
+            stats = encoder.getStats();
+        }
+        CHECK(stats.frame_allocations <= 3 * static_cast<uint64_t>(options.thread_count + 2));
+
+        VideoDecoder decoder(path);
+        std::vector<uint8_t> luma(static_cast<size_t>(WIDTH) * HEIGHT);
+        FrameOutput output;
+        output.data = luma.data();
+        output.format = FrameOutputFormat::GRAY8;
+        int frames = 0;
+        while (decoder.getNextFrame(output)) {
+            const auto expected = static_cast<uint8_t>(40 + 3 * frames);
+            CHECK(std::all_of(luma.begin(), luma.end(), [expected](uint8_t sample) { return sample == expected; }));
+            frames++;
+        }
+        CHECK(frames == FRAMES);
+    }
+
+    /**
+     * Records events on a thread that then exits, and checks that they are in the next written trace
+     * but not in the one after it, since the thread's buffer is freed once its events are written.
+     */
+    void checkTracerFreesExitedThreads(bool &test_failed) {
+        Tracer &tracer = Tracer::getInstance();
+        tracer.clear();
+        tracer.start();
+        std::thread worker([&tracer]() {
+            tracer.setThreadName("exiting-worker");
+            const auto now = std::chrono::steady_clock::now();
+            tracer.record("worker-event", now, now + std::chrono::microseconds(5));
+        });
+        worker.join();
+        tracer.stop();
+
+        const auto readTrace = [](const std::string &path) {
+            std::ifstream file(path);
+            return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        };
+        const std::string first_path = getTemporaryPath("trace-1.json");
+        const std::string second_path = getTemporaryPath("trace-2.json");
+        CHECK(tracer.writeChromeTrace(first_path));
+        CHECK(tracer.writeChromeTrace(second_path));
+        const std::string first_trace = readTrace(first_path);
+        const std::string second_trace = readTrace(second_path);
+        CHECK(first_trace.find("\"exiting-worker\"") != std::string::npos);
+        CHECK(first_trace.find("\"worker-event\"") != std::string::npos);
+        CHECK(second_trace.find("\"exiting-worker\"") == std::string::npos);
+        CHECK(second_trace.find("\"worker-event\"") == std::string::npos);
+        tracer.clear();
+    }
+}
+
+
+int main(int argc, char **argv) {
+    return runTests({
+        {"round_trip", checkRoundTrip},
+        {"seek_accuracy", checkSeekAccuracy},
+        {"packet_scan", checkPacketScan},
+        {"clone_checksums", checkCloneMatchesDecode},
+        {"probe_cache_checksums", checkProbeCacheMatchesDecode},
+        {"reopen_checksums", checkReopenMatchesDecode},
+        {"frame_allocator_checksums", checkFrameAllocatorMatchesDecode},
+        {"cropped_output_checksums", checkCroppedOutputMatchesDecode},
+        {"remux_trim", checkRemuxTrim},
+        {"smart_cut", checkSmartCut},
+        {"transcode", checkTranscode},
+        {"pipelined_transcode", checkPipelinedTranscode},
+        {"transcode_frame_rate", checkTranscodeFrameRate},
+        {"ladder", checkLadder},
+        {"scheduler", checkScheduler},
+        {"scheduler_budget", checkSchedulerBudget},
+        {"encoder_options", checkEncoderOptions},
+        {"encoder_threads", checkEncoderThreads},
+        {"native_input", checkNativeInput},
+        {"scaled_input", checkScaledInput},
+        {"async_encode", checkAsyncEncode},
+        {"async_frame_drop", checkAsyncFrameDrop},
+        {"frame_pool", checkFramePool},
+        {"tracer_exited_threads", checkTracerFreesExitedThreads},
+    }, argc, argv);
+}
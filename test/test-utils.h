@@ -0,0 +1,133 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "video-encoder.h"
+
+
+/**
+ * Reports a failed check and marks the running test as failed, without aborting it.
+ */
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            test_failed = true; \
+        } \
+    } while (false)
+
+
+/**
+ * A named test case. It sets `test_failed` through CHECK(...) and may throw to fail early.
+ */
+struct TestCase {
+    const char *name;
+    std::function<void(bool &test_failed)> run;
+};
+
+
+/**
+ * Returns a directory for test files in the system's temporary directory, unique to this process.
+ */
+inline std::filesystem::path getTemporaryDirectory() {
+    static const std::filesystem::path directory = std::filesystem::temp_directory_path() /
+        ("video-library-test-" + std::to_string(std::random_device{}()));
+    return directory;
+}
+
+
+/**
+ * Runs the test cases named on the command line (or all of them) and returns the process exit status.
+ */
+inline int runTests(const std::vector<TestCase> &tests, int argc, char **argv) {
+    int failures = 0;
+    for (const TestCase &test : tests) {
+        bool selected = argc < 2;
+        for (int i = 1; i < argc; i++) {
+            selected = selected || argv[i] == std::string(test.name);
+        }
+        if (!selected) {
+            continue;
+        }
+
+        bool test_failed = false;
+        try {
+            test.run(test_failed);
+        } catch (const std::exception &exception) {
+            std::fprintf(stderr, "%s: exception: %s\n", test.name, exception.what());
+            test_failed = true;
+        }
+        std::fprintf(stderr, "%s %s\n", test_failed ? "FAIL" : "PASS", test.name);
+        failures += test_failed;
+    }
+
+    std::error_code error;
+    std::filesystem::remove_all(getTemporaryDirectory(), error);
+    return failures ? 1 : 0;
+}
+
+
+/**
+ * Fills an RGB24 buffer with a deterministic test pattern: a gradient that changes with the frame
+ * index and a square that moves across it.
+ */
+inline void fillPattern(uint8_t *rgb_buffer, int width, int height, int frame_index) {
+    const int square_size = height / 4;
+    const int square_x = (frame_index * 5) % (width - square_size);
+    const int square_y = (frame_index * 3) % (height - square_size);
+
+    for (int y = 0; y < height; y++) {
+        uint8_t *row = rgb_buffer + static_cast<size_t>(y) * width * 3;
+        for (int x = 0; x < width; x++) {
+            const bool in_square = x >= square_x && x < square_x + square_size &&
+                y >= square_y && y < square_y + square_size;
+            row[3 * x] = in_square ? 240 : static_cast<uint8_t>(x + 4 * frame_index);
+            row[3 * x + 1] = in_square ? 32 : static_cast<uint8_t>(y * 2);
+            row[3 * x + 2] = in_square ? 64 : static_cast<uint8_t>((x + y + frame_index) / 2);
+        }
+    }
+}
+
+
+/**
+ * Encodes `frames` frames of the test pattern into a file.
+ */
+inline void encodeTestClip(const std::string &path, int width, int height, int frames, double fps) {
+    std::vector<uint8_t> rgb_buffer(static_cast<size_t>(width) * height * 3);
+    VideoEncoder encoder(path, width, height, fps, int64_t{width} * height * 8);
+    for (int i = 0; i < frames; i++) {
+        fillPattern(rgb_buffer.data(), width, height, i);
+        encoder.encodeFrame(rgb_buffer.data(), width, height);
+    }
+    encoder.finalize();
+}
+
+
+/**
+ * Returns a path for a test file in the temporary test directory, which is removed by runTests(...).
+ */
+inline std::string getTemporaryPath(const std::string &name) {
+    std::filesystem::create_directories(getTemporaryDirectory());
+    return (getTemporaryDirectory() / name).string();
+}
+
+
+/**
+ * Returns the 64-bit FNV-1a hash of the rows of an image region, ignoring row padding.
+ */
+inline uint64_t getChecksum(const uint8_t *data, int stride, int row_bytes, int rows) {
+    uint64_t hash = 14695981039346656037ull;
+    for (int y = 0; y < rows; y++) {
+        const uint8_t *row = data + static_cast<ptrdiff_t>(y) * stride;
+        for (int x = 0; x < row_bytes; x++) {
+            hash = (hash ^ row[x]) * 1099511628211ull;
+        }
+    }
+    return hash;
+}